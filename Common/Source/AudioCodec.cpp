@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#include "AudioCodec.hpp"
+
+#ifdef JUCE_WINDOWS
+#include <intrin.h>
+#endif
+
+namespace e47 {
+
+namespace {
+
+inline int significantBytes(uint32 x) {
+    if (x == 0) {
+        return 0;
+    }
+#ifdef JUCE_WINDOWS
+    unsigned long idx;
+    _BitScanReverse(&idx, x);
+    return (int)idx / 8 + 1;
+#else
+    return (32 - __builtin_clz(x) + 7) / 8;
+#endif
+}
+
+inline int significantBytes(uint64 x) {
+    if (x == 0) {
+        return 0;
+    }
+#ifdef JUCE_WINDOWS
+    unsigned long idx;
+    _BitScanReverse64(&idx, x);
+    return (int)idx / 8 + 1;
+#else
+    return (64 - __builtin_clzll(x) + 7) / 8;
+#endif
+}
+
+template <typename W>
+inline W lowBytesMask(int n) {
+    return n >= (int)sizeof(W) ? (W)~(W)0 : (W)(((W)1 << (n * 8)) - 1);
+}
+
+template <typename W>
+inline W littleEndian(W x);
+
+template <>
+inline uint32 littleEndian(uint32 x) {
+    return ByteOrder::swapIfBigEndian(x);
+}
+
+template <>
+inline uint64 littleEndian(uint64 x) {
+    return ByteOrder::swapIfBigEndian(x);
+}
+
+template <typename W, typename F>
+size_t encodeWords(const F* src, int samples, char* out) {
+    static_assert(sizeof(W) == sizeof(F), "word size mismatch");
+    size_t pos = 0;
+    W prev = 0;
+    auto next = [&](int i, int& n) {
+        W bits;
+        memcpy(&bits, src + i, sizeof(W));
+        W x = bits ^ prev;
+        prev = bits;
+        n = significantBytes(x);
+        return littleEndian(x);
+    };
+    for (int i = 0; i < samples; i += 2) {
+        int n0, n1 = 0;
+        auto x0 = next(i, n0);
+        auto ctrlPos = pos++;
+        // always write a full word and only advance by the significant bytes, the buffer is padded for this
+        memcpy(out + pos, &x0, sizeof(W));
+        pos += (size_t)n0;
+        if (i + 1 < samples) {
+            auto x1 = next(i + 1, n1);
+            memcpy(out + pos, &x1, sizeof(W));
+            pos += (size_t)n1;
+        }
+        out[ctrlPos] = (char)(n0 | (n1 << 4));
+    }
+    return pos;
+}
+
+template <typename W, typename F>
+size_t decodeWords(const char* in, size_t size, F* dst, int samples) {
+    static_assert(sizeof(W) == sizeof(F), "word size mismatch");
+    size_t pos = 0;
+    W prev = 0;
+    auto next = [&](int i, int n) {
+        W x;
+        memcpy(&x, in + pos, sizeof(W));
+        pos += (size_t)n;
+        prev ^= littleEndian(x) & lowBytesMask<W>(n);
+        memcpy(dst + i, &prev, sizeof(W));
+    };
+    for (int i = 0; i < samples; i += 2) {
+        if (pos >= size) {
+            return 0;
+        }
+        int ctrl = (uint8)in[pos++];
+        int n0 = ctrl & 0xf;
+        int n1 = ctrl >> 4;
+        if (n0 > (int)sizeof(W) || n1 > (int)sizeof(W) || pos + (size_t)(n0 + n1) > size ||
+            (i + 1 == samples && n1 > 0)) {
+            return 0;
+        }
+        next(i, n0);
+        if (i + 1 < samples) {
+            next(i + 1, n1);
+        }
+    }
+    return pos;
+}
+
+}  // namespace
+
+size_t AudioCodec::encodeChannel(const float* src, int samples, char* out) {
+    return encodeWords<uint32>(src, samples, out);
+}
+
+size_t AudioCodec::encodeChannel(const double* src, int samples, char* out) {
+    return encodeWords<uint64>(src, samples, out);
+}
+
+size_t AudioCodec::decodeChannel(const char* in, size_t size, float* dst, int samples) {
+    return decodeWords<uint32>(in, size, dst, samples);
+}
+
+size_t AudioCodec::decodeChannel(const char* in, size_t size, double* dst, int samples) {
+    return decodeWords<uint64>(in, size, dst, samples);
+}
+
+}  // namespace e47
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef AudioCodec_hpp
+#define AudioCodec_hpp
+
+#include <JuceHeader.h>
+
+namespace e47 {
+
+/*
+ * Lossless XOR-delta codec for float/double audio blocks. Each sample is XORed with the previous sample of its channel.
+ * Neighbouring samples share the sign, the exponent and the upper mantissa bits, so only the low bytes of the XOR
+ * value are significant. Two samples share a control byte holding the number of significant bytes of each, followed
+ * by those bytes. The prediction is reset for every block, so each block can be decoded on its own.
+ */
+class AudioCodec {
+  public:
+    // Encoders and decoders access full words, so buffers need this many extra bytes after the encoded data
+    static constexpr size_t PADDING = 8;
+
+    template <typename T>
+    static size_t getMaxEncodedSize(int channels, int samples) {
+        return (size_t)channels * ((size_t)samples * sizeof(T) + (size_t)(samples + 1) / 2) + PADDING;
+    }
+
+    // Returns the number of bytes written to out, that has to be at least getMaxEncodedSize() bytes large
+    template <typename T>
+    static size_t encode(const AudioBuffer<T>& buffer, int channels, int samples, char* out) {
+        size_t size = 0;
+        for (int chan = 0; chan < channels; chan++) {
+            size += encodeChannel(buffer.getReadPointer(chan), samples, out + size);
+        }
+        return size;
+    }
+
+    // Returns false if the data is corrupt, in has to be readable for PADDING bytes after size
+    template <typename T>
+    static bool decode(const char* in, size_t size, AudioBuffer<T>& buffer, int channels, int samples) {
+        size_t offset = 0;
+        for (int chan = 0; chan < channels; chan++) {
+            auto len = decodeChannel(in + offset, size - offset, buffer.getWritePointer(chan), samples);
+            if (len == 0 && samples > 0) {
+                return false;
+            }
+            offset += len;
+        }
+        return offset == size;
+    }
+
+  private:
+    static size_t encodeChannel(const float* src, int samples, char* out);
+    static size_t encodeChannel(const double* src, int samples, char* out);
+    // Returns the number of bytes consumed or 0 on error
+    static size_t decodeChannel(const char* in, size_t size, float* dst, int samples);
+    static size_t decodeChannel(const char* in, size_t size, double* dst, int samples);
+};
+
+}  // namespace e47
+
+#endif /* AudioCodec_hpp */
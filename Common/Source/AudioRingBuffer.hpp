@@ -30,6 +30,24 @@ class AudioRingBuffer {
         allocate(clearNewData);
     }
 
+    // Copy the most recently written samples of another buffer without allocating. They end up right before the write
+    // position, that is reset to the beginning of the buffer. The read position has to be set again afterwards.
+    void copyContentFrom(const AudioRingBuffer& other) {
+        clear();
+        size_t keep = jmin(other.m_samples, m_samples);
+        if (keep > 0) {
+            size_t start = (other.m_writeOffset + other.m_samples - keep) % other.m_samples;
+            size_t part1 = jmin(keep, other.m_samples - start);
+            size_t dst = m_samples - keep;
+            for (size_t c = 0; c < jmin(m_channels, other.m_channels); c++) {
+                memcpy(m_buffer[c].data() + dst, other.m_buffer[c].data() + start, part1 * sizeof(T));
+                memcpy(m_buffer[c].data() + dst + part1, other.m_buffer[c].data(), (keep - part1) * sizeof(T));
+            }
+        }
+        m_readOffset = 0;
+        m_writeOffset = 0;
+    }
+
     void clear() {
         for (size_t c = 0; c < m_buffer.size(); c++) {
             memset(m_buffer[c].data(), 0, m_samples * sizeof(T));
@@ -39,6 +57,8 @@ class AudioRingBuffer {
     int getNumChannels() const noexcept { return (int)m_channels; }
     int getNumSamples() const noexcept { return (int)m_samples; }
 
+    int getWriteOffset() const noexcept { return (int)m_writeOffset; }
+
     void setReadOffset(int offset) {
         if (m_samples > 0) {
             m_readOffset = (size_t)offset;
@@ -67,46 +87,50 @@ class AudioRingBuffer {
         }
     }
 
-    void read(T** dst, int numSamples) {
+    // Reads numChannels channels or all channels, if numChannels is negative
+    void read(T** dst, int numSamples, int numChannels = -1) {
+        size_t channels = numChannels < 0 ? m_channels : jmin(m_channels, (size_t)numChannels);
         size_t samplesToRead = jmin(m_samples, (size_t)numSamples);
         if (m_readOffset + samplesToRead <= m_samples) {
-            for (size_t c = 0; c < m_channels; c++) {
+            for (size_t c = 0; c < channels; c++) {
                 memcpy(dst[c], m_buffer[c].data() + m_readOffset, samplesToRead * sizeof(T));
             }
             incReadOffset((int)samplesToRead);
         } else {
             // read until the end of the buffer
             size_t samplesToReadPart1 = m_samples - m_readOffset;
-            for (size_t c = 0; c < m_channels; c++) {
+            for (size_t c = 0; c < channels; c++) {
                 memcpy(dst[c], m_buffer[c].data() + m_readOffset, samplesToReadPart1 * sizeof(T));
             }
             incReadOffset((int)samplesToReadPart1);
             // read the remaining samples from the beginning
             size_t samplesToReadPart2 = samplesToRead - samplesToReadPart1;
-            for (size_t c = 0; c < m_channels; c++) {
+            for (size_t c = 0; c < channels; c++) {
                 memcpy(dst[c] + samplesToReadPart1, m_buffer[c].data() + m_readOffset, samplesToReadPart2 * sizeof(T));
             }
             incReadOffset((int)samplesToReadPart2);
         }
     }
 
-    void write(const T** src, int numSamples) {
+    // Writes numChannels channels or all channels, if numChannels is negative
+    void write(const T** src, int numSamples, int numChannels = -1) {
+        size_t channels = numChannels < 0 ? m_channels : jmin(m_channels, (size_t)numChannels);
         size_t samplesToWrite = jmin(m_samples, (size_t)numSamples);
         if (m_writeOffset + samplesToWrite <= m_samples) {
-            for (size_t c = 0; c < m_channels; c++) {
+            for (size_t c = 0; c < channels; c++) {
                 memcpy(m_buffer[c].data() + m_writeOffset, src[c], samplesToWrite * sizeof(T));
             }
             incWriteOffset((int)samplesToWrite);
         } else {
             // write until the end of the buffer
             size_t samplesToWritePart1 = m_samples - m_writeOffset;
-            for (size_t c = 0; c < m_channels; c++) {
+            for (size_t c = 0; c < channels; c++) {
                 memcpy(m_buffer[c].data() + m_writeOffset, src[c], samplesToWritePart1 * sizeof(T));
             }
             incWriteOffset((int)samplesToWritePart1);
             // write the remaining samples from the beginning
             size_t samplesToWritePart2 = samplesToWrite - samplesToWritePart1;
-            for (size_t c = 0; c < m_channels; c++) {
+            for (size_t c = 0; c < channels; c++) {
                 memcpy(m_buffer[c].data() + m_writeOffset, src[c] + samplesToWritePart1,
                        samplesToWritePart2 * sizeof(T));
             }
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#include "AudioWireFormat.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AG_WIRE_SSE2
+#include <emmintrin.h>
+#if defined(__F16C__)
+#define AG_WIRE_F16C
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define AG_WIRE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace e47 {
+
+namespace {
+
+constexpr float INT16_SCALE = 32767.0f;
+constexpr float INT24_SCALE = 8388607.0f;
+
+// NaN ends up as -1
+template <typename T>
+inline T clampSample(T x) {
+    return x > (T)-1 ? (x < (T)1 ? x : (T)1) : (T)-1;
+}
+
+inline void putInt16(char* p, int32 v) {
+    p[0] = (char)(v & 0xff);
+    p[1] = (char)((v >> 8) & 0xff);
+}
+
+inline void putInt24(char* p, int32 v) {
+    p[0] = (char)(v & 0xff);
+    p[1] = (char)((v >> 8) & 0xff);
+    p[2] = (char)((v >> 16) & 0xff);
+}
+
+inline int32 getInt16(const char* p) { return (int16)((uint16)(uint8)p[0] | (uint16)((uint8)p[1] << 8)); }
+
+inline int32 getInt24(const char* p) {
+    auto v = (uint32)(uint8)p[0] | ((uint32)(uint8)p[1] << 8) | ((uint32)(uint8)p[2] << 16);
+    return (int32)(v << 8) >> 8;
+}
+
+inline uint16 floatToHalf(float f) {
+    uint32 x;
+    memcpy(&x, &f, sizeof(x));
+    uint32 sign = (x >> 16) & 0x8000;
+    uint32 absx = x & 0x7fffffff;
+    if (absx >= 0x47800000) {
+        // too large, inf or NaN
+        return (uint16)(sign | (absx > 0x7f800000 ? 0x7e00 : 0x7c00));
+    }
+    if (absx < 0x38800000) {
+        // subnormal or zero, the half precision unit is 2^-24
+        float a;
+        memcpy(&a, &absx, sizeof(a));
+        return (uint16)(sign | (uint32)lrintf(a * 16777216.0f));
+    }
+    // rebias the exponent and round to nearest even, an overflow ends up as inf
+    absx += 0xc8000fff + ((absx >> 13) & 1);
+    return (uint16)(sign | (absx >> 13));
+}
+
+inline float halfToFloat(uint16 h) {
+    uint32 sign = (uint32)(h & 0x8000) << 16;
+    uint32 exp = (h >> 10) & 0x1f;
+    uint32 mant = h & 0x3ff;
+    uint32 bits;
+    if (exp == 0) {
+        float f = (float)mant * (1.0f / 16777216.0f);
+        return sign != 0 ? -f : f;
+    } else if (exp == 31) {
+        bits = sign | 0x7f800000 | (mant << 13);
+    } else {
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// The SIMD kernels return the number of processed samples, the rest is handled by the scalar code
+
+int encodeInt16Simd(const float* src, char* dst, int num) {
+    int i = 0;
+#if defined(AG_WIRE_SSE2)
+    const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f), scale = _mm_set1_ps(INT16_SCALE);
+    for (; i + 8 <= num; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo), hi);
+        __m128i ia = _mm_cvtps_epi32(_mm_mul_ps(a, scale));
+        __m128i ib = _mm_cvtps_epi32(_mm_mul_ps(b, scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), _mm_packs_epi32(ia, ib));
+    }
+#elif defined(AG_WIRE_NEON)
+    const float32x4_t lo = vdupq_n_f32(-1.0f), hi = vdupq_n_f32(1.0f);
+    for (; i + 8 <= num; i += 8) {
+        float32x4_t a = vminq_f32(vmaxq_f32(vld1q_f32(src + i), lo), hi);
+        float32x4_t b = vminq_f32(vmaxq_f32(vld1q_f32(src + i + 4), lo), hi);
+        int32x4_t ia = vcvtnq_s32_f32(vmulq_n_f32(a, INT16_SCALE));
+        int32x4_t ib = vcvtnq_s32_f32(vmulq_n_f32(b, INT16_SCALE));
+        vst1q_s16(reinterpret_cast<int16_t*>(dst + i * 2), vcombine_s16(vqmovn_s32(ia), vqmovn_s32(ib)));
+    }
+#else
+    ignoreUnused(src, dst, num);
+#endif
+    return i;
+}
+
+int decodeInt16Simd(const char* src, float* dst, int num) {
+    int i = 0;
+#if defined(AG_WIRE_SSE2)
+    const __m128 scale = _mm_set1_ps(1.0f / INT16_SCALE);
+    for (; i + 8 <= num; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        // sign extend by moving the 16 bit values to the upper half of the 32 bit lanes
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+    }
+#elif defined(AG_WIRE_NEON)
+    for (; i + 8 <= num; i += 8) {
+        int16x8_t v = vld1q_s16(reinterpret_cast<const int16_t*>(src + i * 2));
+        float32x4_t a = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+        float32x4_t b = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+        vst1q_f32(dst + i, vmulq_n_f32(a, 1.0f / INT16_SCALE));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(b, 1.0f / INT16_SCALE));
+    }
+#else
+    ignoreUnused(src, dst, num);
+#endif
+    return i;
+}
+
+int encodeInt24Simd(const float* src, char* dst, int num) {
+    int i = 0;
+#if defined(AG_WIRE_SSE2) || defined(AG_WIRE_NEON)
+    alignas(16) int32 v[4];
+#if defined(AG_WIRE_SSE2)
+    const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f), scale = _mm_set1_ps(INT24_SCALE);
+#else
+    const float32x4_t lo = vdupq_n_f32(-1.0f), hi = vdupq_n_f32(1.0f);
+#endif
+    for (; i + 4 <= num; i += 4) {
+#if defined(AG_WIRE_SSE2)
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi);
+        _mm_store_si128(reinterpret_cast<__m128i*>(v), _mm_cvtps_epi32(_mm_mul_ps(a, scale)));
+#else
+        float32x4_t a = vminq_f32(vmaxq_f32(vld1q_f32(src + i), lo), hi);
+        vst1q_s32(v, vcvtnq_s32_f32(vmulq_n_f32(a, INT24_SCALE)));
+#endif
+        char* p = dst + i * 3;
+        putInt24(p, v[0]);
+        putInt24(p + 3, v[1]);
+        putInt24(p + 6, v[2]);
+        putInt24(p + 9, v[3]);
+    }
+#else
+    ignoreUnused(src, dst, num);
+#endif
+    return i;
+}
+
+int encodeFloat16Simd(const float* src, char* dst, int num) {
+    int i = 0;
+#if defined(AG_WIRE_F16C)
+    for (; i + 8 <= num; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), h);
+    }
+#elif defined(AG_WIRE_NEON)
+    for (; i + 4 <= num; i += 4) {
+        vst1_u16(reinterpret_cast<uint16_t*>(dst + i * 2), vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+    }
+#else
+    ignoreUnused(src, dst, num);
+#endif
+    return i;
+}
+
+int decodeFloat16Simd(const char* src, float* dst, int num) {
+    int i = 0;
+#if defined(AG_WIRE_F16C)
+    for (; i + 8 <= num; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+#elif defined(AG_WIRE_NEON)
+    for (; i + 4 <= num; i += 4) {
+        uint16x4_t h = vld1_u16(reinterpret_cast<const uint16_t*>(src + i * 2));
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(h)));
+    }
+#else
+    ignoreUnused(src, dst, num);
+#endif
+    return i;
+}
+
+template <typename T>
+void encodeScalar(const T* src, char* dst, int i, int num, uint8 fmt) {
+    switch (fmt) {
+        case AudioWireFormat::FLOAT32:
+            for (; i < num; i++) {
+                auto f = (float)src[i];
+                uint32 bits;
+                memcpy(&bits, &f, sizeof(bits));
+                bits = ByteOrder::swapIfBigEndian(bits);
+                memcpy(dst + i * 4, &bits, sizeof(bits));
+            }
+            break;
+        case AudioWireFormat::INT24:
+            for (; i < num; i++) {
+                putInt24(dst + i * 3, (int32)lrint(clampSample(src[i]) * (T)INT24_SCALE));
+            }
+            break;
+        case AudioWireFormat::INT16:
+            for (; i < num; i++) {
+                putInt16(dst + i * 2, (int32)lrint(clampSample(src[i]) * (T)INT16_SCALE));
+            }
+            break;
+        case AudioWireFormat::FLOAT16:
+            for (; i < num; i++) {
+                putInt16(dst + i * 2, floatToHalf((float)src[i]));
+            }
+            break;
+    }
+}
+
+template <typename T>
+void decodeScalar(const char* src, T* dst, int i, int num, uint8 fmt) {
+    switch (fmt) {
+        case AudioWireFormat::FLOAT32:
+            for (; i < num; i++) {
+                uint32 bits;
+                memcpy(&bits, src + i * 4, sizeof(bits));
+                bits = ByteOrder::swapIfBigEndian(bits);
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                dst[i] = (T)f;
+            }
+            break;
+        case AudioWireFormat::INT24:
+            for (; i < num; i++) {
+                dst[i] = (T)getInt24(src + i * 3) * ((T)1 / (T)INT24_SCALE);
+            }
+            break;
+        case AudioWireFormat::INT16:
+            for (; i < num; i++) {
+                dst[i] = (T)getInt16(src + i * 2) * ((T)1 / (T)INT16_SCALE);
+            }
+            break;
+        case AudioWireFormat::FLOAT16:
+            for (; i < num; i++) {
+                dst[i] = (T)halfToFloat((uint16)getInt16(src + i * 2));
+            }
+            break;
+    }
+}
+
+}  // namespace
+
+void AudioWireFormat::encode(const float* src, char* dst, int num, uint8 fmt) {
+    int i = 0;
+    switch (fmt) {
+        case INT24:
+            i = encodeInt24Simd(src, dst, num);
+            break;
+        case INT16:
+            i = encodeInt16Simd(src, dst, num);
+            break;
+        case FLOAT16:
+            i = encodeFloat16Simd(src, dst, num);
+            break;
+    }
+    encodeScalar(src, dst, i, num, fmt);
+}
+
+void AudioWireFormat::encode(const double* src, char* dst, int num, uint8 fmt) { encodeScalar(src, dst, 0, num, fmt); }
+
+void AudioWireFormat::decode(const char* src, float* dst, int num, uint8 fmt) {
+    int i = 0;
+    switch (fmt) {
+        case INT16:
+            i = decodeInt16Simd(src, dst, num);
+            break;
+        case FLOAT16:
+            i = decodeFloat16Simd(src, dst, num);
+            break;
+    }
+    decodeScalar(src, dst, i, num, fmt);
+}
+
+void AudioWireFormat::decode(const char* src, double* dst, int num, uint8 fmt) { decodeScalar(src, dst, 0, num, fmt); }
+
+}  // namespace e47
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef AudioWireFormat_hpp
+#define AudioWireFormat_hpp
+
+#include <JuceHeader.h>
+
+namespace e47 {
+
+/*
+ * Sample formats for transferring audio blocks. NATIVE sends the samples as they are (float or double), all other
+ * formats are converted before sending and converted back to the native precision after receiving. Samples are
+ * little endian on the wire. The integer formats clip the signal to [-1, 1].
+ */
+class AudioWireFormat {
+  public:
+    enum Format : uint8 { NATIVE = 0, FLOAT32, INT24, INT16, FLOAT16, NUM_OF_FORMATS };
+
+    static String toString(uint8 fmt) {
+        switch (fmt) {
+            case NATIVE:
+                return "Native";
+            case FLOAT32:
+                return "Float 32-bit";
+            case INT24:
+                return "Integer 24-bit";
+            case INT16:
+                return "Integer 16-bit";
+            case FLOAT16:
+                return "Float 16-bit";
+        }
+        return "Unknown";
+    }
+
+    static bool isValid(uint8 fmt) { return fmt < NUM_OF_FORMATS; }
+
+    // Returns the format to actually use for samples of type T, FLOAT32 is native for float samples
+    template <typename T>
+    static uint8 resolve(uint8 fmt) {
+        return std::is_same<T, float>::value && fmt == FLOAT32 ? (uint8)NATIVE : fmt;
+    }
+
+    static size_t getSampleSize(uint8 fmt) {
+        switch (fmt) {
+            case FLOAT32:
+                return 4;
+            case INT24:
+                return 3;
+            case INT16:
+            case FLOAT16:
+                return 2;
+        }
+        return 0;
+    }
+
+    // Convert num samples from src to the wire format fmt (fmt must not be NATIVE)
+    static void encode(const float* src, char* dst, int num, uint8 fmt);
+    static void encode(const double* src, char* dst, int num, uint8 fmt);
+
+    // Convert num samples from the wire format fmt (fmt must not be NATIVE) to dst
+    static void decode(const char* src, float* dst, int num, uint8 fmt);
+    static void decode(const char* src, double* dst, int num, uint8 fmt);
+};
+
+}  // namespace e47
+
+#endif /* AudioWireFormat_hpp */
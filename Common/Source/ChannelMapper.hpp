@@ -9,7 +9,7 @@
 #define _CHANNELMAPPER_HPP_
 
 #include <JuceHeader.h>
-#include <set>
+#include <array>
 
 #include "Utils.hpp"
 #include "ChannelSet.hpp"
@@ -18,10 +18,11 @@ namespace e47 {
 
 class ChannelMapper : public LogTagDelegate {
   public:
-    ChannelMapper(LogTag* tag) : LogTagDelegate(tag) {}
+    ChannelMapper(LogTag* tag) : LogTagDelegate(tag) { reset(); }
     ChannelMapper(LogTag* tag, const ChannelSet& activeChannels) : ChannelMapper(tag) { createMapping(activeChannels); }
 
-    // Creates a mapping to copy channels one buffer to a reduced buffer containing only the active channels provided
+    // Creates a mapping to copy channels one buffer to a reduced buffer containing only the active channels provided.
+    // The mapping is flattened into routing tables, so mapping a buffer does not allocate or look anything up.
     void createMapping(const ChannelSet& activeChannels) {
         reset();
         int chSrc = 0, chDst = 0;
@@ -35,7 +36,7 @@ class ChannelMapper : public LogTagDelegate {
             auto& revMap = m_fwdMap;
 #endif
             // input channels exists, so we map from a larger buffer to a smaller buffer and back
-            for (; chSrc < activeChannels.getNumChannelsCombined(); chSrc++) {
+            for (; chSrc < jmin(activeChannels.getNumChannelsCombined(), MAX); chSrc++) {
                 if (activeChannels.isInputActive(chSrc)) {
                     fwdMap[chSrc] = chDst;
                     if (activeChannels.isOutputActive(chSrc)) {
@@ -46,7 +47,7 @@ class ChannelMapper : public LogTagDelegate {
                 }
             }
         } else {  // inst
-            for (; chSrc < activeChannels.getNumChannelsCombined(); chSrc++) {
+            for (; chSrc < jmin(activeChannels.getNumChannelsCombined(), MAX); chSrc++) {
                 if (activeChannels.isOutputActive(chSrc)) {
 #if AG_PLUGIN
                     // no input channels, we just create a reverse map for the plugin side
@@ -58,23 +59,27 @@ class ChannelMapper : public LogTagDelegate {
                 }
             }
         }
+        m_fwdRouting.build(m_fwdMap);
+        m_revRouting.build(m_revMap);
     }
 
     void reset() {
-        m_fwdMap.clear();
-        m_revMap.clear();
+        m_fwdMap.fill(-1);
+        m_revMap.fill(-1);
+        m_fwdRouting.build(m_fwdMap);
+        m_revRouting.build(m_revMap);
     }
 
     template <typename T>
     void map(const AudioBuffer<T>* src, AudioBuffer<T>* dst) const {
         traceScope();
-        mapInternal(src, dst, false);
+        mapInternal(src, dst, m_fwdRouting);
     }
 
     template <typename T>
     void mapReverse(const AudioBuffer<T>* src, AudioBuffer<T>* dst) const {
         traceScope();
-        mapInternal(src, dst, true);
+        mapInternal(src, dst, m_revRouting);
     }
 
     void print() const {
@@ -105,65 +110,71 @@ class ChannelMapper : public LogTagDelegate {
     }
 
   private:
-    std::unordered_map<int, int> m_fwdMap, m_revMap;
-
-    template <typename T>
-    void mapInternal(const AudioBuffer<T>* src, AudioBuffer<T>* dst, bool reverse) const {
-        if (src == dst) {
-            return;
-        }
-        std::set<int> mapped;
-        for (int ch = 0; ch < src->getNumChannels(); ch++) {
-            int chMapped = reverse ? getMappedChannelReverse(ch) : getMappedChannel(ch);
-            if (chMapped > -1) {
-                copyChannel(src, ch, dst, chMapped);
-                mapped.insert(chMapped);
+    static constexpr int MAX = Defaults::PLUGIN_CHANNELS_MAX;
+
+    // Dense channel maps, -1 means unmapped
+    using ChannelMap = std::array<int, MAX>;
+    ChannelMap m_fwdMap, m_revMap;
+
+    // The copy operations for one direction: the (src, dst) channel pairs and the dst channels, that no src channel
+    // is copied to
+    struct Routing {
+        std::array<int, MAX> src, dst, unmapped;
+        int numRoutes = 0;
+        int numUnmapped = 0;
+
+        void build(const ChannelMap& map) {
+            std::array<bool, MAX> mapped;
+            mapped.fill(false);
+            numRoutes = 0;
+            for (int ch = 0; ch < MAX; ch++) {
+                if (map[(size_t)ch] > -1 && map[(size_t)ch] < MAX) {
+                    src[(size_t)numRoutes] = ch;
+                    dst[(size_t)numRoutes] = map[(size_t)ch];
+                    mapped[(size_t)map[(size_t)ch]] = true;
+                    numRoutes++;
+                }
             }
-        }
-        // clear any other channel in the dst buffer, that can't be mapped
-        for (int ch = 0; ch < dst->getNumChannels(); ch++) {
-            if (mapped.find(ch) == mapped.end()) {
-                traceln("clearing unmapped channel " << ch);
-                dst->clear(ch, 0, dst->getNumSamples());
+            numUnmapped = 0;
+            for (int ch = 0; ch < MAX; ch++) {
+                if (!mapped[(size_t)ch]) {
+                    unmapped[(size_t)numUnmapped++] = ch;
+                }
             }
         }
-    }
+    };
 
-    int getMappedChannel(int ch) const {
-        auto it = m_fwdMap.find(ch);
-        if (it != m_fwdMap.end()) {
-            return it->second;
-        }
-        return -1;
-    }
-
-    int getMappedChannelReverse(int ch) const {
-        auto it = m_revMap.find(ch);
-        if (it != m_revMap.end()) {
-            return it->second;
-        }
-        return -1;
-    }
+    Routing m_fwdRouting, m_revRouting;
 
     template <typename T>
-    void copyChannel(const AudioBuffer<T>* src, int chSrc, AudioBuffer<T>* dst, int chDst) const {
-        traceScope();
-        traceln("copying channel " << chSrc << " to " << chDst);
-        if (chSrc < 0 || chSrc >= src->getNumChannels()) {
-            logln("channel mapper can't copy ch " << chSrc << " to " << chDst << ": src channel out of range");
-            return;
-        }
-        if (chDst < 0 || chDst >= dst->getNumChannels()) {
-            logln("channel mapper can't copy ch " << chSrc << " to " << chDst << ": dst channel out of range");
+    void mapInternal(const AudioBuffer<T>* src, AudioBuffer<T>* dst, const Routing& routing) const {
+        if (src == dst) {
             return;
         }
         if (src->getNumSamples() != dst->getNumSamples()) {
-            logln("channel mapper can't copy ch " << chSrc << " to " << chDst
-                                                  << ": src and dst buffers have different numbers of samples");
+            logln("channel mapper can't copy channels: src and dst buffers have different numbers of samples");
             return;
         }
-        dst->copyFrom(chDst, 0, *src, chSrc, 0, src->getNumSamples());
+        int numSamples = src->getNumSamples();
+        int numSrc = src->getNumChannels();
+        int numDst = dst->getNumChannels();
+        auto* srcData = src->getArrayOfReadPointers();
+        auto* dstData = dst->getArrayOfWritePointers();
+        for (int i = 0; i < routing.numRoutes; i++) {
+            int chSrc = routing.src[(size_t)i];
+            int chDst = routing.dst[(size_t)i];
+            if (chSrc < numSrc && chDst < numDst) {
+                FloatVectorOperations::copy(dstData[chDst], srcData[chSrc], numSamples);
+            }
+        }
+        // clear any other channel in the dst buffer, that can't be mapped
+        for (int i = 0; i < routing.numUnmapped && routing.unmapped[(size_t)i] < numDst; i++) {
+            FloatVectorOperations::clear(dstData[routing.unmapped[(size_t)i]], numSamples);
+        }
     }
+
+    int getMappedChannel(int ch) const { return ch >= 0 && ch < MAX ? m_fwdMap[(size_t)ch] : -1; }
+    int getMappedChannelReverse(int ch) const { return ch >= 0 && ch < MAX ? m_revMap[(size_t)ch] : -1; }
 };
 
 }  // namespace e47
@@ -0,0 +1,495 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#if defined(AG_PLUGIN) || defined(AG_SERVER)
+
+#include "DatagramStream.hpp"
+#include "Metrics.hpp"
+
+#ifdef JUCE_WINDOWS
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+namespace e47 {
+
+namespace {
+// The address of the peer of a TCP connection, in the same format DatagramSocket reports the sender of a datagram
+String getPeerAddress(StreamingSocket* socket, const String& fallback) {
+    sockaddr_in addr;
+#ifdef JUCE_WINDOWS
+    int len = sizeof(addr);
+#else
+    socklen_t len = sizeof(addr);
+#endif
+    if (getpeername(socket->getRawSocketHandle(), reinterpret_cast<sockaddr*>(&addr), &len) == 0 &&
+        addr.sin_family == AF_INET) {
+        return String::fromUTF8(inet_ntoa(addr.sin_addr));
+    }
+    return fallback;
+}
+}  // namespace
+
+DatagramStream::DatagramStream(const LogTag* tag, uint64 clientId, StreamingSocket* socket)
+    : LogTagDelegate(tag), m_clientId(clientId), m_socket(socket) {
+    traceScope();
+    m_packet.resize(sizeof(DatagramHeader) + MAX_PAYLOAD);
+    m_recvPacket.resize(sizeof(DatagramHeader) + MAX_PAYLOAD);
+
+    // a block can be many datagrams, so make sure bursts fit into the socket buffers
+    int bufSize = 4 * 1024 * 1024;
+    auto handle = m_udp.getRawSocketHandle();
+    setsockopt(handle, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufSize), sizeof(bufSize));
+    setsockopt(handle, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufSize), sizeof(bufSize));
+
+    auto sim = SystemStats::getEnvironmentVariable("AG_UDP_SIMULATE", "");
+    if (sim.isNotEmpty()) {
+        m_simLoss = sim.upToFirstOccurrenceOf(",", false, false).getFloatValue() / 100.0f;
+        m_simJitter = sim.fromFirstOccurrenceOf(",", false, false).getIntValue();
+        logln("simulating " << String(m_simLoss * 100, 2) << "% datagram loss and up to " << m_simJitter
+                            << "ms jitter");
+    }
+}
+
+DatagramStream::~DatagramStream() {
+    traceScope();
+    close();
+    m_udp.shutdown();
+    if (m_messages > 0) {
+        logln("UDP audio stream closed: " << getStats());
+    }
+}
+
+bool DatagramStream::waitForClient(int port, int timeoutMilliseconds) {
+    traceScope();
+    bool ok = false;
+    bool bound = m_udp.bindToPort(port);
+    if (port == 0) {
+        int32 boundPort = bound ? m_udp.getBoundPort() : 0;
+        if (!e47::send(m_socket, reinterpret_cast<const char*>(&boundPort), sizeof(boundPort))) {
+            logln("failed to send UDP port");
+            return false;
+        }
+    }
+    if (bound) {
+        auto host = m_socket->getHostName();
+        TimeStatistic::Timeout timeout(timeoutMilliseconds);
+        while (!ok && m_socket->isConnected() && timeout.getMillisecondsLeft() > 0) {
+            if (m_udp.waitUntilReady(true, 50) > 0) {
+                String senderHost;
+                int senderPort;
+                int len = m_udp.read(m_recvPacket.data(), (int)m_recvPacket.size(), false, senderHost, senderPort);
+                DatagramHeader hdr;
+                uint64 clientId;
+                if (len == (int)(sizeof(hdr) + sizeof(clientId)) && senderHost == host) {
+                    memcpy(&hdr, m_recvPacket.data(), sizeof(hdr));
+                    memcpy(&clientId, m_recvPacket.data() + sizeof(hdr), sizeof(clientId));
+                    if (hdr.magic == MAGIC_HELLO && clientId == m_clientId) {
+                        m_peerHost = senderHost;
+                        m_peerAddress = senderHost;
+                        m_peerPort = senderPort;
+                        ok = true;
+                    }
+                }
+            }
+        }
+        if (!ok) {
+            logln("no UDP hello received from " << host);
+        }
+    } else {
+        logln("failed to bind UDP port " << port);
+    }
+    char result = ok ? 1 : 0;
+    if (!e47::send(m_socket, &result, 1)) {
+        logln("failed to send UDP negotiation result");
+        return false;
+    }
+    if (ok) {
+        logln("UDP audio stream established with " << m_peerHost << ":" << m_peerPort);
+    }
+    return ok;
+}
+
+DatagramStream::NegotiationResult DatagramStream::connectToServer(const String& host, int port,
+                                                                  int timeoutMilliseconds) {
+    traceScope();
+    if (!m_udp.bindToPort(0)) {
+        logln("failed to bind UDP socket");
+        return NEGOTIATION_FAILED;
+    }
+    if (port == 0) {
+        int32 serverPort = 0;
+        if (!e47::read(m_socket, &serverPort, sizeof(serverPort), timeoutMilliseconds)) {
+            logln("failed to read UDP port");
+            return NEGOTIATION_FAILED;
+        }
+        if (serverPort == 0) {
+            // the server could not bind, only the result follows
+            char result = 0;
+            e47::read(m_socket, &result, 1, timeoutMilliseconds);
+            return NEGOTIATION_DECLINED;
+        }
+        port = serverPort;
+    }
+    m_peerHost = host;
+    m_peerPort = port;
+    // the host might be a name, but datagrams are checked against the address they came from
+    m_peerAddress = getPeerAddress(m_socket, host);
+    char hello[sizeof(DatagramHeader) + sizeof(uint64)];
+    DatagramHeader hdr = {MAGIC_HELLO, 0, sizeof(uint64), 0, 1};
+    memcpy(hello, &hdr, sizeof(hdr));
+    memcpy(hello + sizeof(hdr), &m_clientId, sizeof(m_clientId));
+    TimeStatistic::Timeout timeout(timeoutMilliseconds);
+    do {
+        // datagrams might get lost or arrive before the server is listening, so keep sending until the server answers
+        if (m_udp.write(host, port, hello, sizeof(hello)) < 0) {
+            logln("failed to send UDP hello");
+            return NEGOTIATION_FAILED;
+        }
+        int ret = m_socket->waitUntilReady(true, 50);
+        if (ret > 0) {
+            char result = 0;
+            if (!e47::read(m_socket, &result, 1, 100)) {
+                logln("failed to read UDP negotiation result");
+                return NEGOTIATION_FAILED;
+            }
+            return result == 1 ? NEGOTIATION_OK : NEGOTIATION_DECLINED;
+        } else if (ret < 0) {
+            return NEGOTIATION_FAILED;
+        }
+    } while (timeout.getMillisecondsLeft() > 0);
+    logln("UDP negotiation timed out");
+    return NEGOTIATION_FAILED;
+}
+
+void DatagramStream::close() { m_closed = true; }
+
+bool DatagramStream::isConnected() const {
+    return !m_closed && !m_peerGone && m_peerPort > 0 && nullptr != m_socket && m_socket->isConnected();
+}
+
+bool DatagramStream::checkPeer() {
+    auto now = Time::getMillisecondCounterHiRes();
+    if (now - m_lastPeerCheck >= LIVENESS_CHECK_MILLISECONDS) {
+        m_lastPeerCheck = now;
+        if (m_socket->waitUntilReady(true, 0) != 0) {
+            // nothing is sent over the socket after the negotiation, so this is either EOF or an error
+            m_peerGone = true;
+        }
+    }
+    return !m_peerGone;
+}
+
+bool DatagramStream::writePacket(const char* data, int size) {
+    if (m_simLoss > 0 || m_simJitter > 0) {
+        if (m_simRandom.nextFloat() < m_simLoss) {
+            return true;
+        }
+        if (m_simJitter > 0) {
+            std::lock_guard<std::mutex> lock(m_simMtx);
+            m_simQueue.emplace(Time::getMillisecondCounterHiRes() + m_simRandom.nextInt(m_simJitter + 1),
+                               std::vector<char>(data, data + size));
+            return true;
+        }
+    }
+    return m_udp.write(m_peerHost, m_peerPort, data, size) == size;
+}
+
+void DatagramStream::flushSimulated() {
+    if (m_simJitter == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_simMtx);
+    auto now = Time::getMillisecondCounterHiRes();
+    while (!m_simQueue.empty() && m_simQueue.begin()->first <= now) {
+        auto& packet = m_simQueue.begin()->second;
+        m_udp.write(m_peerHost, m_peerPort, packet.data(), (int)packet.size());
+        m_simQueue.erase(m_simQueue.begin());
+    }
+}
+
+bool DatagramStream::sendv(const IOSlices& slices, MessageHelper::Error* e, Meter* metric) {
+    traceScope();
+    if (!isConnected()) {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        traceln("failed: E_STATE");
+        return false;
+    }
+    size_t size = 0;
+    for (auto& slice : slices) {
+        size += (size_t)slice.size;
+    }
+    if (size > (size_t)MAX_MESSAGE_SIZE) {
+        MessageHelper::seterr(e, MessageHelper::E_SIZE, "message too large");
+        return false;
+    }
+    if (m_sendBuf.size() < size) {
+        m_sendBuf.resize(size);
+    }
+    size_t offset = 0;
+    for (auto& slice : slices) {
+        memcpy(m_sendBuf.data() + offset, slice.data, (size_t)slice.size);
+        offset += (size_t)slice.size;
+    }
+    flushSimulated();
+    DatagramHeader hdr;
+    hdr.magic = MAGIC_DATA;
+    hdr.seq = m_sendSeq++;
+    hdr.size = (uint32)size;
+    hdr.numFrags = (uint16)jmax((size_t)1, (size + MAX_PAYLOAD - 1) / MAX_PAYLOAD);
+    offset = 0;
+    for (hdr.frag = 0; hdr.frag < hdr.numFrags; hdr.frag++) {
+        auto len = jmin((size_t)MAX_PAYLOAD, size - offset);
+        memcpy(m_packet.data(), &hdr, sizeof(hdr));
+        memcpy(m_packet.data() + sizeof(hdr), m_sendBuf.data() + offset, len);
+        if (!writePacket(m_packet.data(), (int)(sizeof(hdr) + len))) {
+            MessageHelper::seterr(e, MessageHelper::E_SYSCALL);
+            traceln("write failed: E_SYSCALL");
+            return false;
+        }
+        offset += len;
+    }
+    if (nullptr != metric) {
+        metric->increment((uint32)size);
+    }
+    return true;
+}
+
+bool DatagramStream::receive(int timeoutMilliseconds) {
+    flushSimulated();
+    if (m_simJitter > 0) {
+        std::lock_guard<std::mutex> lock(m_simMtx);
+        if (!m_simQueue.empty()) {
+            auto due = (int)(m_simQueue.begin()->first - Time::getMillisecondCounterHiRes());
+            timeoutMilliseconds = jlimit(0, timeoutMilliseconds, due);
+        }
+    }
+    int ret = m_udp.waitUntilReady(true, timeoutMilliseconds);
+    while (ret > 0) {
+        String senderHost;
+        int senderPort;
+        int len = m_udp.read(m_recvPacket.data(), (int)m_recvPacket.size(), false, senderHost, senderPort);
+        if (len <= 0) {
+            break;
+        }
+        // anyone, that can reach the port, can send datagrams, only accept them from the peer
+        if (senderPort == m_peerPort && senderHost == m_peerAddress) {
+            handleDatagram(m_recvPacket.data(), len);
+        } else {
+            m_foreignDatagrams++;
+        }
+        ret = m_udp.waitUntilReady(true, 0);
+    }
+    return ret >= 0;
+}
+
+void DatagramStream::handleDatagram(const char* data, int size) {
+    DatagramHeader hdr;
+    if (size < (int)sizeof(hdr)) {
+        return;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    auto payload = (size_t)size - sizeof(hdr);
+    auto offset = (size_t)hdr.frag * MAX_PAYLOAD;
+    if (hdr.magic != MAGIC_DATA || hdr.size > (uint32)MAX_MESSAGE_SIZE || hdr.frag >= hdr.numFrags ||
+        offset + payload > hdr.size || (hdr.frag + 1 < hdr.numFrags && payload != MAX_PAYLOAD)) {
+        return;
+    }
+    if ((int32)(hdr.seq - m_expectedSeq) < 0) {
+        // the message has been delivered or concealed already
+        m_lateDatagrams++;
+        return;
+    }
+    auto it = m_pending.find(hdr.seq);
+    if (it == m_pending.end()) {
+        if (m_pending.size() >= MAX_PENDING) {
+            return;
+        }
+        auto& p = m_pending[hdr.seq];
+        p.data.swap(m_spare);
+        p.data.resize(hdr.size);
+        p.received.assign(hdr.numFrags, false);
+        p.missing = hdr.numFrags;
+        p.firstArrival = Time::getMillisecondCounterHiRes();
+        it = m_pending.find(hdr.seq);
+    }
+    auto& p = it->second;
+    if (p.data.size() != hdr.size || p.received.size() != hdr.numFrags) {
+        return;
+    }
+    if (!p.received[hdr.frag]) {
+        memcpy(p.data.data() + offset, data + sizeof(hdr), payload);
+        p.received[hdr.frag] = true;
+        p.missing--;
+    }
+}
+
+void DatagramStream::dropStalePending() {
+    while (!m_pending.empty() && (int32)(m_pending.begin()->first - m_expectedSeq) < 0) {
+        m_pending.erase(m_pending.begin());
+    }
+}
+
+bool DatagramStream::nextMessage(int timeoutMilliseconds, MessageHelper::Error* e) {
+    auto start = Time::getMillisecondCounterHiRes();
+    while (true) {
+        auto now = Time::getMillisecondCounterHiRes();
+        auto it = m_pending.find(m_expectedSeq);
+        if (it != m_pending.end() && it->second.missing == 0) {
+            // keep the most recent message for concealment and recycle the oldest buffer
+            if (!m_concealed) {
+                m_last.swap(m_current);
+            }
+            m_current.swap(it->second.data);
+            m_spare.swap(it->second.data);
+            m_pending.erase(it);
+            m_currentPos = 0;
+            m_concealed = false;
+            m_hasLast = true;
+            m_expectedSeq++;
+            m_messages++;
+            dropStalePending();
+            return true;
+        }
+        bool laterArrived = false;
+        for (auto& p : m_pending) {
+            if ((int32)(p.first - m_expectedSeq) > 0 && now - p.second.firstArrival >= JITTER_MILLISECONDS) {
+                laterArrived = true;
+                break;
+            }
+        }
+        bool concealTimeout = m_concealTimeout > 0 && now - start >= m_concealTimeout;
+        if (laterArrived || concealTimeout) {
+            if (m_hasLast) {
+                if (!m_concealed) {
+                    m_last.swap(m_current);
+                }
+                m_current = m_last;
+                m_currentPos = 0;
+                m_concealed = true;
+                m_expectedSeq++;
+                m_messages++;
+                m_concealedMessages++;
+                dropStalePending();
+                return true;
+            } else if (laterArrived) {
+                // nothing to repeat yet, skip the message
+                m_expectedSeq++;
+                dropStalePending();
+                continue;
+            }
+        }
+        if (timeoutMilliseconds > 0 && now - start >= timeoutMilliseconds) {
+            MessageHelper::seterr(e, MessageHelper::E_TIMEOUT);
+            traceln("failed: E_TIMEOUT");
+            return false;
+        }
+        if (!checkPeer()) {
+            MessageHelper::seterr(e, MessageHelper::E_STATE);
+            traceln("peer gone: E_STATE");
+            return false;
+        }
+        // poll with a fine granularity while a message is on its way, so it can be concealed in time
+        if (!receive(m_pending.empty() && m_concealTimeout == 0 ? LIVENESS_CHECK_MILLISECONDS : 1)) {
+            MessageHelper::seterr(e, MessageHelper::E_SYSCALL);
+            traceln("receive failed: E_SYSCALL");
+            return false;
+        }
+    }
+}
+
+bool DatagramStream::read(void* data, int size, int timeoutMilliseconds, MessageHelper::Error* e, Meter* metric) {
+    traceScope();
+    MessageHelper::seterr(e, MessageHelper::E_NONE);
+    if (!isConnected()) {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        traceln("failed: E_STATE");
+        return false;
+    }
+    if (size <= 0) {
+        return true;
+    }
+    if (m_currentPos >= m_current.size() && !nextMessage(timeoutMilliseconds, e)) {
+        return false;
+    }
+    if (m_currentPos + (size_t)size > m_current.size()) {
+        MessageHelper::seterr(e, MessageHelper::E_DATA, "message too short");
+        return false;
+    }
+    memcpy(data, m_current.data() + m_currentPos, (size_t)size);
+    m_currentPos += (size_t)size;
+    if (nullptr != metric) {
+        metric->increment((uint32)size);
+    }
+    return true;
+}
+
+bool DatagramStream::waitUntilReady(int timeoutMilliseconds) {
+    if (!isConnected()) {
+        return false;
+    }
+    if (m_currentPos < m_current.size() || !m_pending.empty()) {
+        return true;
+    }
+    if (!receive(timeoutMilliseconds) || !checkPeer()) {
+        return false;
+    }
+    return !m_pending.empty();
+}
+
+String DatagramStream::getStats() const {
+    String s;
+    s << (int64)m_messages << " messages, " << (int64)m_concealedMessages << " concealed";
+    if (m_messages > 0) {
+        s << " (" << String((double)m_concealedMessages * 100 / (double)m_messages, 2) << "%)";
+    }
+    s << ", " << (int64)m_lateDatagrams << " late datagrams";
+    if (m_foreignDatagrams > 0) {
+        s << ", " << (int64)m_foreignDatagrams << " datagrams from unknown senders dropped";
+    }
+    return s;
+}
+
+bool send(DatagramStream* stream, const char* data, int size, MessageHelper::Error* e, Meter* metric) {
+    return sendv(stream, {{const_cast<char*>(data), size}}, e, metric);
+}
+
+bool read(DatagramStream* stream, void* data, int size, int timeoutMilliseconds, MessageHelper::Error* e,
+          Meter* metric) {
+    if (nullptr == stream) {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        return false;
+    }
+    return stream->read(data, size, timeoutMilliseconds, e, metric);
+}
+
+bool sendv(DatagramStream* stream, const IOSlices& slices, MessageHelper::Error* e, Meter* metric) {
+    if (nullptr == stream) {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        return false;
+    }
+    return stream->sendv(slices, e, metric);
+}
+
+bool readv(DatagramStream* stream, const IOSlices& slices, int timeoutMilliseconds, MessageHelper::Error* e,
+           Meter* metric) {
+    for (auto& slice : slices) {
+        if (!read(stream, slice.data, slice.size, timeoutMilliseconds, e, metric)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isConcealed(DatagramStream* stream) { return nullptr != stream && stream->isConcealed(); }
+
+}  // namespace e47
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef DatagramStream_hpp
+#define DatagramStream_hpp
+
+#if defined(AG_PLUGIN) || defined(AG_SERVER)
+
+#include <JuceHeader.h>
+#include <map>
+#include <mutex>
+
+#include "Message.hpp"
+#include "Utils.hpp"
+
+namespace e47 {
+
+/*
+ * Message oriented audio transport over UDP. Every sendv() call is one message, that is split into datagrams carrying
+ * a sequence number. The receiver reassembles the messages and delivers them in order. A message, that is still
+ * missing when a later message has been waiting for the jitter buffer time (or when the conceal timeout has passed),
+ * is replaced by repeating the previous message, so a lost datagram never stalls the stream.
+ *
+ * The audio socket stays connected for the negotiation and is used for liveness afterwards: nothing is sent over it,
+ * so the socket becoming readable means the peer is gone.
+ *
+ * For testing, loss and jitter can be simulated on the sending side by setting AG_UDP_SIMULATE=<loss %>,<jitter ms>.
+ */
+class DatagramStream : public LogTagDelegate {
+  public:
+    DatagramStream(const LogTag* tag, uint64 clientId, StreamingSocket* socket);
+    ~DatagramStream() override;
+
+    // Server side: bind to the given port and wait for the client. The result is sent to the client over the audio
+    // socket. If port is 0, any free port is used and sent to the client over the audio socket first.
+    bool waitForClient(int port, int timeoutMilliseconds);
+
+    enum NegotiationResult { NEGOTIATION_OK, NEGOTIATION_DECLINED, NEGOTIATION_FAILED };
+
+    // Client side: announce the stream to the server and wait for the result of the negotiation. If the server
+    // declined, the audio socket can be used for TCP streaming. If port is 0, the port is read from the audio socket.
+    NegotiationResult connectToServer(const String& host, int port, int timeoutMilliseconds);
+
+    void close();
+    bool isConnected() const;
+
+    // Replace the next message, if it did not arrive within the given time after starting to read it. By default
+    // messages are concealed only after a later message arrived.
+    void setConcealTimeout(int ms) { m_concealTimeout = ms; }
+
+    bool sendv(const IOSlices& slices, MessageHelper::Error* e, Meter* metric);
+    bool read(void* data, int size, int timeoutMilliseconds, MessageHelper::Error* e, Meter* metric);
+    bool waitUntilReady(int timeoutMilliseconds);
+
+    bool isConcealed() const { return m_concealed; }
+    String getStats() const;
+
+  private:
+    static constexpr uint32 MAGIC_DATA = 0x41475544;   // AGUD
+    static constexpr uint32 MAGIC_HELLO = 0x41475548;  // AGUH
+    static constexpr int MAX_PAYLOAD = 1400;
+    static constexpr int MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+    static constexpr int MAX_PENDING = 64;
+    static constexpr int JITTER_MILLISECONDS = 5;
+    static constexpr int LIVENESS_CHECK_MILLISECONDS = 100;
+
+    struct DatagramHeader {
+        uint32 magic;
+        uint32 seq;
+        uint32 size;
+        uint16 frag;
+        uint16 numFrags;
+    };
+
+    struct Pending {
+        std::vector<char> data;
+        std::vector<bool> received;
+        int missing = 0;
+        double firstArrival = 0;
+    };
+
+    uint64 m_clientId;
+    StreamingSocket* m_socket;
+    DatagramSocket m_udp;
+    String m_peerHost;
+    String m_peerAddress;
+    int m_peerPort = 0;
+    std::atomic_bool m_peerGone{false};
+    std::atomic_bool m_closed{false};
+    std::atomic<double> m_lastPeerCheck{0};
+    int m_concealTimeout = 0;
+
+    uint32 m_sendSeq = 0;
+    std::vector<char> m_sendBuf;
+    std::vector<char> m_packet;
+    std::vector<char> m_recvPacket;
+
+    uint32 m_expectedSeq = 0;
+    std::map<uint32, Pending> m_pending;
+    std::vector<char> m_current;
+    size_t m_currentPos = 0;
+    std::vector<char> m_last;
+    std::vector<char> m_spare;
+    bool m_hasLast = false;
+    bool m_concealed = false;
+
+    uint64 m_messages = 0;
+    uint64 m_concealedMessages = 0;
+    uint64 m_lateDatagrams = 0;
+    uint64 m_foreignDatagrams = 0;
+
+    // loss/jitter simulation, the queue is flushed by the sending and the receiving thread
+    float m_simLoss = 0;
+    int m_simJitter = 0;
+    Random m_simRandom;
+    std::multimap<double, std::vector<char>> m_simQueue;
+    std::mutex m_simMtx;
+
+    bool writePacket(const char* data, int size);
+    void flushSimulated();
+    bool receive(int timeoutMilliseconds);
+    void handleDatagram(const char* data, int size);
+    void dropStalePending();
+    bool nextMessage(int timeoutMilliseconds, MessageHelper::Error* e);
+    bool checkPeer();
+};
+
+}  // namespace e47
+
+#endif
+
+#endif /* DatagramStream_hpp */
@@ -213,6 +213,12 @@ inline String getConfigFileName(ConfigFile type) {
     return file;
 }
 
+inline String getSharedMemoryFileName(uint64 clientId) {
+    return File(WINDOW_POSITIONS_FILE)
+        .getSiblingFile("audio_" + String::toHexString(clientId) + ".shm")
+        .getFullPathName();
+}
+
 static constexpr int DEFAULT_NUM_OF_BUFFERS = 8;
 static constexpr int DEFAULT_NUM_RECENTS = 10;
 static constexpr int DEFAULT_LOAD_PLUGIN_TIMEOUT = 15000;
@@ -16,6 +16,7 @@
 #include <windows.h>
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #endif
 
@@ -122,6 +123,178 @@ bool read(StreamingSocket* socket, void* data, int size, int timeoutMilliseconds
     }
 }
 
+namespace {
+// max number of buffers passed to a single sendmsg/recvmsg call, needs to be below IOV_MAX (1024 on all platforms)
+constexpr size_t MAX_IOV = 256;
+
+// Calls sendmsg/recvmsg (or WSASend/WSARecv) for the slices starting at index idx with the first slice being advanced
+// by offset bytes. Returns the number of bytes transferred or -1.
+int sliceIO(StreamingSocket* socket, bool write, const IOSlices& slices, size_t idx, int offset) {
+    auto count = jmin(slices.size() - idx, MAX_IOV);
+#ifdef JUCE_WINDOWS
+    WSABUF bufs[MAX_IOV];
+    for (size_t i = 0; i < count; i++) {
+        auto& slice = slices[idx + i];
+        bufs[i].buf = slice.data + (i == 0 ? offset : 0);
+        bufs[i].len = (ULONG)(slice.size - (i == 0 ? offset : 0));
+    }
+    DWORD len = 0;
+    DWORD flags = 0;
+    auto handle = (SOCKET)socket->getRawSocketHandle();
+    int ret = write ? WSASend(handle, bufs, (DWORD)count, &len, 0, NULL, NULL)
+                    : WSARecv(handle, bufs, (DWORD)count, &len, &flags, NULL, NULL);
+    return ret == 0 ? (int)len : -1;
+#else
+    struct iovec iov[MAX_IOV];
+    for (size_t i = 0; i < count; i++) {
+        auto& slice = slices[idx + i];
+        iov[i].iov_base = slice.data + (i == 0 ? offset : 0);
+        iov[i].iov_len = (size_t)(slice.size - (i == 0 ? offset : 0));
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (decltype(msg.msg_iovlen))count;
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
+    auto ret = write ? sendmsg(socket->getRawSocketHandle(), &msg, flags)
+                     : recvmsg(socket->getRawSocketHandle(), &msg, flags);
+    return (int)ret;
+#endif
+}
+
+// Moves the slice position forward by len bytes
+void advanceSlices(const IOSlices& slices, size_t& idx, int& offset, int len) {
+    while (len > 0 && idx < slices.size()) {
+        int left = slices[idx].size - offset;
+        if (len >= left) {
+            len -= left;
+            idx++;
+            offset = 0;
+        } else {
+            offset += len;
+            len = 0;
+        }
+    }
+    // skip empty slices
+    while (idx < slices.size() && slices[idx].size - offset == 0) {
+        idx++;
+        offset = 0;
+    }
+}
+
+int getSlicesSize(const IOSlices& slices) {
+    int size = 0;
+    for (auto& slice : slices) {
+        size += slice.size;
+    }
+    return size;
+}
+}  // namespace
+
+bool sendv(StreamingSocket* socket, const IOSlices& slices, MessageHelper::Error* e, Meter* metric) {
+    setLogTagStatic("sendv");
+    traceScope();
+    if (nullptr != socket && socket->isConnected()) {
+        size_t idx = 0;
+        int offset = 0;
+        int maxTries = 10;
+        advanceSlices(slices, idx, offset, 0);
+        while (idx < slices.size() && maxTries > 0) {
+            int ret = socket->waitUntilReady(false, 100);
+            if (ret < 0) {
+                MessageHelper::seterr(e, MessageHelper::E_SYSCALL);
+                traceln("waitUntilReady failed: E_SYSCALL");
+                return false;  // error
+            } else if (ret > 0) {
+                int len = sliceIO(socket, true, slices, idx, offset);
+                if (len < 0) {
+                    MessageHelper::seterr(e, MessageHelper::E_SYSCALL);
+                    traceln("sendmsg failed: E_SYSCALL");
+                    return false;
+                }
+                advanceSlices(slices, idx, offset, len);
+            } else {
+                maxTries--;
+            }
+        }
+        if (idx < slices.size()) {
+            MessageHelper::seterr(e, MessageHelper::E_TIMEOUT);
+            traceln("failed: E_TIMEOUT");
+            return false;
+        }
+        if (nullptr != metric) {
+            metric->increment((uint32)getSlicesSize(slices));
+        }
+        return true;
+    } else {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        traceln("failed: E_STATE");
+        return false;
+    }
+}
+
+bool readv(StreamingSocket* socket, const IOSlices& slices, int timeoutMilliseconds, MessageHelper::Error* e,
+           Meter* metric) {
+    setLogTagStatic("readv");
+    traceScope();
+    MessageHelper::seterr(e, MessageHelper::E_NONE);
+    if (nullptr == socket || !socket->isConnected()) {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        traceln("failed: E_STATE");
+        return false;
+    }
+    auto now = Time::getMillisecondCounterHiRes();
+    auto until = now;
+    if (timeoutMilliseconds > 0) {
+        until += timeoutMilliseconds;
+    }
+    size_t idx = 0;
+    int offset = 0;
+    advanceSlices(slices, idx, offset, 0);
+    while (idx < slices.size() && (timeoutMilliseconds == 0 || now <= until)) {
+        int ret = socket->waitUntilReady(true, 100);
+        if (ret < 0) {
+            MessageHelper::seterr(e, MessageHelper::E_SYSCALL);
+            traceln("waitUntilReady failed: E_SYSCALL");
+            return false;  // error
+        } else if (ret > 0) {
+            int len = sliceIO(socket, false, slices, idx, offset);
+            if (len < 0) {
+#ifdef JUCE_WINDOWS
+                bool isError = WSAGetLastError() != WSAEWOULDBLOCK;
+#else
+                bool isError = errno != EAGAIN && errno != EINTR;
+#endif
+                if (isError) {
+                    MessageHelper::seterr(e, MessageHelper::E_SYSCALL);
+                    traceln("recvmsg failed: E_SYSCALL");
+                    return false;
+                }
+            } else if (len == 0) {
+                MessageHelper::seterr(e, MessageHelper::E_DATA);
+                traceln("failed: E_DATA");
+                return false;
+            } else {
+                advanceSlices(slices, idx, offset, len);
+            }
+        }
+        now = Time::getMillisecondCounterHiRes();
+    }
+    if (idx == slices.size()) {
+        if (nullptr != metric) {
+            metric->increment((uint32)getSlicesSize(slices));
+        }
+        return true;
+    } else {
+        MessageHelper::seterr(e, MessageHelper::E_TIMEOUT);
+        traceln("failed: E_TIMEOUT");
+        return false;
+    }
+}
+
 bool setNonBlocking(int handle) noexcept {
 #ifdef JUCE_WINDOWS
     DWORD nonBlocking = 1;
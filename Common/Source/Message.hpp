@@ -17,6 +17,8 @@ using json = nlohmann::json;
 #include "KeyAndMouseCommon.hpp"
 #include "Utils.hpp"
 #include "Metrics.hpp"
+#include "AudioCodec.hpp"
+#include "AudioWireFormat.hpp"
 
 namespace e47 {
 
@@ -80,13 +82,53 @@ bool send(StreamingSocket* socket, const char* data, int size, MessageHelper::Er
 bool read(StreamingSocket* socket, void* data, int size, int timeoutMilliseconds = 0, MessageHelper::Error* e = nullptr,
           Meter* metric = nullptr);
 
+/*
+ * Scatter/gather I/O, a list of slices is transferred with as few syscalls as possible
+ */
+struct IOSlice {
+    char* data;
+    int size;
+};
+
+using IOSlices = std::vector<IOSlice>;
+
+bool sendv(StreamingSocket* socket, const IOSlices& slices, MessageHelper::Error* e = nullptr, Meter* metric = nullptr);
+bool readv(StreamingSocket* socket, const IOSlices& slices, int timeoutMilliseconds = 0,
+           MessageHelper::Error* e = nullptr, Meter* metric = nullptr);
+
+class SharedMemoryStream;
+
+bool send(SharedMemoryStream* stream, const char* data, int size, MessageHelper::Error* e = nullptr,
+          Meter* metric = nullptr);
+bool read(SharedMemoryStream* stream, void* data, int size, int timeoutMilliseconds = 0,
+          MessageHelper::Error* e = nullptr, Meter* metric = nullptr);
+bool sendv(SharedMemoryStream* stream, const IOSlices& slices, MessageHelper::Error* e = nullptr,
+           Meter* metric = nullptr);
+bool readv(SharedMemoryStream* stream, const IOSlices& slices, int timeoutMilliseconds = 0,
+           MessageHelper::Error* e = nullptr, Meter* metric = nullptr);
+
+class DatagramStream;
+
+bool send(DatagramStream* stream, const char* data, int size, MessageHelper::Error* e = nullptr,
+          Meter* metric = nullptr);
+bool read(DatagramStream* stream, void* data, int size, int timeoutMilliseconds = 0,
+          MessageHelper::Error* e = nullptr, Meter* metric = nullptr);
+bool sendv(DatagramStream* stream, const IOSlices& slices, MessageHelper::Error* e = nullptr,
+           Meter* metric = nullptr);
+bool readv(DatagramStream* stream, const IOSlices& slices, int timeoutMilliseconds = 0,
+           MessageHelper::Error* e = nullptr, Meter* metric = nullptr);
+
+// True if the last message read from the stream replaces a lost message
+inline bool isConcealed(const void*) { return false; }
+bool isConcealed(DatagramStream* stream);
+
 bool setNonBlocking(int handle) noexcept;
 StreamingSocket* accept(StreamingSocket*, int timeoutMs = 1000, std::function<bool()> abortFn = nullptr);
 
 /*
  * Client/Server handshake
  */
-static constexpr int AG_PROTOCOL_VERSION = 6;
+static constexpr int AG_PROTOCOL_VERSION = 7;
 
 struct HandshakeRequest {
     int version;
@@ -98,13 +140,31 @@ struct HandshakeRequest {
     bool doublePrecission;
     uint64 clientId;
     uint8 flags;
-    uint8 unused1;
+    uint8 wireFormat;
     uint64 activeChannels;
-    uint16 unused2;
+    uint16 stream;
+
+    // SESSION_ATTACH: the handshake connection becomes the command connection and the other connections are made to
+    // the server port as well. Each of them starts with a request, that has the ATTACH_STREAM flag, the client ID and
+    // the stream set. Only the version, the client ID, the flags and the stream are used in such a request.
+    //
+    // RESUME_SESSION: the request is followed by a ResumeRequest. The server hands over the plugin chain of the
+    // previous session of the client, if it is still parked and matches.
+    enum FLAGS : uint8 {
+        NO_PLUGINLIST_FILTER = 1,
+        SHARED_MEMORY_AUDIO = 2,
+        COMPRESSED_AUDIO = 4,
+        UDP_AUDIO = 8,
+        SESSION_ATTACH = 16,
+        ATTACH_STREAM = 32,
+        RESUME_SESSION = 64
+    };
+    enum STREAMS : uint16 { STREAM_COMMANDS = 0, STREAM_CALLBACKS = 1, STREAM_AUDIO = 2, STREAM_SCREEN = 3 };
+    static constexpr int NUM_STREAMS = 4;
 
-    enum FLAGS : uint8 { NO_PLUGINLIST_FILTER = 1 };
     void setFlag(uint8 f) { flags |= f; }
-    bool isFlag(uint8 f) { return (flags & f) == f; }
+    void unsetFlag(uint8 f) { flags &= (uint8)~f; }
+    bool isFlag(uint8 f) const { return (flags & f) == f; }
 
     json toJson() const {
         json j;
@@ -117,6 +177,7 @@ struct HandshakeRequest {
         j["doublePrecission"] = doublePrecission;
         j["clientId"] = clientId;
         j["flags"] = flags;
+        j["wireFormat"] = wireFormat;
         j["activeChannels"] = activeChannels;
         return j;
     }
@@ -131,22 +192,44 @@ struct HandshakeRequest {
         doublePrecission = j["doublePrecission"].get<bool>();
         clientId = j["clientId"].get<uint64>();
         flags = j["flags"].get<uint8>();
+        wireFormat = j["wireFormat"].get<uint8>();
         activeChannels = j["activeChannels"].get<uint64>();
     }
 };
 
+struct ResumeRequest {
+    uint32 token;
+    uint32 unused;
+    int64 chain;
+
+    // Identifies a chain by the IDs of its plugins in order
+    static int64 getChainFingerprint(const StringArray& ids) { return ids.joinIntoString("|").hashCode64(); }
+};
+
 struct HandshakeResponse {
     int version;
     uint32 flags;
     int port;
-    uint32 unused1;
-    uint32 unused2;
+    uint32 wireFormat;
+    uint32 sessionToken;
     uint32 unused3;
     uint32 unused4;
     uint32 unused5;
     uint32 unused6;
 
-    enum FLAGS : uint32 { SANDBOX_ENABLED = 1, LOCAL_MODE = 2 };
+    enum FLAGS : uint32 {
+        SANDBOX_ENABLED = 1,
+        LOCAL_MODE = 2,
+        SHARED_MEMORY_AUDIO = 4,
+        COMPRESSED_AUDIO = 8,
+        UDP_AUDIO = 16,
+        PLUGIN_DSP_LOAD = 32,
+        XRUN_REPORTING = 64,
+        SESSION_ATTACH = 128,
+        SESSION_RESUME = 256,  // the session token can be used to resume the session after a disconnect
+        SESSION_RESUMED = 512,  // the plugin chain of the previous session has been taken over
+        LOAD_CHAIN = 1024
+    };
     void setFlag(uint32 f) { flags |= f; }
     bool isFlag(uint32 f) { return (flags & f) == f; }
 };
@@ -165,6 +248,8 @@ class AudioMessage : public LogTagDelegate {
         int samplesRequested;   // If only midi data is sent, let the server know about the expected audio buffer size
         int numMidiEvents;
         bool isDouble;
+        uint8 wireFormat;  // The server responds in the same format
+        uint32 seq;        // The server responds with the same sequence number
     };
 
     struct ResponseHeader {
@@ -172,6 +257,7 @@ class AudioMessage : public LogTagDelegate {
         int samples;
         int numMidiEvents;
         int latencySamples;
+        uint32 seq;
     };
 
     struct MidiHeader {
@@ -186,82 +272,84 @@ class AudioMessage : public LogTagDelegate {
     bool isDouble() const { return m_reqHeader.isDouble; }
 
     int getLatencySamples() const { return m_resHeader.latencySamples; }
+    uint32 getRequestSequence() const { return m_reqHeader.seq; }
+    uint32 getResponseSequence() const { return m_resHeader.seq; }
+
+    // With compression enabled the channel data is sent as an int holding the encoded size followed by the data
+    // encoded with AudioCodec. Both sides have to agree on this in the handshake.
+    void setCompression(bool b) {
+        m_compress = b;
+        if (b) {
+            initCodecStats();
+        }
+    }
+    bool getCompression() const { return m_compress; }
+
+    // The negotiated AudioWireFormat. It takes precedence over compression. The client sends the format with each
+    // request, the server accepts the negotiated format or NATIVE.
+    void setWireFormat(uint8 fmt) {
+        m_wireFormat = fmt;
+        // responses are decoded in the requested format, this matters if a message is used for reading only
+        m_reqHeader.wireFormat = fmt;
+        if (fmt != AudioWireFormat::NATIVE) {
+            initCodecStats();
+        }
+    }
+    uint8 getWireFormat() const { return m_wireFormat; }
 
-    template <typename T>
-    bool sendToServer(StreamingSocket* socket, AudioBuffer<T>& buffer, MidiBuffer& midi,
-                      AudioPlayHead::CurrentPositionInfo& posInfo, int channelsRequested, int samplesRequested,
-                      MessageHelper::Error* e, Meter& metric) {
+    // Ratio of raw to encoded channel bytes so far
+    double getCompressionRatio() const {
+        return m_encodedBytes > 0 ? (double)m_rawBytes / (double)m_encodedBytes : 1.0;
+    }
+
+    template <typename T, typename S>
+    bool sendToServer(S* socket, AudioBuffer<T>& buffer, MidiBuffer& midi, AudioPlayHead::CurrentPositionInfo& posInfo,
+                      int channelsRequested, int samplesRequested, MessageHelper::Error* e, Meter& metric) {
         traceScope();
         m_reqHeader.channels = buffer.getNumChannels();
         m_reqHeader.samples = buffer.getNumSamples();
         m_reqHeader.channelsRequested = channelsRequested > -1 ? channelsRequested : buffer.getNumChannels();
         m_reqHeader.samplesRequested = samplesRequested > -1 ? samplesRequested : buffer.getNumSamples();
         m_reqHeader.isDouble = std::is_same<T, double>::value;
+        m_reqHeader.wireFormat = m_wireFormat;
         m_reqHeader.numMidiEvents = midi.getNumEvents();
+        m_reqHeader.seq = m_seq++;
         if (socket->isConnected()) {
-            if (!send(socket, reinterpret_cast<const char*>(&m_reqHeader), sizeof(m_reqHeader), e, &metric)) {
-                return false;
-            }
-            for (int chan = 0; chan < m_reqHeader.channels; ++chan) {
-                if (!send(socket, reinterpret_cast<const char*>(buffer.getReadPointer(chan)),
-                          m_reqHeader.samples * (int)sizeof(T), e, &metric)) {
-                    return false;
-                }
-            }
-            MidiHeader midiHdr;
-            for (auto midiIt = midi.begin(); midiIt != midi.end(); midiIt++) {
-                midiHdr.size = (*midiIt).numBytes;
-                midiHdr.sampleNumber = (*midiIt).samplePosition;
-                if (!send(socket, reinterpret_cast<const char*>(&midiHdr), sizeof(midiHdr), e, &metric)) {
-                    return false;
-                }
-                if (!send(socket, reinterpret_cast<const char*>((*midiIt).data), midiHdr.size, e, &metric)) {
-                    return false;
-                }
-            }
-            if (!send(socket, reinterpret_cast<const char*>(&posInfo), sizeof(posInfo), e, &metric)) {
+            m_slices.clear();
+            addSlice(&m_reqHeader, sizeof(m_reqHeader));
+            addChannelData(buffer, m_reqHeader.channels, m_reqHeader.samples);
+            addMidiSlices(midi);
+            addSlice(&posInfo, sizeof(posInfo));
+            if (!sendv(socket, m_slices, e, &metric)) {
                 return false;
             }
         }
         return true;
     }
 
-    template <typename T>
-    bool sendToClient(StreamingSocket* socket, AudioBuffer<T>& buffer, MidiBuffer& midi, int latencySamples,
-                      int channelsToSend, MessageHelper::Error* e, Meter& metric) {
+    template <typename T, typename S>
+    bool sendToClient(S* socket, AudioBuffer<T>& buffer, MidiBuffer& midi, int latencySamples, int channelsToSend,
+                      MessageHelper::Error* e, Meter& metric) {
         traceScope();
         m_resHeader.channels = channelsToSend;
         m_resHeader.samples = buffer.getNumSamples();
         m_resHeader.latencySamples = latencySamples;
         m_resHeader.numMidiEvents = midi.getNumEvents();
+        m_resHeader.seq = m_reqHeader.seq;
         if (socket->isConnected()) {
-            if (!send(socket, reinterpret_cast<const char*>(&m_resHeader), sizeof(m_resHeader), e, &metric)) {
+            m_slices.clear();
+            addSlice(&m_resHeader, sizeof(m_resHeader));
+            addChannelData(buffer, m_resHeader.channels, m_resHeader.samples);
+            addMidiSlices(midi);
+            if (!sendv(socket, m_slices, e, &metric)) {
                 return false;
             }
-            for (int chan = 0; chan < m_resHeader.channels; ++chan) {
-                if (!send(socket, reinterpret_cast<const char*>(buffer.getReadPointer(chan)),
-                          m_resHeader.samples * (int)sizeof(T), e, &metric)) {
-                    return false;
-                }
-            }
-            MidiHeader midiHdr;
-            for (auto midiIt = midi.begin(); midiIt != midi.end(); midiIt++) {
-                midiHdr.size = (*midiIt).numBytes;
-                midiHdr.sampleNumber = (*midiIt).samplePosition;
-                if (!send(socket, reinterpret_cast<const char*>(&midiHdr), sizeof(midiHdr), e, &metric)) {
-                    return false;
-                }
-                if (!send(socket, reinterpret_cast<const char*>((*midiIt).data), midiHdr.size, e, &metric)) {
-                    return false;
-                }
-            }
         }
         return true;
     }
 
-    template <typename T>
-    bool readFromServer(StreamingSocket* socket, AudioBuffer<T>& buffer, MidiBuffer& midi, MessageHelper::Error* e,
-                        Meter& metric) {
+    template <typename T, typename S>
+    bool readFromServer(S* socket, AudioBuffer<T>& buffer, MidiBuffer& midi, MessageHelper::Error* e, Meter& metric) {
         traceScope();
         if (socket->isConnected()) {
             if (!read(socket, &m_resHeader, sizeof(m_resHeader), 1000, e, &metric)) {
@@ -276,31 +364,26 @@ class AudioMessage : public LogTagDelegate {
                 MessageHelper::seterr(e, MessageHelper::E_SIZE, "buffer has not enough samples");
                 return false;
             }
-            for (int chan = 0; chan < m_resHeader.channels; ++chan) {
-                if (!read(socket, buffer.getWritePointer(chan), m_resHeader.samples * (int)sizeof(T), 1000, e,
-                          &metric)) {
-                    MessageHelper::seterrstr(e, "audio data");
-                    return false;
-                }
+            m_slices.clear();
+            if (!addChannelReadSlices(socket, buffer, m_resHeader.channels, m_resHeader.samples, 1000, e, metric)) {
+                return false;
             }
-            midi.clear();
-            std::vector<char> midiData;
-            MidiHeader midiHdr;
-            for (int i = 0; i < m_resHeader.numMidiEvents; i++) {
-                if (!read(socket, &midiHdr, sizeof(midiHdr), 1000, e, &metric)) {
-                    MessageHelper::seterrstr(e, "midi header");
-                    return false;
-                }
-                auto size = (size_t)midiHdr.size;
-                if (midiData.size() < size) {
-                    midiData.resize(size);
-                }
-                if (!read(socket, midiData.data(), midiHdr.size, 1000, e, &metric)) {
-                    MessageHelper::seterrstr(e, "midi data");
-                    return false;
-                }
-                midi.addEvent(midiData.data(), midiHdr.size, midiHdr.sampleNumber);
+            if (!readv(socket, m_slices, 1000, e, &metric)) {
+                MessageHelper::seterrstr(e, "audio data");
+                return false;
+            }
+            if (!decodeChannelData(buffer, m_resHeader.channels, m_resHeader.samples, e)) {
+                return false;
+            }
+            if (!readMidi(socket, midi, m_resHeader.numMidiEvents, 1000, e, metric)) {
+                return false;
             }
+            if (isConcealed(socket)) {
+                // don't repeat the midi events of the previous block, the repeated block replaces the next one
+                midi.clear();
+                m_resHeader.seq = m_seq;
+            }
+            m_seq = m_resHeader.seq + 1;
         } else {
             MessageHelper::seterr(e, MessageHelper::E_STATE, "not connected");
             traceln("failed: E_STATE");
@@ -310,51 +393,65 @@ class AudioMessage : public LogTagDelegate {
         return true;
     }
 
-    bool readFromClient(StreamingSocket* socket, AudioBuffer<float>& bufferF, AudioBuffer<double>& bufferD,
-                        MidiBuffer& midi, AudioPlayHead::CurrentPositionInfo& posInfo, MessageHelper::Error* e,
-                        Meter& metric) {
+    template <typename S>
+    bool readFromClient(S* socket, AudioBuffer<float>& bufferF, AudioBuffer<double>& bufferD, MidiBuffer& midi,
+                        AudioPlayHead::CurrentPositionInfo& posInfo, MessageHelper::Error* e, Meter& metric) {
         traceScope();
         if (socket->isConnected()) {
             if (!read(socket, &m_reqHeader, sizeof(m_reqHeader), 0, e, &metric)) {
                 MessageHelper::seterrstr(e, "request header");
                 return false;
             }
-            int size = m_reqHeader.samples * (int)(m_reqHeader.isDouble ? sizeof(double) : sizeof(float));
+            if (m_wireFormat == AudioWireFormat::NATIVE) {
+                m_reqHeader.wireFormat = AudioWireFormat::NATIVE;
+            } else if (m_reqHeader.wireFormat != AudioWireFormat::NATIVE && m_reqHeader.wireFormat != m_wireFormat) {
+                MessageHelper::seterr(e, MessageHelper::E_DATA, "unexpected wire format");
+                return false;
+            }
+            m_slices.clear();
             if (m_reqHeader.isDouble) {
                 bufferD.setSize(jmax(m_reqHeader.channels, m_reqHeader.channelsRequested),
                                 jmax(m_reqHeader.samples, m_reqHeader.samplesRequested), false, true);
+                if (!addChannelReadSlices(socket, bufferD, m_reqHeader.channels, m_reqHeader.samples, 0, e, metric)) {
+                    return false;
+                }
             } else {
                 bufferF.setSize(jmax(m_reqHeader.channels, m_reqHeader.channelsRequested),
                                 jmax(m_reqHeader.samples, m_reqHeader.samplesRequested), false, true);
-            }
-            // Read the channel data from the client, if any
-            for (int chan = 0; chan < m_reqHeader.channels; ++chan) {
-                char* data = m_reqHeader.isDouble ? reinterpret_cast<char*>(bufferD.getWritePointer(chan))
-                                                  : reinterpret_cast<char*>(bufferF.getWritePointer(chan));
-                if (!read(socket, data, size, 0, e, &metric)) {
-                    MessageHelper::seterrstr(e, "audio data");
+                if (!addChannelReadSlices(socket, bufferF, m_reqHeader.channels, m_reqHeader.samples, 0, e, metric)) {
                     return false;
                 }
             }
-            midi.clear();
-            for (int i = 0; i < m_reqHeader.numMidiEvents; i++) {
-                std::vector<char> midiData;
-                MidiHeader midiHdr;
-                if (!read(socket, &midiHdr, sizeof(midiHdr), 0, e, &metric)) {
-                    MessageHelper::seterrstr(e, "midi header");
+            // Without midi events the position info directly follows the channel data, so everything can be read at
+            // once
+            if (m_reqHeader.numMidiEvents == 0) {
+                addSlice(&posInfo, sizeof(posInfo));
+            }
+            if (!readv(socket, m_slices, 0, e, &metric)) {
+                MessageHelper::seterrstr(e, "audio data");
+                return false;
+            }
+            if (m_reqHeader.isDouble ? !decodeChannelData(bufferD, m_reqHeader.channels, m_reqHeader.samples, e)
+                                     : !decodeChannelData(bufferF, m_reqHeader.channels, m_reqHeader.samples, e)) {
+                return false;
+            }
+            if (m_reqHeader.numMidiEvents > 0) {
+                if (!readMidi(socket, midi, m_reqHeader.numMidiEvents, 0, e, metric)) {
                     return false;
                 }
-                midiData.resize(static_cast<size_t>(midiHdr.size));
-                if (!read(socket, midiData.data(), midiHdr.size, 0, e, &metric)) {
-                    MessageHelper::seterrstr(e, "midi data");
+                if (!read(socket, &posInfo, sizeof(posInfo), 0, e, &metric)) {
+                    MessageHelper::seterrstr(e, "pos info");
                     return false;
                 }
-                midi.addEvent(midiData.data(), midiHdr.size, midiHdr.sampleNumber);
+            } else {
+                midi.clear();
             }
-            if (!read(socket, &posInfo, sizeof(posInfo), 0, e, &metric)) {
-                MessageHelper::seterrstr(e, "pos info");
-                return false;
+            if (isConcealed(socket)) {
+                // don't repeat the midi events of the previous block, the repeated block replaces the next one
+                midi.clear();
+                m_reqHeader.seq = m_seq;
             }
+            m_seq = m_reqHeader.seq + 1;
         } else {
             MessageHelper::seterr(e, MessageHelper::E_STATE, "not connected");
             traceln("failed: E_STATE");
@@ -367,6 +464,170 @@ class AudioMessage : public LogTagDelegate {
   private:
     RequestHeader m_reqHeader;
     ResponseHeader m_resHeader;
+    uint32 m_seq = 0;  // Next sequence number to send or expect
+    IOSlices m_slices;
+    std::vector<MidiHeader> m_midiHeaders;
+    std::vector<char> m_midiData;
+    bool m_compress = false;
+    uint8 m_wireFormat = AudioWireFormat::NATIVE;
+    std::vector<char> m_wireData;
+    int m_encodedSize = 0;
+    std::vector<char> m_encoded;
+    uint64 m_rawBytes = 0;
+    uint64 m_encodedBytes = 0;
+    std::shared_ptr<TimeStatistic> m_encodeTime, m_decodeTime;
+
+    void addSlice(const void* data, size_t size) {
+        if (size > 0) {
+            m_slices.push_back({const_cast<char*>(static_cast<const char*>(data)), (int)size});
+        }
+    }
+
+    template <typename T>
+    void addChannelSlices(AudioBuffer<T>& buffer, int channels, int samples, bool readInto) {
+        for (int chan = 0; chan < channels; ++chan) {
+            addSlice(readInto ? buffer.getWritePointer(chan) : buffer.getReadPointer(chan),
+                     (size_t)samples * sizeof(T));
+        }
+    }
+
+    void initCodecStats() {
+        if (nullptr == m_encodeTime) {
+            m_encodeTime = Metrics::getStatistic<TimeStatistic>("audio-encode");
+            m_decodeTime = Metrics::getStatistic<TimeStatistic>("audio-decode");
+        }
+    }
+
+    size_t getWireDataSize(uint8 fmt, int channels, int samples) const {
+        return (size_t)channels * (size_t)samples * AudioWireFormat::getSampleSize(fmt);
+    }
+
+    template <typename T>
+    void addChannelData(AudioBuffer<T>& buffer, int channels, int samples) {
+        auto fmt = AudioWireFormat::resolve<T>(m_reqHeader.wireFormat);
+        if (fmt != AudioWireFormat::NATIVE) {
+            auto size = getWireDataSize(fmt, channels, samples);
+            if (m_wireData.size() < size) {
+                m_wireData.resize(size);
+            }
+            TimeStatistic::Duration duration(m_encodeTime);
+            auto chanSize = (size_t)samples * AudioWireFormat::getSampleSize(fmt);
+            for (int chan = 0; chan < channels; chan++) {
+                AudioWireFormat::encode(buffer.getReadPointer(chan), m_wireData.data() + (size_t)chan * chanSize,
+                                        samples, fmt);
+            }
+            addSlice(m_wireData.data(), size);
+            return;
+        }
+        if (!m_compress) {
+            addChannelSlices(buffer, channels, samples, false);
+            return;
+        }
+        auto maxSize = AudioCodec::getMaxEncodedSize<T>(channels, samples);
+        if (m_encoded.size() < maxSize) {
+            m_encoded.resize(maxSize);
+        }
+        TimeStatistic::Duration duration(m_encodeTime);
+        m_encodedSize = (int)AudioCodec::encode(buffer, channels, samples, m_encoded.data());
+        duration.finish();
+        m_rawBytes += (uint64)channels * (uint64)samples * sizeof(T);
+        m_encodedBytes += (uint64)m_encodedSize;
+        addSlice(&m_encodedSize, sizeof(m_encodedSize));
+        addSlice(m_encoded.data(), (size_t)m_encodedSize);
+    }
+
+    // Adds the slices to read the channel data into. Compressed data is read into the encode buffer, so the encoded
+    // size has to be read first.
+    template <typename T, typename S>
+    bool addChannelReadSlices(S* socket, AudioBuffer<T>& buffer, int channels, int samples, int timeoutMilliseconds,
+                              MessageHelper::Error* e, Meter& metric) {
+        auto fmt = AudioWireFormat::resolve<T>(m_reqHeader.wireFormat);
+        if (fmt != AudioWireFormat::NATIVE) {
+            auto size = getWireDataSize(fmt, channels, samples);
+            if (m_wireData.size() < size) {
+                m_wireData.resize(size);
+            }
+            addSlice(m_wireData.data(), size);
+            return true;
+        }
+        if (!m_compress) {
+            addChannelSlices(buffer, channels, samples, true);
+            return true;
+        }
+        if (!read(socket, &m_encodedSize, sizeof(m_encodedSize), timeoutMilliseconds, e, &metric)) {
+            MessageHelper::seterrstr(e, "encoded size");
+            return false;
+        }
+        auto maxSize = AudioCodec::getMaxEncodedSize<T>(channels, samples);
+        if (m_encodedSize < 0 || (size_t)m_encodedSize + AudioCodec::PADDING > maxSize) {
+            MessageHelper::seterr(e, MessageHelper::E_SIZE, "invalid encoded size");
+            return false;
+        }
+        if (m_encoded.size() < maxSize) {
+            m_encoded.resize(maxSize);
+        }
+        addSlice(m_encoded.data(), (size_t)m_encodedSize);
+        return true;
+    }
+
+    template <typename T>
+    bool decodeChannelData(AudioBuffer<T>& buffer, int channels, int samples, MessageHelper::Error* e) {
+        auto fmt = AudioWireFormat::resolve<T>(m_reqHeader.wireFormat);
+        if (fmt != AudioWireFormat::NATIVE) {
+            TimeStatistic::Duration duration(m_decodeTime);
+            auto chanSize = (size_t)samples * AudioWireFormat::getSampleSize(fmt);
+            for (int chan = 0; chan < channels; chan++) {
+                AudioWireFormat::decode(m_wireData.data() + (size_t)chan * chanSize, buffer.getWritePointer(chan),
+                                        samples, fmt);
+            }
+            return true;
+        }
+        if (!m_compress) {
+            return true;
+        }
+        TimeStatistic::Duration duration(m_decodeTime);
+        if (!AudioCodec::decode(m_encoded.data(), (size_t)m_encodedSize, buffer, channels, samples)) {
+            MessageHelper::seterr(e, MessageHelper::E_DATA, "corrupt audio data");
+            return false;
+        }
+        return true;
+    }
+
+    void addMidiSlices(MidiBuffer& midi) {
+        // the headers have to be in place before taking their addresses
+        m_midiHeaders.resize((size_t)midi.getNumEvents());
+        size_t i = 0;
+        for (auto midiIt = midi.begin(); midiIt != midi.end(); midiIt++, i++) {
+            auto& midiHdr = m_midiHeaders[i];
+            midiHdr.size = (*midiIt).numBytes;
+            midiHdr.sampleNumber = (*midiIt).samplePosition;
+            addSlice(&midiHdr, sizeof(midiHdr));
+            addSlice((*midiIt).data, (size_t)midiHdr.size);
+        }
+    }
+
+    template <typename S>
+    bool readMidi(S* socket, MidiBuffer& midi, int numEvents, int timeoutMilliseconds, MessageHelper::Error* e,
+                  Meter& metric) {
+        midi.clear();
+        MidiHeader midiHdr;
+        for (int i = 0; i < numEvents; i++) {
+            if (!read(socket, &midiHdr, sizeof(midiHdr), timeoutMilliseconds, e, &metric)) {
+                MessageHelper::seterrstr(e, "midi header");
+                return false;
+            }
+            auto size = (size_t)midiHdr.size;
+            if (m_midiData.size() < size) {
+                m_midiData.resize(size);
+            }
+            if (!read(socket, m_midiData.data(), midiHdr.size, timeoutMilliseconds, e, &metric)) {
+                MessageHelper::seterrstr(e, "midi data");
+                return false;
+            }
+            midi.addEvent(m_midiData.data(), midiHdr.size, midiHdr.sampleNumber);
+        }
+        return true;
+    }
 };
 
 /*
@@ -777,6 +1038,49 @@ class CPULoad : public FloatPayload {
     CPULoad() : FloatPayload(Type) {}
 };
 
+// Consecutive plugins with a branch > 0 form a parallel section, plugins with the same branch are processed in series
+// within the section, the branches get the same input and their outputs are summed up
+struct pluginbranch_t {
+    int idx;
+    int branch;
+};
+
+class SetPluginBranch : public DataPayload<pluginbranch_t> {
+  public:
+    static constexpr int Type = __COUNTER__;
+    SetPluginBranch() : DataPayload<pluginbranch_t>(Type) {}
+};
+
+// The DSP load of every plugin of the chain in percent of the block period: [{"name", "load", "peak"}, ...]
+class PluginDSPLoad : public JsonPayload {
+  public:
+    static constexpr int Type = __COUNTER__;
+    PluginDSPLoad() : JsonPayload(Type) {}
+};
+
+// Blocks, that missed their deadline on the server: {"count", "budget", "lastOverrun", "maxOverrun", "totalOverrun",
+// "plugin"}, times in milliseconds, plugin is the slowest plugin of the last missed block
+class ChainXruns : public JsonPayload {
+  public:
+    static constexpr int Type = __COUNTER__;
+    ChainXruns() : JsonPayload(Type) {}
+};
+
+// Loads a list of plugins with one round trip: [{"id", "settings"}, ...], settings are base64 encoded
+class LoadChain : public JsonPayload {
+  public:
+    static constexpr int Type = __COUNTER__;
+    LoadChain() : JsonPayload(Type) {}
+};
+
+// {"latency", "disabledSideChain", "plugins": [{"success", "err", "hasEditor", "presets", "params"}, ...]}, the
+// plugins in the order of the request, presets and params as sent after adding a single plugin
+class LoadChainResult : public JsonPayload {
+  public:
+    static constexpr int Type = __COUNTER__;
+    LoadChainResult() : JsonPayload(Type) {}
+};
+
 template <typename T>
 class Message : public LogTagDelegate {
   public:
@@ -74,6 +74,37 @@ class Meter : public BasicStatistic {
     inline double alpha(int secs) { return 1 - std::exp(std::log(0.005) / secs); }
 };
 
+// A value, that can go up and down, like a queue size. Logs the current value and the maximum since the last
+// aggregation.
+class Gauge : public BasicStatistic, public LogTag {
+  public:
+    Gauge() : LogTag("stats") {}
+    ~Gauge() override {}
+
+    inline void set(int64 v) {
+        m_value = v;
+        updateMax(v);
+    }
+    inline void add(int64 v) { updateMax(m_value += v); }
+    inline int64 get() const { return m_value; }
+    inline int64 getMax() const { return m_lastMax; }
+
+    void aggregate() override { m_lastMax = m_max.exchange(m_value); }
+    void aggregate1s() override {}
+    void log(const String& name) override { logln(name << ": current " << get() << ", max " << getMax()); }
+
+  private:
+    std::atomic<int64> m_value{0};
+    std::atomic<int64> m_max{0};
+    std::atomic<int64> m_lastMax{0};
+
+    inline void updateMax(int64 v) {
+        auto max = m_max.load(std::memory_order_relaxed);
+        while (v > max && !m_max.compare_exchange_weak(max, v, std::memory_order_relaxed)) {
+        }
+    }
+};
+
 class TimeStatistic : public BasicStatistic, public LogTag {
   public:
     class Duration {
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#include "NamedEvent.hpp"
+
+#ifdef JUCE_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace e47 {
+
+NamedEvent::NamedEvent(const LogTag* tag, const File& file) : LogTagDelegate(tag), m_file(file) {}
+
+NamedEvent::~NamedEvent() {
+    close();
+    if (m_created) {
+        m_file.deleteFile();
+    }
+}
+
+bool NamedEvent::open(bool create) {
+    traceScope();
+    if (isOpen()) {
+        return true;
+    }
+#ifdef JUCE_WINDOWS
+    // kernel object names must not contain backslashes, so only the file name is used
+    auto name = "Local\\AudioGridder_" + m_file.getFileName();
+    m_event = CreateEventW(nullptr, FALSE, FALSE, name.toWideCharPointer());
+    if (nullptr == m_event) {
+        logln("CreateEventW failed: " << GetLastErrorStr());
+        return false;
+    }
+    m_created = create;
+#else
+    auto path = m_file.getFullPathName().getCharPointer();
+    if (create) {
+        ::unlink(path);
+        if (::mkfifo(path, S_IRUSR | S_IWUSR) != 0) {
+            logln("mkfifo failed: " << strerror(errno));
+            return false;
+        }
+        m_created = true;
+    }
+    // opening for reading and writing does not block and keeps the FIFO usable, when the peer closes its end
+    m_fd = ::open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0) {
+        logln("open failed: " << strerror(errno));
+        return false;
+    }
+#endif
+    return true;
+}
+
+void NamedEvent::close() {
+#ifdef JUCE_WINDOWS
+    if (nullptr != m_event) {
+        CloseHandle(m_event);
+        m_event = nullptr;
+    }
+#else
+    if (m_fd > -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+bool NamedEvent::isOpen() const {
+#ifdef JUCE_WINDOWS
+    return nullptr != m_event;
+#else
+    return m_fd > -1;
+#endif
+}
+
+void NamedEvent::signal() {
+#ifdef JUCE_WINDOWS
+    if (nullptr != m_event) {
+        SetEvent(m_event);
+    }
+#else
+    if (m_fd > -1) {
+        // a full pipe means there are pending signals already
+        char c = 1;
+        while (::write(m_fd, &c, 1) < 0 && errno == EINTR) {
+        }
+    }
+#endif
+}
+
+bool NamedEvent::wait(int timeoutMilliseconds) {
+#ifdef JUCE_WINDOWS
+    if (nullptr == m_event) {
+        return false;
+    }
+    return WaitForSingleObject(m_event, (DWORD)timeoutMilliseconds) == WAIT_OBJECT_0;
+#else
+    if (m_fd < 0) {
+        return false;
+    }
+    pollfd pfd = {m_fd, POLLIN, 0};
+    int ret;
+    while ((ret = ::poll(&pfd, 1, timeoutMilliseconds)) < 0 && errno == EINTR) {
+    }
+    if (ret <= 0) {
+        return false;
+    }
+    // consume all pending signals, like an auto reset event
+    char buf[64];
+    while (::read(m_fd, buf, sizeof(buf)) > 0) {
+    }
+    return true;
+#endif
+}
+
+}  // namespace e47
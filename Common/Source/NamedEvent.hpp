@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef NamedEvent_hpp
+#define NamedEvent_hpp
+
+#include <JuceHeader.h>
+
+#include "Utils.hpp"
+
+namespace e47 {
+
+/*
+ * An auto reset event, that can be signaled from another process. It is identified by a file path: on Windows the
+ * file name names a kernel event, on other platforms the path is a FIFO, that signal() writes to. A signal, that
+ * arrives while nobody waits, is kept until the next wait.
+ */
+class NamedEvent : public LogTagDelegate {
+  public:
+    NamedEvent(const LogTag* tag, const File& file);
+    ~NamedEvent() override;
+
+    // The creating side removes a stale event and deletes the file again, when the event is destroyed
+    bool open(bool create);
+    void close();
+    bool isOpen() const;
+
+    void signal();
+
+    // Returns false, if the event has not been signaled within the given time
+    bool wait(int timeoutMilliseconds);
+
+  private:
+    File m_file;
+    bool m_created = false;
+#ifdef JUCE_WINDOWS
+    void* m_event = nullptr;
+#else
+    int m_fd = -1;
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE(NamedEvent)
+};
+
+}  // namespace e47
+
+#endif /* NamedEvent_hpp */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#include "Semaphore.hpp"
+
+#include <thread>
+
+#if defined(JUCE_MAC)
+#include <dispatch/dispatch.h>
+#elif defined(JUCE_WINDOWS)
+#include <windows.h>
+#else
+#include <semaphore.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
+namespace e47 {
+
+Semaphore::Semaphore(int spinMicroseconds) : m_spinMicroseconds(spinMicroseconds) {
+#if defined(JUCE_MAC)
+    m_sem = dispatch_semaphore_create(0);
+#elif defined(JUCE_WINDOWS)
+    m_sem = CreateSemaphore(nullptr, 0, MAXLONG, nullptr);
+#else
+    auto* sem = new sem_t;
+    sem_init(sem, 0, 0);
+    m_sem = sem;
+#endif
+}
+
+Semaphore::~Semaphore() {
+#if defined(JUCE_MAC)
+    dispatch_release(static_cast<dispatch_semaphore_t>(m_sem));
+#elif defined(JUCE_WINDOWS)
+    CloseHandle(m_sem);
+#else
+    auto* sem = static_cast<sem_t*>(m_sem);
+    sem_destroy(sem);
+    delete sem;
+#endif
+}
+
+void Semaphore::kernelPost() {
+#if defined(JUCE_MAC)
+    dispatch_semaphore_signal(static_cast<dispatch_semaphore_t>(m_sem));
+#elif defined(JUCE_WINDOWS)
+    ReleaseSemaphore(m_sem, 1, nullptr);
+#else
+    sem_post(static_cast<sem_t*>(m_sem));
+#endif
+}
+
+bool Semaphore::kernelWait(int timeoutMilliseconds) {
+#if defined(JUCE_MAC)
+    return dispatch_semaphore_wait(static_cast<dispatch_semaphore_t>(m_sem),
+                                   dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeoutMilliseconds * NSEC_PER_MSEC)) == 0;
+#elif defined(JUCE_WINDOWS)
+    return WaitForSingleObject(m_sem, (DWORD)timeoutMilliseconds) == WAIT_OBJECT_0;
+#else
+    auto* sem = static_cast<sem_t*>(m_sem);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeoutMilliseconds / 1000;
+    ts.tv_nsec += (long)(timeoutMilliseconds % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    int ret;
+    while ((ret = sem_timedwait(sem, &ts)) != 0 && errno == EINTR) {
+    }
+    return ret == 0;
+#endif
+}
+
+void Semaphore::post() {
+    // a negative count means a thread is parked
+    if (m_count.fetch_add(1, std::memory_order_release) < 0) {
+        kernelPost();
+    }
+}
+
+bool Semaphore::tryWait() {
+    int count = m_count.load(std::memory_order_relaxed);
+    while (count > 0) {
+        if (m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Semaphore::wait(int timeoutMilliseconds) {
+    if (tryWait()) {
+        return true;
+    }
+    if (m_spinMicroseconds > 0) {
+        auto spinUntil = Time::getHighResolutionTicks() + Time::secondsToHighResolutionTicks(m_spinMicroseconds / 1e6);
+        while (Time::getHighResolutionTicks() < spinUntil) {
+            std::this_thread::yield();
+            if (tryWait()) {
+                return true;
+            }
+        }
+    }
+    if (m_count.fetch_sub(1, std::memory_order_acquire) > 0) {
+        return true;
+    }
+    if (kernelWait(timeoutMilliseconds)) {
+        return true;
+    }
+    // Timed out: give the decrement back. If a post came in meanwhile, it signals the kernel semaphore and we consume
+    // that signal instead.
+    while (true) {
+        int count = m_count.load(std::memory_order_relaxed);
+        if (count < 0 && m_count.compare_exchange_strong(count, count + 1, std::memory_order_relaxed)) {
+            return false;
+        }
+        if (count >= 0 && kernelWait(0)) {
+            return true;
+        }
+    }
+}
+
+}  // namespace e47
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef Semaphore_hpp
+#define Semaphore_hpp
+
+#include <JuceHeader.h>
+#include <atomic>
+
+namespace e47 {
+
+/*
+ * A counting semaphore, that can be used from a real-time thread. post() is a single atomic operation and only calls
+ * into the kernel, if another thread is parked in wait(). wait() spins for the given time before parking. No locks
+ * are taken on either side, so there is no priority inversion.
+ */
+class Semaphore {
+  public:
+    Semaphore(int spinMicroseconds = 0);
+    ~Semaphore();
+
+    void post();
+
+    // Returns false, if the count could not be decremented within the given time
+    bool wait(int timeoutMilliseconds);
+    bool tryWait();
+
+  private:
+    std::atomic_int m_count{0};
+    int m_spinMicroseconds;
+    void* m_sem;
+
+    void kernelPost();
+    bool kernelWait(int timeoutMilliseconds);
+
+    JUCE_DECLARE_NON_COPYABLE(Semaphore)
+};
+
+}  // namespace e47
+
+#endif /* Semaphore_hpp */
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#if defined(AG_PLUGIN) || defined(AG_SERVER)
+
+#include "SharedMemoryStream.hpp"
+#include "Defaults.hpp"
+
+#include <thread>
+
+namespace e47 {
+
+SharedMemoryStream::SharedMemoryStream(const LogTag* tag, uint64 clientId, size_t ringSize, bool isClient,
+                                       StreamingSocket* socket)
+    : LogTagDelegate(tag),
+      m_file(this, Defaults::getSharedMemoryFileName(clientId), sizeof(Header) + ringSize * 2),
+      m_ringSize(ringSize),
+      m_isClient(isClient),
+      m_socket(socket) {
+    for (int i = 0; i < 4; i++) {
+        // one data and one space event per ring
+        auto name = Defaults::getSharedMemoryFileName(clientId) + "." + String(i / 2) + (i % 2 == 0 ? "d" : "s");
+        m_events[i] = std::make_unique<NamedEvent>(tag, File(name));
+    }
+}
+
+SharedMemoryStream::~SharedMemoryStream() {
+    traceScope();
+    close();
+    m_hdr = nullptr;
+    m_file.close();
+    if (m_isClient) {
+        m_file.deleteFile();
+    }
+}
+
+size_t SharedMemoryStream::getRingSize(const HandshakeRequest& cfg) {
+    int channels = jmin(Defaults::PLUGIN_CHANNELS_MAX, jmax(cfg.channelsIn + cfg.channelsSC, cfg.channelsOut));
+    size_t sampleSize = cfg.doublePrecission ? sizeof(double) : sizeof(float);
+    // room for two blocks plus headers, midi and the position info, the ring size has to be a power of two
+    size_t blockSize = (size_t)jmax(1, channels) * (size_t)cfg.samplesPerBlock * sampleSize + 65536;
+    return (size_t)nextPowerOfTwo((int)(blockSize * 2));
+}
+
+bool SharedMemoryStream::open() {
+    traceScope();
+    if (m_isClient) {
+        auto dir = m_file.getFile().getParentDirectory();
+        if (!dir.exists()) {
+            dir.createDirectory();
+        }
+    }
+    m_file.open(m_isClient);
+    if (!m_file.isOpen()) {
+        logln("failed to map shared memory file " << m_file.getFile().getFullPathName());
+        return false;
+    }
+    for (auto& ev : m_events) {
+        if (!ev->open(m_isClient)) {
+            logln("failed to open shared memory event");
+            m_file.close();
+            return false;
+        }
+    }
+    auto* hdr = reinterpret_cast<Header*>(m_file.data());
+    if (m_isClient) {
+        hdr->magic = 0;
+        hdr->ringSize = (uint32)m_ringSize;
+        hdr->closed = 0;
+        for (auto& ring : hdr->rings) {
+            ring.writePos = 0;
+            ring.readerParked = 0;
+            ring.readPos = 0;
+            ring.writerParked = 0;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        hdr->magic = MAGIC;
+    } else if (hdr->magic != MAGIC || hdr->ringSize != (uint32)m_ringSize) {
+        logln("invalid shared memory header: magic=" << String::toHexString((int)hdr->magic) << " ringSize="
+                                                     << (int)hdr->ringSize << " (" << (int)m_ringSize << " expected)");
+        m_file.close();
+        return false;
+    }
+    char* data = m_file.data() + sizeof(Header);
+    // ring 0 is plugin -> server, ring 1 is server -> plugin
+    int outIdx = m_isClient ? 0 : 1;
+    int inIdx = m_isClient ? 1 : 0;
+    m_out = &hdr->rings[outIdx];
+    m_outData = data + (size_t)outIdx * m_ringSize;
+    m_outDataEvent = m_events[outIdx * 2].get();
+    m_outSpaceEvent = m_events[outIdx * 2 + 1].get();
+    m_in = &hdr->rings[inIdx];
+    m_inData = data + (size_t)inIdx * m_ringSize;
+    m_inDataEvent = m_events[inIdx * 2].get();
+    m_inSpaceEvent = m_events[inIdx * 2 + 1].get();
+    m_hdr = hdr;
+    logln("shared memory audio stream opened (ring size " << (int)m_ringSize << " bytes)");
+    return true;
+}
+
+void SharedMemoryStream::close() {
+    traceScope();
+    // only flag the stream as closed, the mapping might still be in use by the audio thread and is released when
+    // destroying the stream
+    if (nullptr != m_hdr) {
+        m_hdr->closed = 1;
+        // wake up parked threads on both sides
+        for (auto& ev : m_events) {
+            ev->signal();
+        }
+    }
+}
+
+bool SharedMemoryStream::isConnected() const {
+    return nullptr != m_hdr && !m_peerGone && m_hdr->closed == 0 && (nullptr == m_socket || m_socket->isConnected());
+}
+
+bool SharedMemoryStream::checkPeer() {
+    if (nullptr != m_socket && m_socket->waitUntilReady(true, 0) != 0) {
+        // nothing is sent over the socket in shared memory mode, so this is either EOF or an error
+        m_peerGone = true;
+        return false;
+    }
+    return true;
+}
+
+template <typename Fn>
+SharedMemoryStream::WaitResult SharedMemoryStream::waitFor(Fn isReady, std::atomic<uint32>& parked, NamedEvent* event,
+                                                           int timeoutMilliseconds) {
+    auto start = Time::getMillisecondCounterHiRes();
+    auto spinUntil = start + SPIN_MICROSECONDS / 1000.0;
+    while (!isReady()) {
+        if (!isConnected()) {
+            return WAIT_CLOSED;
+        }
+        auto now = Time::getMillisecondCounterHiRes();
+        if (timeoutMilliseconds > -1 && now - start >= timeoutMilliseconds) {
+            return WAIT_TIMEOUT;
+        }
+        if (now - m_lastPeerCheck >= LIVENESS_CHECK_MILLISECONDS) {
+            m_lastPeerCheck = now;
+            if (!checkPeer()) {
+                return WAIT_CLOSED;
+            }
+        }
+        if (now < spinUntil) {
+            std::this_thread::yield();
+            continue;
+        }
+        // the flag has to be visible before checking again, otherwise the other side could miss it
+        parked.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!isReady() && isConnected()) {
+            int waitMs = LIVENESS_CHECK_MILLISECONDS;
+            if (timeoutMilliseconds > -1) {
+                waitMs = jlimit(1, waitMs, roundToInt(timeoutMilliseconds - (now - start)));
+            }
+            event->wait(waitMs);
+        }
+        parked.store(0, std::memory_order_relaxed);
+    }
+    return WAIT_READY;
+}
+
+void SharedMemoryStream::wakeUp(std::atomic<uint32>& parked, NamedEvent* event) {
+    // pairs with the fence in waitFor: either the peer sees the new position or we see its flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed) != 0 && parked.exchange(0, std::memory_order_relaxed) != 0) {
+        event->signal();
+    }
+}
+
+bool SharedMemoryStream::send(const char* data, int size, MessageHelper::Error* e, Meter* metric) {
+    traceScope();
+    if (!isConnected()) {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        traceln("failed: E_STATE");
+        return false;
+    }
+    auto mask = m_ringSize - 1;
+    auto toWrite = (size_t)size;
+    size_t offset = 0;
+    while (toWrite > 0) {
+        auto w = m_out->writePos.load(std::memory_order_relaxed);
+        auto space = m_ringSize - (size_t)(w - m_out->readPos.load(std::memory_order_acquire));
+        if (space == 0) {
+            auto res = waitFor([this, w] { return m_out->readPos.load(std::memory_order_acquire) + m_ringSize > w; },
+                               m_out->writerParked, m_outSpaceEvent, 1000);
+            if (res != WAIT_READY) {
+                MessageHelper::seterr(e, res == WAIT_TIMEOUT ? MessageHelper::E_TIMEOUT : MessageHelper::E_STATE);
+                traceln("wait for space failed");
+                return false;
+            }
+            continue;
+        }
+        auto len = jmin(space, toWrite);
+        auto pos = (size_t)(w & mask);
+        auto first = jmin(len, m_ringSize - pos);
+        memcpy(m_outData + pos, data + offset, first);
+        if (len > first) {
+            memcpy(m_outData, data + offset + first, len - first);
+        }
+        m_out->writePos.store(w + len, std::memory_order_release);
+        wakeUp(m_out->readerParked, m_outDataEvent);
+        offset += len;
+        toWrite -= len;
+    }
+    if (nullptr != metric) {
+        metric->increment((uint32)size);
+    }
+    return true;
+}
+
+bool SharedMemoryStream::read(void* data, int size, int timeoutMilliseconds, MessageHelper::Error* e, Meter* metric) {
+    traceScope();
+    MessageHelper::seterr(e, MessageHelper::E_NONE);
+    if (!isConnected()) {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        traceln("failed: E_STATE");
+        return false;
+    }
+    auto* dst = static_cast<char*>(data);
+    auto mask = m_ringSize - 1;
+    auto toRead = (size_t)size;
+    size_t offset = 0;
+    while (toRead > 0) {
+        auto r = m_in->readPos.load(std::memory_order_relaxed);
+        auto avail = (size_t)(m_in->writePos.load(std::memory_order_acquire) - r);
+        if (avail == 0) {
+            auto res = waitFor([this, r] { return m_in->writePos.load(std::memory_order_acquire) > r; },
+                               m_in->readerParked, m_inDataEvent, timeoutMilliseconds > 0 ? timeoutMilliseconds : -1);
+            if (res != WAIT_READY) {
+                MessageHelper::seterr(e, res == WAIT_TIMEOUT ? MessageHelper::E_TIMEOUT : MessageHelper::E_STATE);
+                traceln("wait for data failed");
+                return false;
+            }
+            continue;
+        }
+        auto len = jmin(avail, toRead);
+        auto pos = (size_t)(r & mask);
+        auto first = jmin(len, m_ringSize - pos);
+        memcpy(dst + offset, m_inData + pos, first);
+        if (len > first) {
+            memcpy(dst + offset + first, m_inData, len - first);
+        }
+        m_in->readPos.store(r + len, std::memory_order_release);
+        wakeUp(m_in->writerParked, m_inSpaceEvent);
+        offset += len;
+        toRead -= len;
+    }
+    if (nullptr != metric) {
+        metric->increment((uint32)size);
+    }
+    return true;
+}
+
+bool SharedMemoryStream::waitUntilReady(int timeoutMilliseconds) {
+    if (!isConnected()) {
+        return false;
+    }
+    auto r = m_in->readPos.load(std::memory_order_relaxed);
+    return waitFor([this, r] { return m_in->writePos.load(std::memory_order_acquire) > r; }, m_in->readerParked,
+                   m_inDataEvent, timeoutMilliseconds) == WAIT_READY;
+}
+
+bool send(SharedMemoryStream* stream, const char* data, int size, MessageHelper::Error* e, Meter* metric) {
+    if (nullptr == stream) {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        return false;
+    }
+    return stream->send(data, size, e, metric);
+}
+
+bool read(SharedMemoryStream* stream, void* data, int size, int timeoutMilliseconds, MessageHelper::Error* e,
+          Meter* metric) {
+    if (nullptr == stream) {
+        MessageHelper::seterr(e, MessageHelper::E_STATE);
+        return false;
+    }
+    return stream->read(data, size, timeoutMilliseconds, e, metric);
+}
+
+bool sendv(SharedMemoryStream* stream, const IOSlices& slices, MessageHelper::Error* e, Meter* metric) {
+    for (auto& slice : slices) {
+        if (!send(stream, slice.data, slice.size, e, metric)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readv(SharedMemoryStream* stream, const IOSlices& slices, int timeoutMilliseconds, MessageHelper::Error* e,
+           Meter* metric) {
+    for (auto& slice : slices) {
+        if (!read(stream, slice.data, slice.size, timeoutMilliseconds, e, metric)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace e47
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef SharedMemoryStream_hpp
+#define SharedMemoryStream_hpp
+
+#if defined(AG_PLUGIN) || defined(AG_SERVER)
+
+#include <JuceHeader.h>
+#include <atomic>
+
+#include "Message.hpp"
+#include "MemoryFile.hpp"
+#include "NamedEvent.hpp"
+#include "Utils.hpp"
+
+namespace e47 {
+
+/*
+ * A bidirectional byte stream between the plugin and a server running on the same machine. Each direction is a single
+ * producer/single consumer ring in a memory mapped file, so a block costs no kernel copies. Syscalls are only needed to
+ * wake up the other side, when it stopped spinning and waits for an event. The audio socket stays connected and is used
+ * for liveness only: after the server reported the result of opening the stream, nothing is sent over it, so the socket
+ * becoming readable means the peer is gone.
+ */
+class SharedMemoryStream : public LogTagDelegate {
+  public:
+    SharedMemoryStream(const LogTag* tag, uint64 clientId, size_t ringSize, bool isClient, StreamingSocket* socket);
+    ~SharedMemoryStream() override;
+
+    static size_t getRingSize(const HandshakeRequest& cfg);
+
+    bool open();
+    void close();
+    bool isConnected() const;
+
+    bool send(const char* data, int size, MessageHelper::Error* e, Meter* metric);
+    bool read(void* data, int size, int timeoutMilliseconds, MessageHelper::Error* e, Meter* metric);
+    bool waitUntilReady(int timeoutMilliseconds);
+
+  private:
+    static constexpr uint32 MAGIC = 0x41475348;  // AGSH
+    static constexpr int SPIN_MICROSECONDS = 200;
+    static constexpr int LIVENESS_CHECK_MILLISECONDS = 100;
+
+    // After spinning, a side flags itself as parked and waits on an event, that the other side signals after moving
+    // the position it waits for
+    struct Ring {
+        std::atomic<uint64> writePos;
+        std::atomic<uint32> readerParked;
+        char pad1[52];
+        std::atomic<uint64> readPos;
+        std::atomic<uint32> writerParked;
+        char pad2[52];
+    };
+
+    struct Header {
+        uint32 magic;
+        uint32 ringSize;
+        std::atomic<uint32> closed;
+        char pad[52];
+        Ring rings[2];
+    };
+
+    MemoryFile m_file;
+    size_t m_ringSize;
+    bool m_isClient;
+    StreamingSocket* m_socket;
+    Header* m_hdr = nullptr;
+    Ring* m_in = nullptr;
+    Ring* m_out = nullptr;
+    char* m_inData = nullptr;
+    char* m_outData = nullptr;
+    // the data and the space event of each ring, the reader waits for data and the writer for space
+    std::unique_ptr<NamedEvent> m_events[4];
+    NamedEvent* m_inDataEvent = nullptr;
+    NamedEvent* m_inSpaceEvent = nullptr;
+    NamedEvent* m_outDataEvent = nullptr;
+    NamedEvent* m_outSpaceEvent = nullptr;
+    std::atomic_bool m_peerGone{false};
+    std::atomic<double> m_lastPeerCheck{0};
+
+    enum WaitResult { WAIT_READY, WAIT_TIMEOUT, WAIT_CLOSED };
+
+    template <typename Fn>
+    WaitResult waitFor(Fn isReady, std::atomic<uint32>& parked, NamedEvent* event, int timeoutMilliseconds);
+    void wakeUp(std::atomic<uint32>& parked, NamedEvent* event);
+
+    bool checkPeer();
+};
+
+}  // namespace e47
+
+#endif
+
+#endif /* SharedMemoryStream_hpp */
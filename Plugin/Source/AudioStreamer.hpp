@@ -11,31 +11,63 @@
 #include <memory>
 #include "Client.hpp"
 #include "Metrics.hpp"
+#include "SharedMemoryStream.hpp"
+#include "DatagramStream.hpp"
+#include "Semaphore.hpp"
 
 namespace e47 {
 
 template <typename T>
 class AudioStreamer : public Thread, public LogTagDelegate {
   public:
-    AudioStreamer(Client* clnt, StreamingSocket* sock)
+    AudioStreamer(Client* clnt, StreamingSocket* sock, std::unique_ptr<SharedMemoryStream> shm = nullptr,
+                  std::unique_ptr<DatagramStream> udp = nullptr, bool compressedAudio = false,
+                  uint8 wireFormat = AudioWireFormat::NATIVE)
         : Thread("AudioStreamer"),
           LogTagDelegate(clnt),
           m_client(clnt),
           m_socket(std::unique_ptr<StreamingSocket>(sock)),
-          m_writeQ((size_t)clnt->NUM_OF_BUFFERS * 2),
-          m_readQ((size_t)clnt->NUM_OF_BUFFERS * 2),
+          m_shm(std::move(shm)),
+          m_udp(std::move(udp)),
+          m_msg(clnt),
+          m_readMsg(clnt),
+          m_readSem(SPIN_MICROSECONDS),
+          m_writeQ(getPoolSize(clnt)),
+          m_readQ(getPoolSize(clnt)),
+          m_inFlightQ(getPoolSize(clnt)),
+          m_maxInFlight((size_t)clnt->NUM_OF_BUFFERS.load()),
+          m_depth(clnt->NUM_OF_BUFFERS),
+          m_targetDepth(clnt->NUM_OF_BUFFERS),
           m_durationGlobal(TimeStatistic::getDuration("audio")),
-          m_durationLocal(TimeStatistic::getDuration(String("audio.") + String(getId()), false)) {
+          m_durationLocal(TimeStatistic::getDuration(String("audio.") + String(getId()), false)),
+          m_timeGlobal(Metrics::getStatistic<TimeStatistic>("audio")),
+          m_timeLocal(Metrics::getStatistic<TimeStatistic>(String("audio.") + String(getId()))),
+          m_readTime(Metrics::getStatistic<TimeStatistic>("audio-read")) {
         traceScope();
 
+        int channels = jmax(1, clnt->getChannelsIn(), clnt->getChannelsOut(), clnt->getNumActiveChannels());
+        int samples = clnt->getSamplesPerBlock();
+        m_pool.resize(getPoolSize(clnt));
+        m_freeBufs.reserve(m_pool.size());
+        for (auto& buf : m_pool) {
+            allocateBuffer(buf, channels, samples);
+            m_freeBufs.push_back(&buf);
+        }
+        // the read queue starts with silence, this is the latency the buffers add
         for (int i = 0; i < clnt->NUM_OF_BUFFERS; i++) {
-            AudioMidiBuffer buf;
-            buf.audio.setSize(clnt->getChannelsIn(), clnt->getSamplesPerBlock());
-            buf.audio.clear();
-            m_readQ.push(std::move(buf));
+            m_readQ.push(getFreeBuffer());
+            notifyRead();
         }
-        m_workingSendBuf.audio.clear();
-        m_workingReadBuf.audio.clear();
+        allocateBuffer(m_syncBuf, channels, samples);
+        allocateBuffer(m_workingSendBuf, channels, samples * 2);
+        allocateBuffer(m_workingReadBuf, channels, samples * 2);
+        m_midiScratch.ensureSize(MIDI_BUFFER_BYTES);
+        m_client->setNumOfBuffersActive(m_depth);
+
+        m_msg.setCompression(compressedAudio);
+        m_msg.setWireFormat(wireFormat);
+        m_readMsg.setCompression(compressedAudio);
+        m_readMsg.setWireFormat(wireFormat);
 
         m_bytesOutMeter = Metrics::getStatistic<Meter>("NetBytesOut");
         m_bytesInMeter = Metrics::getStatistic<Meter>("NetBytesIn");
@@ -47,6 +79,7 @@ class AudioStreamer : public Thread, public LogTagDelegate {
         signalThreadShouldExit();
         notifyWrite();
         notifyRead();
+        notifyInFlight();
         waitForThreadAndLog(getLogTagSource(), this);
         logln("audio streamer cleanup done");
     }
@@ -54,40 +87,48 @@ class AudioStreamer : public Thread, public LogTagDelegate {
     bool isOk() {
         traceScope();
         if (!m_error) {
-            return m_socket->isConnected();
+            return m_socket->isConnected() && (nullptr == m_shm || m_shm->isConnected()) &&
+                   (nullptr == m_udp || m_udp->isConnected());
         }
         return false;
     }
 
+    // Sends the buffered blocks without waiting for the responses, up to NUM_OF_BUFFERS blocks can be in flight. The
+    // responses are read by the receiver thread.
     void run() {
         traceScope();
         logln("audio streamer ready");
-        while (!currentThreadShouldExit() && !m_error && m_socket->isConnected()) {
-            while (m_writeQ.read_available() > 0) {
-                AudioMidiBuffer buf;
-                m_writeQ.pop(buf);
-                m_durationLocal.reset();
-                m_durationGlobal.reset();
-                if (!sendReal(buf)) {
-                    logln("error: " << getInstanceString() << ": send failed");
-                    setError();
-                    return;
-                }
-                MessageHelper::Error err;
-                if (!readReal(buf, &err)) {
-                    logln("error: " << getInstanceString() << ": read failed: " << err.toString());
-                    setError();
-                    return;
-                }
-                m_durationLocal.update();
-                m_durationGlobal.update();
-                m_readQ.push(std::move(buf));
-                notifyRead();
+        std::unique_ptr<Receiver> receiver;
+        if (m_maxInFlight > 0) {
+            receiver = std::make_unique<Receiver>(*this);
+            receiver->startThread(Thread::realtimeAudioPriority);
+        }
+        while (!currentThreadShouldExit() && !m_error && isOk()) {
+            AudioMidiBuffer* buf;
+            if (!waitInFlight() || !waitWrite() || !m_writeQ.pop(buf)) {
+                continue;
+            }
+            buf->sendTicks = Time::getHighResolutionTicks();
+            if (!sendReal(*buf)) {
+                logln("error: " << getInstanceString() << ": send failed");
+                setError();
+                break;
             }
-            waitWrite();
+            buf->seq = m_msg.getRequestSequence();
+            m_inFlight++;
+            m_inFlightQ.push(buf);
+            notifyInFlight();
+        }
+        if (nullptr != receiver) {
+            receiver->signalThreadShouldExit();
+            notifyInFlight();
+            receiver->waitForThreadToExit(-1);
         }
         m_durationLocal.clear();
         m_durationGlobal.clear();
+        if (m_msg.getCompression()) {
+            logln("audio compression ratio " << String(m_msg.getCompressionRatio(), 2));
+        }
         logln("audio streamer terminated");
     }
 
@@ -96,19 +137,22 @@ class AudioStreamer : public Thread, public LogTagDelegate {
         if (m_error) {
             return;
         }
+        m_playing = posInfo.isPlaying;
         if (m_client->NUM_OF_BUFFERS > 0) {
             if (buffer.getNumSamples() == m_client->getSamplesPerBlock() && m_workingSendSamples == 0) {
-                AudioMidiBuffer buf;
+                auto* buf = getFreeBuffer();
+                if (nullptr == buf) {
+                    return;
+                }
                 if (m_client->getChannelsIn() > 0) {  // fx
-                    buf.audio.makeCopyOf(buffer);
+                    copyAudio(buf->audio, buffer, buffer.getNumChannels(), buffer.getNumSamples());
                 } else {  // inst
-                    buf.channelsRequested = m_client->getNumActiveChannels();
-                    buf.samplesRequested = m_client->getSamplesPerBlock();
+                    buf->channelsRequested = m_client->getNumActiveChannels();
+                    buf->samplesRequested = m_client->getSamplesPerBlock();
                 }
-                buf.midi.addEvents(midi, 0, buffer.getNumSamples(), 0);
-                buf.posInfo = posInfo;
-                m_writeQ.push(std::move(buf));
-                notifyWrite();
+                buf->midi.addEvents(midi, 0, buffer.getNumSamples(), 0);
+                buf->posInfo = posInfo;
+                pushWrite(buf);
             } else {
                 if (!copyToWorkingBuffer(m_workingSendBuf, m_workingSendSamples, buffer, midi)) {
                     logln("error: " << getInstanceString() << ": send error");
@@ -116,22 +160,20 @@ class AudioStreamer : public Thread, public LogTagDelegate {
                     return;
                 }
                 if (m_workingSendSamples >= m_client->getSamplesPerBlock()) {
-                    AudioMidiBuffer buf;
-                    if (m_client->getChannelsIn() > 0) {  // fx
-                        buf.audio.setSize(m_client->getNumActiveChannels(), m_client->getSamplesPerBlock());
-                        for (int chan = 0; chan < m_client->getNumActiveChannels(); chan++) {
-                            buf.audio.copyFrom(chan, 0, m_workingSendBuf.audio, chan, 0,
-                                               m_client->getSamplesPerBlock());
+                    auto* buf = getFreeBuffer();
+                    if (nullptr != buf) {
+                        if (m_client->getChannelsIn() > 0) {  // fx
+                            copyAudio(buf->audio, m_workingSendBuf.audio, m_client->getNumActiveChannels(),
+                                      m_client->getSamplesPerBlock());
+                        } else {  // inst
+                            buf->channelsRequested = m_client->getNumActiveChannels();
+                            buf->samplesRequested = m_client->getSamplesPerBlock();
                         }
-                    } else {  // inst
-                        buf.channelsRequested = m_client->getNumActiveChannels();
-                        buf.samplesRequested = m_client->getSamplesPerBlock();
+                        buf->midi.addEvents(m_workingSendBuf.midi, 0, m_client->getSamplesPerBlock(), 0);
+                        buf->posInfo = posInfo;
+                        pushWrite(buf);
                     }
-                    buf.midi.addEvents(m_workingSendBuf.midi, 0, m_client->getSamplesPerBlock(), 0);
                     m_workingSendBuf.midi.clear(0, m_client->getSamplesPerBlock());
-                    buf.posInfo = posInfo;
-                    m_writeQ.push(std::move(buf));
-                    notifyWrite();
                     m_workingSendSamples -= m_client->getSamplesPerBlock();
                     if (m_workingSendSamples > 0) {
                         shiftSamplesToFront(m_workingSendBuf, m_client->getSamplesPerBlock(), m_workingSendSamples);
@@ -139,9 +181,10 @@ class AudioStreamer : public Thread, public LogTagDelegate {
                 }
             }
         } else {
-            AudioMidiBuffer buf;
+            auto& buf = m_syncBuf;
+            resetBuffer(buf);
             if (m_client->getChannelsIn() > 0) {  // fx
-                buf.audio.makeCopyOf(buffer);
+                copyAudio(buf.audio, buffer, buffer.getNumChannels(), buffer.getNumSamples());
             } else {  // inst
                 buf.channelsRequested = m_client->getNumActiveChannels();
                 buf.samplesRequested = buffer.getNumSamples();
@@ -159,41 +202,47 @@ class AudioStreamer : public Thread, public LogTagDelegate {
 
     void read(AudioBuffer<T>& buffer, MidiBuffer& midi) {
         traceScope();
+        // the time the audio thread spends in here, including waiting for data
+        TimeStatistic::Duration duration(m_readTime);
         if (m_error) {
             return;
         }
-        AudioMidiBuffer buf;
         if (m_client->NUM_OF_BUFFERS > 0) {
             if (buffer.getNumSamples() == m_client->getSamplesPerBlock() && m_workingReadSamples == 0) {
-                if (!waitRead()) {
+                AudioMidiBuffer* buf;
+                if (!popRead(buf)) {
                     logln("error: " << getInstanceString() << ": waitRead failed");
                     return;
                 }
-                m_readQ.pop(buf);
-                buffer.makeCopyOf(buf.audio);
+                if (nullptr == buf) {
+                    buffer.clear();
+                    midi.clear();
+                    return;
+                }
+                copyToHostBuffer(buffer, buf->audio);
                 midi.clear();
-                midi.addEvents(buf.midi, 0, buffer.getNumSamples(), 0);
+                midi.addEvents(buf->midi, 0, buffer.getNumSamples(), 0);
+                m_freeBufs.push_back(buf);
             } else {
                 while (m_workingReadSamples < buffer.getNumSamples()) {
-                    if (!waitRead()) {
+                    AudioMidiBuffer* buf;
+                    if (!popRead(buf)) {
                         logln("error: " << getInstanceString() << ": waitRead failed");
                         return;
                     }
-                    m_readQ.pop(buf);
-                    if (!copyToWorkingBuffer(m_workingReadBuf, m_workingReadSamples, buf.audio, buf.midi)) {
+                    if (nullptr == buf) {
+                        appendSilence(m_workingReadBuf, m_workingReadSamples, m_client->getSamplesPerBlock());
+                        continue;
+                    }
+                    bool ok = copyToWorkingBuffer(m_workingReadBuf, m_workingReadSamples, buf->audio, buf->midi);
+                    m_freeBufs.push_back(buf);
+                    if (!ok) {
                         logln("error: " << getInstanceString() << ": read error");
                         setError();
                         return;
                     }
                 }
-                int maxCh = jmin(buffer.getNumChannels(), m_workingReadBuf.audio.getNumChannels());
-                // clear channels of the target buffer, that we have no data for in the src buffer
-                for (int chan = maxCh; chan < buffer.getNumChannels(); chan++) {
-                    buffer.clear(chan, 0, buffer.getNumSamples());
-                }
-                for (int chan = 0; chan < maxCh; chan++) {
-                    buffer.copyFrom(chan, 0, m_workingReadBuf.audio, chan, 0, buffer.getNumSamples());
-                }
+                copyToHostBuffer(buffer, m_workingReadBuf.audio);
                 midi.clear();
                 midi.addEvents(m_workingReadBuf.midi, 0, buffer.getNumSamples(), 0);
                 m_workingReadBuf.midi.clear(0, buffer.getNumSamples());
@@ -203,7 +252,8 @@ class AudioStreamer : public Thread, public LogTagDelegate {
                 }
             }
         } else {
-            buf.audio.setSize(buffer.getNumChannels(), buffer.getNumSamples());
+            auto& buf = m_syncBuf;
+            buf.audio.setSize(buffer.getNumChannels(), buffer.getNumSamples(), false, false, true);
             MessageHelper::Error err;
             if (!readReal(buf, &err)) {
                 logln("error: " << getInstanceString() << ": read failed: " << err.toString());
@@ -212,7 +262,7 @@ class AudioStreamer : public Thread, public LogTagDelegate {
             }
             m_durationLocal.update();
             m_durationGlobal.update();
-            buffer.makeCopyOf(buf.audio);
+            copyToHostBuffer(buffer, buf.audio);
             midi.clear();
             midi.addEvents(buf.midi, 0, buffer.getNumSamples(), 0);
         }
@@ -225,16 +275,58 @@ class AudioStreamer : public Thread, public LogTagDelegate {
         AudioBuffer<T> audio;
         MidiBuffer midi;
         AudioPlayHead::CurrentPositionInfo posInfo;
+        uint32 seq = 0;
+        int64 sendTicks = 0;
+    };
+
+    class Receiver : public Thread {
+      public:
+        Receiver(AudioStreamer& streamer) : Thread("AudioReceiver"), m_streamer(streamer) {}
+        void run() override { m_streamer.receive(*this); }
+
+      private:
+        AudioStreamer& m_streamer;
     };
 
     Client* m_client;
     std::unique_ptr<StreamingSocket> m_socket;
-    boost::lockfree::spsc_queue<AudioMidiBuffer> m_writeQ, m_readQ;
-    std::mutex m_writeMtx, m_readMtx, m_sockMtx;
-    std::condition_variable m_writeCv, m_readCv;
+    std::unique_ptr<SharedMemoryStream> m_shm;
+    std::unique_ptr<DatagramStream> m_udp;
+    AudioMessage m_msg, m_readMsg;
+    boost::lockfree::spsc_queue<AudioMidiBuffer*> m_writeQ, m_readQ, m_inFlightQ;
+    // The audio thread signals and waits without locks. Every push to the write or read queue posts the semaphore
+    // once and every pop is preceded by a successful wait, so the counts match the queue sizes.
+    static constexpr int SPIN_MICROSECONDS = 100;
+    Semaphore m_writeSem, m_readSem;
+    std::mutex m_inFlightMtx, m_sockMtx;
+    std::condition_variable m_inFlightCv;
+    size_t m_maxInFlight;
+    std::atomic<size_t> m_inFlight{0};
+
+    // Adaptive buffering: m_depth is the number of blocks between sending and reading a block, it is owned by the
+    // audio thread. The receiver sets the target depth.
+    static constexpr int ADAPTIVE_SHRINK_MILLISECONDS = 5000;
+    static constexpr int ADAPTIVE_HEADROOM = 1;
+    enum DepthChange { DEPTH_KEEP, DEPTH_GROW, DEPTH_SHRINK };
+    int m_depth;
+    std::atomic_int m_targetDepth;
+    std::atomic_bool m_underrun{false};
+    std::atomic_bool m_playing{false};
+    bool m_fadedOut = false;
+    int m_windowMaxDepth = 0;
+    double m_windowStart = 0;
     TimeStatistic::Duration m_durationGlobal, m_durationLocal;
+    std::shared_ptr<TimeStatistic> m_timeGlobal, m_timeLocal, m_readTime;
     std::shared_ptr<Meter> m_bytesOutMeter, m_bytesInMeter;
 
+    // All blocks are allocated upfront and the queues pass pointers into the pool. Free buffers are taken and returned
+    // by the audio thread only, so the free list needs no synchronization.
+    static constexpr size_t MIDI_BUFFER_BYTES = 4096;
+    std::vector<AudioMidiBuffer> m_pool;
+    std::vector<AudioMidiBuffer*> m_freeBufs;
+    AudioMidiBuffer m_syncBuf;
+    MidiBuffer m_midiScratch;
+
     AudioMidiBuffer m_workingSendBuf, m_workingReadBuf;
     int m_workingSendSamples = 0;
     int m_workingReadSamples = 0;
@@ -244,12 +336,19 @@ class AudioStreamer : public Thread, public LogTagDelegate {
     void setError() {
         traceScope();
         m_sockMtx.lock();
+        if (nullptr != m_shm) {
+            m_shm->close();
+        }
+        if (nullptr != m_udp) {
+            m_udp->close();
+        }
         m_socket->close();
         m_sockMtx.unlock();
         m_error = true;
         m_client->setError();
         notifyRead();
         notifyWrite();
+        notifyInFlight();
     }
 
     String getInstanceString() const {
@@ -261,8 +360,7 @@ class AudioStreamer : public Thread, public LogTagDelegate {
 
     void notifyWrite() {
         traceScope();
-        std::lock_guard<std::mutex> lock(m_writeMtx);
-        m_writeCv.notify_one();
+        m_writeSem.post();
     }
 
     bool waitWrite() {
@@ -270,40 +368,288 @@ class AudioStreamer : public Thread, public LogTagDelegate {
         if (m_error || currentThreadShouldExit()) {
             return false;
         }
-        if (m_writeQ.read_available() == 0) {
-            std::unique_lock<std::mutex> lock(m_writeMtx);
-            return m_writeCv.wait_for(lock, std::chrono::seconds(1),
-                                      [this] { return m_writeQ.read_available() > 0 || currentThreadShouldExit(); });
-        }
-        return true;
+        return m_writeSem.wait(1000);
     }
 
     void notifyRead() {
         traceScope();
-        std::lock_guard<std::mutex> lock(m_readMtx);
-        m_readCv.notify_one();
+        m_readSem.post();
     }
 
     bool waitRead() {
         traceScope();
-        if (m_client->NUM_OF_BUFFERS > 1 && m_readQ.read_available() < (size_t)(m_client->NUM_OF_BUFFERS / 2) &&
-            m_readQ.read_available() > 0) {
+        // with adaptive buffering a low queue is expected, the depth grows on underruns
+        bool warn = m_depth > 1 && !m_client->ADAPTIVE_BUFFERS;
+        if (warn && m_readQ.read_available() < (size_t)(m_depth / 2) && m_readQ.read_available() > 0) {
             logln("warning: " << getInstanceString() << ": input buffer below 50% (" << m_readQ.read_available() << "/"
-                              << m_client->NUM_OF_BUFFERS << ")");
-        } else if (m_readQ.read_available() == 0) {
-            if (m_client->NUM_OF_BUFFERS > 1) {
-                logln("warning: " << getInstanceString()
-                                  << ": read queue empty, waiting for data, try increasing the NumberOfBuffers value");
+                              << m_depth << ")");
+        }
+        if (m_readSem.tryWait()) {
+            return m_readQ.read_available() > 0;
+        }
+        m_underrun = true;
+        if (warn) {
+            logln("warning: " << getInstanceString()
+                              << ": read queue empty, waiting for data, try increasing the NumberOfBuffers value");
+        }
+        if (m_error || threadShouldExit()) {
+            return false;
+        }
+        // setError() posts without pushing a block, so the queue has to be checked after waking up
+        return m_readSem.wait(1000) && m_readQ.read_available() > 0;
+    }
+
+    void notifyInFlight() {
+        traceScope();
+        std::lock_guard<std::mutex> lock(m_inFlightMtx);
+        m_inFlightCv.notify_all();
+    }
+
+    // Wait for the in-flight window to have room for the next block
+    bool waitInFlight() {
+        traceScope();
+        if (m_inFlight >= m_maxInFlight) {
+            std::unique_lock<std::mutex> lock(m_inFlightMtx);
+            return m_inFlightCv.wait_for(lock, std::chrono::seconds(1), [this] {
+                return m_inFlight < m_maxInFlight || m_error || currentThreadShouldExit();
+            }) && !m_error && !currentThreadShouldExit();
+        }
+        return true;
+    }
+
+    // Wait for a block, that has been sent and is waiting for a response
+    bool waitInFlightData(Thread& receiver) {
+        traceScope();
+        if (m_inFlightQ.read_available() == 0) {
+            std::unique_lock<std::mutex> lock(m_inFlightMtx);
+            return m_inFlightCv.wait_for(lock, std::chrono::seconds(1), [this, &receiver] {
+                return m_inFlightQ.read_available() > 0 || m_error || receiver.threadShouldExit();
+            }) && m_inFlightQ.read_available() > 0;
+        }
+        return true;
+    }
+
+    void receive(Thread& receiver) {
+        traceScope();
+        while (!receiver.threadShouldExit() && !m_error) {
+            if (!waitInFlightData(receiver)) {
+                continue;
+            }
+            AudioMidiBuffer* buf;
+            m_inFlightQ.pop(buf);
+            MessageHelper::Error err;
+            if (!readReal(*buf, &err)) {
+                if (!receiver.threadShouldExit()) {
+                    logln("error: " << getInstanceString() << ": read failed: " << err.toString());
+                    setError();
+                }
+                return;
+            }
+            if (!matchSequence(buf, receiver)) {
+                setError();
+                return;
+            }
+            auto ms = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - buf->sendTicks) * 1000;
+            m_timeLocal->update(ms);
+            m_timeGlobal->update(ms);
+            updateTargetDepth(ms);
+            m_inFlight--;
+            m_readQ.push(buf);
+            notifyRead();
+            notifyInFlight();
+        }
+    }
+
+    // Responses arrive in order, but the server skips requests, that got lost on the way (UDP). The blocks of the
+    // skipped requests are replaced by silence and the response is moved to the block it belongs to.
+    bool matchSequence(AudioMidiBuffer*& buf, Thread& receiver) {
+        traceScope();
+        auto seq = m_readMsg.getResponseSequence();
+        auto skipped = (int32)(seq - buf->seq);
+        if (skipped < 0 || skipped >= (int32)m_inFlight) {
+            logln("error: " << getInstanceString() << ": unexpected response " << (int64)seq << ", expected "
+                            << (int64)buf->seq);
+            return false;
+        }
+        for (; skipped > 0; skipped--) {
+            while (!waitInFlightData(receiver)) {
+                if (m_error || receiver.threadShouldExit()) {
+                    return false;
+                }
             }
-            if (!m_error && !threadShouldExit()) {
-                std::unique_lock<std::mutex> lock(m_readMtx);
-                return m_readCv.wait_for(lock, std::chrono::seconds(1),
-                                         [this] { return m_readQ.read_available() > 0 || threadShouldExit(); });
+            AudioMidiBuffer* next;
+            m_inFlightQ.pop(next);
+            std::swap(buf->audio, next->audio);
+            buf->midi.swapWith(next->midi);
+            buf->audio.clear();
+            buf->midi.clear();
+            m_inFlight--;
+            m_readQ.push(buf);
+            notifyRead();
+            buf = next;
+        }
+        return true;
+    }
+
+    // The depth has to cover the round trip time of a block. Every change of the depth changes the latency, so it
+    // grows with some headroom, as soon as a round trip or an underrun needs more blocks. It only shrinks while the
+    // transport is stopped and if no round trip needed the headroom for a while.
+    void updateTargetDepth(double roundTripMs) {
+        traceScope();
+        int maxDepth = (int)m_maxInFlight;
+        if (!m_client->ADAPTIVE_BUFFERS) {
+            m_targetDepth = maxDepth;
+            return;
+        }
+        auto blockMs = m_client->getSamplesPerBlock() * 1000.0 / m_client->getSampleRate();
+        int target = m_targetDepth;
+        int needed = (int)(roundTripMs / blockMs) + 1;
+        if (m_underrun.exchange(false)) {
+            needed = jmax(needed, target + 1);
+        }
+        needed = jmin(needed, maxDepth);
+        m_windowMaxDepth = jmax(m_windowMaxDepth, needed);
+        auto now = Time::getMillisecondCounterHiRes();
+        if (needed > target) {
+            target = jmin(needed + ADAPTIVE_HEADROOM, maxDepth);
+            m_windowMaxDepth = needed;
+            m_windowStart = now;
+        } else if (now - m_windowStart >= ADAPTIVE_SHRINK_MILLISECONDS) {
+            if (!m_playing && m_windowMaxDepth + ADAPTIVE_HEADROOM < target) {
+                target = m_windowMaxDepth + ADAPTIVE_HEADROOM;
             }
+            m_windowMaxDepth = 0;
+            m_windowStart = now;
+        }
+        if (target != m_targetDepth) {
+            logln("adapting the number of buffers from " << m_targetDepth.load() << " to " << target
+                                                         << " (round trip " << String(roundTripMs, 1) << "ms)");
+            m_targetDepth = target;
+        }
+    }
+
+    // Pops the next block from the read queue, buf is nullptr, if a silent block has to be played instead. Depth
+    // changes happen between two blocks, the block before a change is faded out and the block after it faded in.
+    bool popRead(AudioMidiBuffer*& buf) {
+        traceScope();
+        buf = nullptr;
+        if (m_fadedOut && applyDepthChange() == DEPTH_GROW) {
+            return true;
+        }
+        if (!waitRead()) {
+            return false;
+        }
+        m_readQ.pop(buf);
+        int samples = jmin(buf->audio.getNumSamples(), m_client->getSamplesPerBlock());
+        if (m_fadedOut) {
+            buf->audio.applyGainRamp(0, samples, (T)0, (T)1);
+            m_fadedOut = false;
+        } else if (canChangeDepth()) {
+            buf->audio.applyGainRamp(0, samples, (T)1, (T)0);
+            m_fadedOut = true;
         }
         return true;
     }
 
+    bool canChangeDepth() const {
+        int target = m_targetDepth;
+        // shrinking needs a block to drop and another one to fade in
+        return target > m_depth || (target < m_depth && !m_playing && m_readQ.read_available() > 1);
+    }
+
+    // Moves the depth towards the target, called from the audio thread. To grow, a silent block is played per step
+    // instead of the next block. To shrink, blocks are dropped. The latency is updated once the target is reached.
+    DepthChange applyDepthChange() {
+        traceScope();
+        int target = m_targetDepth;
+        if (target > m_depth) {
+            if (++m_depth == target) {
+                m_client->setNumOfBuffersActive(m_depth);
+            }
+            return DEPTH_GROW;
+        }
+        auto change = DEPTH_KEEP;
+        while (target < m_depth && !m_playing && m_readQ.read_available() > 1 && m_readSem.tryWait()) {
+            AudioMidiBuffer* buf;
+            m_readQ.pop(buf);
+            m_freeBufs.push_back(buf);
+            m_depth--;
+            change = DEPTH_SHRINK;
+        }
+        if (change == DEPTH_SHRINK) {
+            m_client->setNumOfBuffersActive(m_depth);
+        }
+        return change;
+    }
+
+    void appendSilence(AudioMidiBuffer& dst, int& workingSamples, int num) {
+        traceScope();
+        if (dst.audio.getNumSamples() - workingSamples < num) {
+            dst.audio.setSize(dst.audio.getNumChannels(), workingSamples + num, true);
+        }
+        dst.audio.clear(workingSamples, num);
+        workingSamples += num;
+    }
+
+    static size_t getPoolSize(Client* clnt) { return (size_t)clnt->NUM_OF_BUFFERS * 2 + 2; }
+
+    static void allocateBuffer(AudioMidiBuffer& buf, int channels, int samples) {
+        buf.audio.setSize(channels, samples);
+        buf.audio.clear();
+        buf.midi.ensureSize(MIDI_BUFFER_BYTES);
+    }
+
+    static void resetBuffer(AudioMidiBuffer& buf) {
+        buf.channelsRequested = -1;
+        buf.samplesRequested = -1;
+        buf.audio.setSize(0, 0, false, false, true);
+        buf.midi.clear();
+    }
+
+    AudioMidiBuffer* getFreeBuffer() {
+        traceScope();
+        if (m_freeBufs.empty()) {
+            logln("warning: " << getInstanceString() << ": no free buffer, dropping block");
+            return nullptr;
+        }
+        auto* buf = m_freeBufs.back();
+        m_freeBufs.pop_back();
+        resetBuffer(*buf);
+        return buf;
+    }
+
+    void pushWrite(AudioMidiBuffer* buf) {
+        traceScope();
+        if (m_writeQ.push(buf)) {
+            notifyWrite();
+        } else {
+            m_freeBufs.push_back(buf);
+        }
+    }
+
+    // Copies without reallocating, as long as the buffer is big enough
+    static void copyAudio(AudioBuffer<T>& dst, const AudioBuffer<T>& src, int channels, int samples) {
+        dst.setSize(channels, samples, false, false, true);
+        for (int chan = 0; chan < channels; chan++) {
+            dst.copyFrom(chan, 0, src, chan, 0, samples);
+        }
+    }
+
+    // Copies into the host buffer, channels without data are cleared
+    static void copyToHostBuffer(AudioBuffer<T>& dst, const AudioBuffer<T>& src) {
+        int maxCh = jmin(dst.getNumChannels(), src.getNumChannels());
+        int samples = jmin(dst.getNumSamples(), src.getNumSamples());
+        for (int chan = 0; chan < maxCh; chan++) {
+            dst.copyFrom(chan, 0, src, chan, 0, samples);
+        }
+        for (int chan = maxCh; chan < dst.getNumChannels(); chan++) {
+            dst.clear(chan, 0, dst.getNumSamples());
+        }
+        if (samples < dst.getNumSamples()) {
+            dst.clear(samples, dst.getNumSamples() - samples);
+        }
+    }
+
     bool copyToWorkingBuffer(AudioMidiBuffer& dst, int& workingSamples, AudioBuffer<T>& src, MidiBuffer& midi) {
         traceScope();
         if (src.getNumChannels() > 0) {
@@ -330,30 +676,44 @@ class AudioStreamer : public Thread, public LogTagDelegate {
             }
         }
         if (buf.midi.getNumEvents() > 0) {
-            MidiBuffer midiCpy;
-            midiCpy.addEvents(buf.midi, 0, -1, -start);
+            m_midiScratch.clear();
+            m_midiScratch.addEvents(buf.midi, 0, -1, -start);
             buf.midi.clear();
-            buf.midi.addEvents(midiCpy, 0, -1, 0);
+            buf.midi.addEvents(m_midiScratch, 0, -1, 0);
+        }
+    }
+
+    // Calls fn with the stream that transports the audio data
+    template <typename Fn>
+    auto withStream(Fn fn) -> decltype(fn(m_socket.get())) {
+        if (nullptr != m_shm) {
+            return fn(m_shm.get());
+        }
+        if (nullptr != m_udp) {
+            return fn(m_udp.get());
         }
+        return fn(m_socket.get());
     }
 
     bool sendReal(AudioMidiBuffer& buffer) {
         traceScope();
-        AudioMessage msg(m_client);
-        return msg.sendToServer(m_socket.get(), buffer.audio, buffer.midi, buffer.posInfo, buffer.channelsRequested,
-                                buffer.samplesRequested, nullptr, *m_bytesOutMeter);
+        return withStream([&](auto* stream) {
+            return m_msg.sendToServer(stream, buffer.audio, buffer.midi, buffer.posInfo, buffer.channelsRequested,
+                                      buffer.samplesRequested, nullptr, *m_bytesOutMeter);
+        });
     }
 
     bool readReal(AudioMidiBuffer& buffer, MessageHelper::Error* e) {
         traceScope();
-        AudioMessage msg(m_client);
         if (buffer.audio.getNumChannels() < buffer.channelsRequested ||
             buffer.audio.getNumSamples() < buffer.samplesRequested) {
-            buffer.audio.setSize(buffer.channelsRequested, buffer.samplesRequested);
+            buffer.audio.setSize(buffer.channelsRequested, buffer.samplesRequested, false, false, true);
         }
-        bool success = msg.readFromServer(m_socket.get(), buffer.audio, buffer.midi, e, *m_bytesInMeter);
+        bool success = withStream([&](auto* stream) {
+            return m_readMsg.readFromServer(stream, buffer.audio, buffer.midi, e, *m_bytesInMeter);
+        });
         if (success) {
-            m_client->setLatency(msg.getLatencySamples());
+            m_client->setLatency(m_readMsg.getLatencySamples());
         }
         return success;
     }
@@ -21,6 +21,8 @@
 namespace e47 {
 
 std::atomic_uint32_t Client::count{0};
+std::unordered_map<Client*, Client::DSPLoad> Client::m_maxDSPLoad;
+std::mutex Client::m_maxDSPLoadMtx;
 
 Client::Client(AudioGridderAudioProcessor* processor)
     : Thread("Client"), LogTag("client"), m_processor(processor), m_msgFactory(this) {
@@ -34,6 +36,8 @@ Client::~Client() {
     signalThreadShouldExit();
     close();
     count--;
+    std::lock_guard<std::mutex> lock(m_maxDSPLoadMtx);
+    m_maxDSPLoad.erase(this);
 }
 
 void Client::run() {
@@ -54,6 +58,8 @@ void Client::run() {
             NUM_OF_BUFFERS = newNum;
             reconnect();
         }
+        // the audio streamer picks this up without reconnecting
+        ADAPTIVE_BUFFERS = jsonGetValue(cfg, "AdaptiveBuffers", ADAPTIVE_BUFFERS.load());
         newNum = jsonGetValue(cfg, "LoadPluginTimeoutMS", LOAD_PLUGIN_TIMEOUT.load());
         if (LOAD_PLUGIN_TIMEOUT != newNum) {
             logln("timeout for leading a plugin changed from " << LOAD_PLUGIN_TIMEOUT << " to " << newNum);
@@ -94,6 +100,8 @@ void Client::run() {
         // CPU load update
         if ((loops % cpuUpdateSeconds == 0) && isReadyLockFree()) {
             updateCPULoad();
+            updateDSPLoad();
+            updateXruns();
         }
 
         // Trigger sync
@@ -269,6 +277,8 @@ void Client::init() {
         id = m_srvId;
         port = m_srvPort + m_srvId;
     }
+    // before locking, as the processor holds its plugins lock while calling the client
+    auto fingerprint = m_processor->getLoadedPluginsFingerprint();
     LockByID lock(*this, INIT2);
     m_error = true;
 #if !JucePlugin_IsMidiEffect
@@ -294,12 +304,42 @@ void Client::init() {
         if (m_processor->getNoSrvPluginListFilter()) {
             cfg.setFlag(HandshakeRequest::NO_PLUGINLIST_FILTER);
         }
+        if (!m_sharedMemoryAudioFailed) {
+            // the server decides if the shared memory transport can be used
+            cfg.setFlag(HandshakeRequest::SHARED_MEMORY_AUDIO);
+        }
+        if (m_processor->getUdpAudio() && !m_udpAudioFailed) {
+            cfg.setFlag(HandshakeRequest::UDP_AUDIO);
+        }
+        if (m_processor->getAudioCompression()) {
+            cfg.setFlag(HandshakeRequest::COMPRESSED_AUDIO);
+        }
+        cfg.wireFormat = m_doublePrecission ? m_processor->getAudioWireFormat()
+                                            : AudioWireFormat::resolve<float>(m_processor->getAudioWireFormat());
+        cfg.setFlag(HandshakeRequest::SESSION_ATTACH);
+
+        // try to take over the plugins of the previous session, if it has been lost
+        String server = host + ":" + String(port);
+        bool resume = m_sessionToken != 0 && m_sessionServer == server;
+        if (resume) {
+            cfg.setFlag(HandshakeRequest::RESUME_SESSION);
+        }
 
         if (!send(m_cmdOut.get(), reinterpret_cast<const char*>(&cfg), sizeof(cfg))) {
             m_cmdOut->close();
             return;
         }
 
+        if (resume) {
+            ResumeRequest req = {m_sessionToken, 0, fingerprint};
+            if (!send(m_cmdOut.get(), reinterpret_cast<const char*>(&req), sizeof(req))) {
+                m_cmdOut->close();
+                return;
+            }
+        }
+        m_sessionToken = 0;
+        m_sessionResumed = false;
+
         HandshakeResponse resp;
         MessageHelper::Error err;
         if (!read(m_cmdOut.get(), &resp, sizeof(resp), 5000, &err)) {
@@ -307,19 +347,50 @@ void Client::init() {
             m_cmdOut->close();
             return;
         }
-        m_cmdOut->close();
 
         m_srvLocalMode = resp.isFlag(HandshakeResponse::LOCAL_MODE);
         logln("server local mode is " << (int)m_srvLocalMode);
+        m_srvPluginDSPLoad = resp.isFlag(HandshakeResponse::PLUGIN_DSP_LOAD);
+        m_srvXrunReporting = resp.isFlag(HandshakeResponse::XRUN_REPORTING);
+        m_srvLoadChain = resp.isFlag(HandshakeResponse::LOAD_CHAIN);
+        if (resp.isFlag(HandshakeResponse::SESSION_RESUME)) {
+            m_sessionToken = resp.sessionToken;
+            m_sessionServer = server;
+        }
+        m_sessionResumed = resume && resp.isFlag(HandshakeResponse::SESSION_RESUMED);
+        if (m_sessionResumed) {
+            logln("resumed the previous session");
+        }
 
-        logln("connecting server " << host << ":" << resp.port);
-        if (!m_cmdOut->connect(host, resp.port, 3000)) {
-            logln("connection to server failed");
+        // In session mode the handshake connection is kept for the commands and all other connections are attached
+        // to the session via the server port. Otherwise the server provides a port for the connections.
+        bool session = resp.isFlag(HandshakeResponse::SESSION_ATTACH);
+        auto connectStream = [&](StreamingSocket* sock, uint16 stream) {
+            if (!session) {
+                return sock->connect(host, resp.port, 3000);
+            }
+            if (!sock->connect(host, port, 3000)) {
+                return false;
+            }
+            HandshakeRequest attach = cfg;
+            attach.flags = HandshakeRequest::ATTACH_STREAM;
+            attach.stream = stream;
+            return send(sock, reinterpret_cast<const char*>(&attach), sizeof(attach));
+        };
+
+        if (session) {
+            logln("attaching to session on server " << host << ":" << port);
+        } else {
             m_cmdOut->close();
-            return;
+            logln("connecting server " << host << ":" << resp.port);
+            if (!m_cmdOut->connect(host, resp.port, 3000)) {
+                logln("connection to server failed");
+                m_cmdOut->close();
+                return;
+            }
         }
         m_cmdIn = std::make_unique<StreamingSocket>();
-        if (!m_cmdIn->connect(host, resp.port, 3000)) {
+        if (!connectStream(m_cmdIn.get(), HandshakeRequest::STREAM_CALLBACKS)) {
             logln("failed to setup command receive connection");
             m_cmdIn.reset();
         }
@@ -327,26 +398,86 @@ void Client::init() {
 
         StreamingSocket* audioSock = nullptr;
         audioSock = new StreamingSocket;
-        if (!audioSock->connect(host, resp.port, 3000)) {
+        std::unique_ptr<SharedMemoryStream> shm;
+        if (resp.isFlag(HandshakeResponse::SHARED_MEMORY_AUDIO)) {
+            // the stream has to exist before the server accepts the audio connection
+            shm = std::make_unique<SharedMemoryStream>(this, getId(), SharedMemoryStream::getRingSize(cfg), true,
+                                                       audioSock);
+            if (!shm->open()) {
+                logln("failed to create shared memory audio stream, falling back to TCP with the next connect");
+                m_sharedMemoryAudioFailed = true;
+                shm.reset();
+                delete audioSock;
+                audioSock = nullptr;
+            }
+        }
+        if (nullptr != audioSock && !connectStream(audioSock, HandshakeRequest::STREAM_AUDIO)) {
             logln("failed to setup audio connection");
+            shm.reset();
             delete audioSock;
             audioSock = nullptr;
         }
+        if (nullptr != audioSock && nullptr != shm) {
+            // the server reports, if it could open the stream
+            char result = 0;
+            if (!read(audioSock, &result, 1, 3000)) {
+                logln("failed to read shared memory negotiation result");
+                shm.reset();
+                delete audioSock;
+                audioSock = nullptr;
+            } else if (result != 1) {
+                logln("server failed to open the shared memory audio stream, using TCP");
+                m_sharedMemoryAudioFailed = true;
+                shm.reset();
+            }
+        }
+
+        std::unique_ptr<DatagramStream> udp;
+        if (nullptr != audioSock && nullptr == shm && resp.isFlag(HandshakeResponse::UDP_AUDIO)) {
+            udp = std::make_unique<DatagramStream>(this, getId(), audioSock);
+            // in session mode the server sends the UDP port over the audio connection
+            switch (udp->connectToServer(host, session ? 0 : resp.port, 3000)) {
+                case DatagramStream::NEGOTIATION_OK:
+                    // don't wait longer for a lost block than the configured buffers allow
+                    udp->setConcealTimeout(
+                        roundToInt(jmax(1, NUM_OF_BUFFERS.load()) * m_samplesPerBlock * 1000 / m_rate) + 5);
+                    break;
+                case DatagramStream::NEGOTIATION_DECLINED:
+                    logln("server declined UDP audio, using TCP");
+                    udp.reset();
+                    break;
+                case DatagramStream::NEGOTIATION_FAILED:
+                    logln("UDP audio negotiation failed, falling back to TCP with the next connect");
+                    m_udpAudioFailed = true;
+                    udp.reset();
+                    delete audioSock;
+                    audioSock = nullptr;
+                    break;
+            }
+        }
 
         m_screen_socket = std::make_unique<StreamingSocket>();
-        if (!m_screen_socket->connect(host, resp.port, 3000)) {
+        if (!connectStream(m_screen_socket.get(), HandshakeRequest::STREAM_SCREEN)) {
             logln("failed to setup screen connection");
             m_screen_socket.reset();
         }
 
         if (nullptr != audioSock) {
-            logln("audio connection established");
+            bool compressed = resp.isFlag(HandshakeResponse::COMPRESSED_AUDIO);
+            auto wireFormat = AudioWireFormat::isValid((uint8)resp.wireFormat) ? (uint8)resp.wireFormat
+                                                                                : (uint8)AudioWireFormat::NATIVE;
+            logln("audio connection established"
+                  << (nullptr != shm ? " (shared memory)" : "") << (nullptr != udp ? " (UDP)" : "")
+                  << (compressed ? " (compressed)" : "") << " (wire format " << AudioWireFormat::toString(wireFormat)
+                  << ")");
             std::lock_guard<std::mutex> audiolck(m_audioMtx);
             if (m_doublePrecission) {
-                m_audioStreamerD = std::make_shared<AudioStreamer<double>>(this, audioSock);
+                m_audioStreamerD = std::make_shared<AudioStreamer<double>>(this, audioSock, std::move(shm),
+                                                                           std::move(udp), compressed, wireFormat);
                 m_audioStreamerD->startThread(Thread::realtimeAudioPriority);
             } else {
-                m_audioStreamerF = std::make_shared<AudioStreamer<float>>(this, audioSock);
+                m_audioStreamerF = std::make_shared<AudioStreamer<float>>(this, audioSock, std::move(shm),
+                                                                          std::move(udp), compressed, wireFormat);
                 m_audioStreamerF->startThread(Thread::realtimeAudioPriority);
             }
         } else {
@@ -405,6 +536,11 @@ void Client::close() {
     m_ready = false;
     LockByID lock(*this, CLOSE);
     m_plugins.clear();
+    // Quitting tells the server, that the session is not needed anymore. Without it, the server keeps the plugins
+    // for a while, so that they can be taken over after a lost connection.
+    if ((m_needsReconnect || threadShouldExit()) && nullptr != m_cmdOut && m_cmdOut->isConnected()) {
+        quit();
+    }
     if (nullptr != m_screen_socket && m_screen_socket->isConnected()) {
         m_screen_socket->close();
     }
@@ -503,18 +639,7 @@ bool Client::addPlugin(String id, StringArray& presets, Array<Parameter>& params
             logln(err);
             return false;
         }
-        auto jparams = msgParams.payload.getJson();
-        Array<Parameter> paramsBak(std::move(params));
-        for (auto& jparam : jparams) {
-            auto newParam = Parameter::fromJson(jparam);
-            for (auto& oldParam : paramsBak) {
-                if (newParam.idx == oldParam.idx) {
-                    newParam.automationSlot = oldParam.automationSlot;
-                    break;
-                }
-            }
-            params.add(std::move(newParam));
-        }
+        updateParameters(params, msgParams.payload.getJson());
         Message<PluginSettings> msgSettings(this);
         if (settings.isNotEmpty()) {
             MemoryBlock block;
@@ -534,6 +659,73 @@ bool Client::addPlugin(String id, StringArray& presets, Array<Parameter>& params
     return false;
 }
 
+bool Client::loadChain(std::vector<ChainPlugin>& plugins, bool& scDisabled, String& err) {
+    traceScope();
+    if (!isReadyLockFree()) {
+        return false;
+    }
+    json jplugins = json::array();
+    for (auto& p : plugins) {
+        jplugins.push_back({{"id", p.id.toStdString()}, {"settings", p.settings.toStdString()}});
+    }
+    MessageHelper::Error e;
+    Message<LoadChain> msg(this);
+    PLD(msg).setJson(jplugins);
+    LockByID lock(*this, LOADCHAIN);
+    // the server loads the plugins one after the other, if parallel loading is disabled
+    TimeStatistic::Timeout timeout(LOAD_PLUGIN_TIMEOUT * jmax(1, (int)plugins.size()));
+    if (!msg.send(m_cmdOut.get())) {
+        err = "failed to send request";
+        logln(err);
+        m_error = true;
+        return false;
+    }
+    Message<LoadChainResult> msgResult(this);
+    if (!msgResult.read(m_cmdOut.get(), &e, timeout.getMillisecondsLeft())) {
+        err = "failed to get result: " + e.toString();
+        logln(err);
+        // a late result would be taken as the response to the next request, so the connection has to be reset
+        m_error = true;
+        return false;
+    }
+    auto jresult = PLD(msgResult).getJson();
+    auto& jresults = jresult["plugins"];
+    if (!jresults.is_array() || jresults.size() != plugins.size()) {
+        err = "invalid result";
+        logln(err);
+        return false;
+    }
+    for (size_t i = 0; i < plugins.size(); i++) {
+        auto& p = plugins[i];
+        auto& jplug = jresults[i];
+        p.ok = jplug["success"].get<bool>();
+        if (p.ok) {
+            p.hasEditor = jplug["hasEditor"].get<bool>();
+            p.presets = StringArray::fromTokens(String(jplug["presets"].get<std::string>()), "|", "");
+            updateParameters(p.params, jplug["params"]);
+        } else {
+            p.err = jplug["err"].get<std::string>();
+        }
+    }
+    m_latency = jresult["latency"].get<int>();
+    scDisabled = jresult["disabledSideChain"].get<bool>();
+    return true;
+}
+
+void Client::updateParameters(Array<Parameter>& params, const json& jparams) {
+    Array<Parameter> paramsBak(std::move(params));
+    for (auto& jparam : jparams) {
+        auto newParam = Parameter::fromJson(jparam);
+        for (auto& oldParam : paramsBak) {
+            if (newParam.idx == oldParam.idx) {
+                newParam.automationSlot = oldParam.automationSlot;
+                break;
+            }
+        }
+        params.add(std::move(newParam));
+    }
+}
+
 void Client::delPlugin(int idx) {
     traceScope();
     if (!isReadyLockFree()) {
@@ -653,6 +845,18 @@ void Client::exchangePlugins(int idxA, int idxB) {
     msg.send(m_cmdOut.get());
 }
 
+void Client::setPluginBranch(int idx, int branch) {
+    traceScope();
+    if (!isReadyLockFree()) {
+        return;
+    };
+    Message<SetPluginBranch> msg(this);
+    DATA(msg)->idx = idx;
+    DATA(msg)->branch = branch;
+    LockByID lock(*this, SETPLUGINBRANCH);
+    msg.send(m_cmdOut.get());
+}
+
 Array<ServerPlugin> Client::getRecents() {
     traceScope();
     Array<ServerPlugin> recents;
@@ -1049,6 +1253,98 @@ void Client::updateCPULoad() {
     }
 }
 
+void Client::updateDSPLoad() {
+    traceScope();
+    if (!m_srvPluginDSPLoad) {
+        return;
+    }
+    Message<PluginDSPLoad> msg(this);
+    {
+        LockByID lock(*this, UPDATEDSPLOAD);
+        if (!msg.send(m_cmdOut.get()) || !msg.read(m_cmdOut.get())) {
+            logln("failed to update plugin dsp load");
+            // a late response would be taken as the response to the next request
+            m_error = true;
+            return;
+        }
+    }
+    std::vector<DSPLoad> loads;
+    DSPLoad maxLoad = {"", 0.0f, 0.0f};
+    for (auto& plug : PLD(msg).getJson()) {
+        DSPLoad l = {plug["name"].get<std::string>(), plug["load"].get<float>(), plug["peak"].get<float>()};
+        if (l.load > maxLoad.load) {
+            maxLoad = l;
+        }
+        loads.push_back(std::move(l));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_dspLoadMtx);
+        m_dspLoad = loads;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_maxDSPLoadMtx);
+        m_maxDSPLoad[this] = maxLoad;
+    }
+    m_processor->updateDSPLoad();
+}
+
+std::vector<Client::DSPLoad> Client::getDSPLoad() {
+    std::lock_guard<std::mutex> lock(m_dspLoadMtx);
+    return m_dspLoad;
+}
+
+void Client::updateXruns() {
+    traceScope();
+    if (!m_srvXrunReporting) {
+        return;
+    }
+    Message<ChainXruns> msg(this);
+    {
+        LockByID lock(*this, UPDATEXRUNS);
+        if (!msg.send(m_cmdOut.get()) || !msg.read(m_cmdOut.get())) {
+            logln("failed to update xruns");
+            // a late response would be taken as the response to the next request
+            m_error = true;
+            return;
+        }
+    }
+    auto j = PLD(msg).getJson();
+    Xruns xruns;
+    xruns.count = j["count"].get<uint64>();
+    xruns.budget = j["budget"].get<float>();
+    xruns.maxOverrun = j["maxOverrun"].get<float>();
+    xruns.plugin = j["plugin"].get<std::string>();
+    auto now = Time::getMillisecondCounter();
+    {
+        std::lock_guard<std::mutex> lock(m_xrunsMtx);
+        // the counter starts from zero after a reconnect
+        if (xruns.count > m_xruns.count || (xruns.count > 0 && xruns.count < m_xruns.count)) {
+            logln("xruns: " << xruns.count << " block(s) missed the deadline of " << String(xruns.budget, 2)
+                            << "ms, slowest plugin: " << xruns.plugin);
+            m_lastXrun = now;
+        }
+        xruns.unstable = m_lastXrun > 0 && now - m_lastXrun < (uint32)XRUN_WARNING_SECONDS * 1000;
+        m_xruns = xruns;
+    }
+    m_processor->updateXruns();
+}
+
+Client::Xruns Client::getXruns() {
+    std::lock_guard<std::mutex> lock(m_xrunsMtx);
+    return m_xruns;
+}
+
+Client::DSPLoad Client::getMaxDSPLoad() {
+    DSPLoad ret = {"", 0.0f, 0.0f};
+    std::lock_guard<std::mutex> lock(m_maxDSPLoadMtx);
+    for (auto& l : m_maxDSPLoad) {
+        if (l.second.load > ret.load) {
+            ret = l.second;
+        }
+    }
+    return ret;
+}
+
 StreamingSocket* Client::accept(StreamingSocket& sock) const {
     traceScope();
     StreamingSocket* clnt = nullptr;
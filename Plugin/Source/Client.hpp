@@ -22,6 +22,7 @@ JUCE_BEGIN_IGNORE_WARNINGS_GCC_LIKE("-Wzero-as-null-pointer-constant", "-Wsign-c
 JUCE_END_IGNORE_WARNINGS_GCC_LIKE
 
 #include <memory>
+#include <unordered_map>
 
 namespace e47 {
 
@@ -138,6 +139,7 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
     };
 
     std::atomic_int NUM_OF_BUFFERS{Defaults::DEFAULT_NUM_OF_BUFFERS};
+    std::atomic_bool ADAPTIVE_BUFFERS{false};  // NUM_OF_BUFFERS is the maximum, if enabled
     std::atomic_int LOAD_PLUGIN_TIMEOUT{Defaults::DEFAULT_LOAD_PLUGIN_TIMEOUT};
 
     void run() override;
@@ -148,12 +150,16 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
     int getServerPort();
     int getServerID();
     bool isServerLocalMode() const { return m_srvLocalMode; }
+    // True, if the last connect took over the plugins of the previous session, so they don't need to be loaded again
+    bool isSessionResumed() const { return m_sessionResumed; }
     int getChannelsIn() const { return m_channelsIn; }
     int getChannelsOut() const { return m_channelsOut; }
     int getNumActiveChannels() const;
     double getSampleRate() const { return m_rate; }
     int getSamplesPerBlock() const { return m_samplesPerBlock; }
-    int getLatencySamples() const { return m_latency + NUM_OF_BUFFERS * m_samplesPerBlock; }
+    int getLatencySamples() const { return m_latency + getNumOfBuffersActive() * m_samplesPerBlock; }
+    int getNumOfBuffersActive() const { return ADAPTIVE_BUFFERS ? m_numOfBuffersActive.load() : NUM_OF_BUFFERS.load(); }
+    void setNumOfBuffersActive(int n) { m_numOfBuffersActive = n; }
     double isUsingDoublePrecission() const { return m_doublePrecission; }
 
     void setLatency(int i) { m_latency = i; }
@@ -183,6 +189,20 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
 
     bool addPlugin(String id, StringArray& presets, Array<Parameter>& params, bool& hasEditor, bool& scDisabled,
                    String settings, String& err);
+
+    struct ChainPlugin {
+        String id;
+        String settings;
+        bool ok = false;
+        String err;
+        StringArray presets;
+        Array<Parameter> params;
+        bool hasEditor = false;
+    };
+
+    // Loads all plugins with a single request, the server can load them in parallel. Requires canLoadChain().
+    bool loadChain(std::vector<ChainPlugin>& plugins, bool& scDisabled, String& err);
+    bool canLoadChain() const { return m_srvLoadChain; }
     void delPlugin(int idx);
     void editPlugin(int idx, int x, int y);
     void hidePlugin();
@@ -191,6 +211,7 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
     void bypassPlugin(int idx);
     void unbypassPlugin(int idx);
     void exchangePlugins(int idxA, int idxB);
+    void setPluginBranch(int idx, int branch);
     Array<ServerPlugin> getRecents();
     void setPreset(int idx, int preset);
 
@@ -214,6 +235,34 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
     void updateCPULoad();
     float getCPULoad() const { return m_srvLoad; }
 
+    // DSP load of a plugin in percent of the block period
+    struct DSPLoad {
+        String name;
+        float load;
+        float peak;
+    };
+
+    void updateDSPLoad();
+    std::vector<DSPLoad> getDSPLoad();
+
+    // The plugin with the highest average load over all instances
+    static DSPLoad getMaxDSPLoad();
+
+    // Blocks, that missed their deadline on the server, the chain is considered unstable for XRUN_WARNING_SECONDS
+    // after a miss
+    struct Xruns {
+        uint64 count = 0;
+        float budget = 0.0f;
+        float maxOverrun = 0.0f;
+        String plugin;
+        bool unstable = false;
+    };
+
+    static constexpr int XRUN_WARNING_SECONDS = 10;
+
+    void updateXruns();
+    Xruns getXruns();
+
     // MouseListener
     void mouseMove(const MouseEvent& event) override;
     void mouseEnter(const MouseEvent& event) override;
@@ -248,6 +297,22 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
     float m_srvLoad = 0.0f;
     int m_srvLoadLastUpdated = 0;
     bool m_srvLocalMode = false;
+    bool m_srvPluginDSPLoad = false;
+    bool m_srvXrunReporting = false;
+    bool m_srvLoadChain = false;
+    uint32 m_sessionToken = 0;
+    String m_sessionServer;
+    bool m_sessionResumed = false;
+    Xruns m_xruns;
+    uint32 m_lastXrun = 0;
+    std::mutex m_xrunsMtx;
+    std::vector<DSPLoad> m_dspLoad;
+    std::mutex m_dspLoadMtx;
+    static std::unordered_map<Client*, DSPLoad> m_maxDSPLoad;
+    static std::mutex m_maxDSPLoadMtx;
+    bool m_sharedMemoryAudioFailed = false;
+    bool m_udpAudioFailed = false;
+    std::atomic_int m_numOfBuffersActive{Defaults::DEFAULT_NUM_OF_BUFFERS};
     bool m_needsReconnect = false;
     double m_rate = 0;
     bool m_doublePrecission = false;
@@ -270,6 +335,7 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
         INIT2,
         CLOSE,
         ADDPLUGIN,
+        LOADCHAIN,
         DELPLUGIN,
         EDITPLUGIN,
         HIDEPLUGIN,
@@ -278,6 +344,7 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
         BYPASSPLUGIN,
         UNBYPASSPLUGIN,
         EXCHANGEPLUGINS,
+        SETPLUGINBRANCH,
         GETRECENTS,
         SETPRESET,
         GETPARAMETERVALUE,
@@ -290,6 +357,8 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
         RESTART,
         UPDATECPULOAD1,
         UPDATECPULOAD2,
+        UPDATEDSPLOAD,
+        UPDATEXRUNS,
         GETLOADEDPLUGINSSTRING,
         UPDATEPLUGINLIST
     };
@@ -388,6 +457,9 @@ class Client : public Thread, public LogTag, public MouseListener, public KeyLis
     void quit();
     void init();
 
+    // Replaces the parameters by the ones received from the server, keeping the automation slots
+    static void updateParameters(Array<Parameter>& params, const json& jparams);
+
     StreamingSocket* accept(StreamingSocket& sock) const;
 
     std::mutex m_audioMtx;
@@ -6,6 +6,7 @@
  */
 
 #include "PluginButton.hpp"
+#include "Defaults.hpp"
 
 using namespace e47;
 
@@ -101,9 +102,34 @@ void PluginButton::paintButton(Graphics& g, bool shouldDrawButtonAsHighlighted,
         g.drawLine(rect.getX(), rect.getBottom(), rect.getRight(), rect.getY(), symLineThikness);
     }
 
+    if (m_load > 0.0f) {
+        uint32 col;
+        if (m_load < 50.0f) {
+            col = Defaults::CPU_LOW_COLOR;
+        } else if (m_load < 90.0f) {
+            col = Defaults::CPU_MEDIUM_COLOR;
+        } else {
+            col = Defaults::CPU_HIGH_COLOR;
+        }
+        g.setColour(Colour(col).withAlpha(0.6f));
+        g.fillRect(0.0f, (float)getHeight() - 2.0f, (float)getWidth() * jmin(m_load, 100.0f) / 100.0f, 2.0f);
+    }
+
     drawText(g, textIndentLeft, textIndentRight);
 }
 
+void PluginButton::setLoad(float load, float peak) {
+    if (load != m_load) {
+        m_load = load;
+        repaint();
+    }
+    if (load > 0.0f || peak > 0.0f) {
+        setTooltip("DSP load: " + String(load, 1) + "% (peak " + String(peak, 1) + "%)");
+    } else {
+        setTooltip("");
+    }
+}
+
 void PluginButton::clicked(const ModifierKeys& modifiers) {
     auto area = getAreaType();
     if (m_listener != nullptr && (m_enabled || area == PluginButton::DELETE)) {
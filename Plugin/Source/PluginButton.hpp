@@ -39,6 +39,9 @@ class PluginButton : public TextButton {
         m_enabled = b;
         repaint();
     }
+
+    // DSP load of the plugin on the server in percent of the block period
+    void setLoad(float load, float peak);
     bool isEnabled() const { return m_enabled; }
 
   protected:
@@ -53,6 +56,7 @@ class PluginButton : public TextButton {
     Listener* m_listener = nullptr;
     bool m_active = false;
     bool m_enabled = true;
+    float m_load = 0.0f;
     String m_id;
     bool m_withExtraButtons = true;
     Rectangle<int> m_bypassArea, m_moveUpArea, m_moveDownArea, m_deleteArea;
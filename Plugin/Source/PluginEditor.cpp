@@ -414,6 +414,14 @@ void AudioGridderAudioProcessorEditor::buttonClicked(Button* button, const Modif
                 preset++;
             }
             m.addSubMenu("Presets", presets);
+            PopupMenu branches;
+            int currentBranch = m_processor.getPluginBranch(idx);
+            branches.addItem("Serial", true, currentBranch == 0, [this, idx] { m_processor.setPluginBranch(idx, 0); });
+            for (int b = 1; b <= 8; b++) {
+                branches.addItem("Parallel Branch " + String(b), true, currentBranch == b,
+                                 [this, idx, b] { m_processor.setPluginBranch(idx, b); });
+            }
+            m.addSubMenu("Processing", branches);
             m.addSeparator();
             PopupMenu params;
             params.addItem("Assign all", [this, idx] {
@@ -597,10 +605,13 @@ void AudioGridderAudioProcessorEditor::setConnected(bool connected) {
 
 void AudioGridderAudioProcessorEditor::setCPULoad(float load) {
     traceScope();
-    m_cpuLabel.setText(String(lround(load)) + "%", NotificationType::dontSendNotification);
+    bool unstable = m_connected && m_unstable;
+    m_cpuLabel.setText(String(lround(load)) + (unstable ? "% !" : "%"), NotificationType::dontSendNotification);
     uint32 col;
     if (!m_connected) {
         col = Colours::white.getARGB();
+    } else if (unstable) {
+        col = Defaults::CPU_HIGH_COLOR;
     } else if (load < 50.0f) {
         col = Defaults::CPU_LOW_COLOR;
     } else if (load < 90.0f) {
@@ -611,6 +622,32 @@ void AudioGridderAudioProcessorEditor::setCPULoad(float load) {
     m_cpuLabel.setColour(Label::textColourId, Colour(col));
 }
 
+void AudioGridderAudioProcessorEditor::setDSPLoad(const std::vector<Client::DSPLoad>& load) {
+    traceScope();
+    for (size_t i = 0; i < m_pluginButtons.size(); i++) {
+        if (i < load.size() && m_connected) {
+            m_pluginButtons[i]->setLoad(load[i].load, load[i].peak);
+        } else {
+            m_pluginButtons[i]->setLoad(0.0f, 0.0f);
+        }
+    }
+}
+
+void AudioGridderAudioProcessorEditor::setXruns(const Client::Xruns& xruns) {
+    traceScope();
+    m_unstable = xruns.unstable;
+    String tooltip;
+    if (xruns.count > 0) {
+        tooltip << String(xruns.count) << " block(s) missed the deadline of " << String(xruns.budget, 1)
+                << "ms on the server, max overrun " << String(xruns.maxOverrun, 1) << "ms";
+        if (xruns.plugin.isNotEmpty()) {
+            tooltip << ", slowest plugin: " << xruns.plugin;
+        }
+    }
+    m_cpuLabel.setTooltip(tooltip);
+    setCPULoad(m_processor.getClient().getCPULoad());
+}
+
 void AudioGridderAudioProcessorEditor::mouseUp(const MouseEvent& event) {
     traceScope();
     if (event.eventComponent == &m_srvIcon) {
@@ -668,6 +705,12 @@ void AudioGridderAudioProcessorEditor::mouseUp(const MouseEvent& event) {
             traceScope();
             m_processor.saveConfig(30);
         });
+        bufMenu.addSeparator();
+        bufMenu.addItem("Adaptive (up to the selected size)", true, m_processor.getClient().ADAPTIVE_BUFFERS, [this] {
+            traceScope();
+            m_processor.getClient().ADAPTIVE_BUFFERS = !m_processor.getClient().ADAPTIVE_BUFFERS;
+            m_processor.saveConfig();
+        });
         m.addSubMenu("Buffer Size", bufMenu);
         m.addSectionHeader("Servers");
         auto& servers = m_processor.getServers();
@@ -988,6 +1031,31 @@ void AudioGridderAudioProcessorEditor::mouseUp(const MouseEvent& event) {
             m_processor.setTransferWhenPlayingOnly(true);
             m_processor.saveConfig();
         });
+        subm.addSeparator();
+        for (uint8 fmt = 0; fmt < AudioWireFormat::NUM_OF_FORMATS; fmt++) {
+            subm.addItem("Sample Format: " + AudioWireFormat::toString(fmt), true,
+                         m_processor.getAudioWireFormat() == fmt, [this, fmt] {
+                             traceScope();
+                             m_processor.setAudioWireFormat(fmt);
+                             m_processor.saveConfig();
+                             m_processor.getClient().reconnect();
+                         });
+        }
+        subm.addSeparator();
+        // compression is not used with a reduced sample format
+        subm.addItem("Compress Audio", m_processor.getAudioWireFormat() == AudioWireFormat::NATIVE,
+                     m_processor.getAudioCompression(), [this] {
+                         traceScope();
+                         m_processor.setAudioCompression(!m_processor.getAudioCompression());
+                         m_processor.saveConfig();
+                         m_processor.getClient().reconnect();
+                     });
+        subm.addItem("Use UDP", true, m_processor.getUdpAudio(), [this] {
+            traceScope();
+            m_processor.setUdpAudio(!m_processor.getUdpAudio());
+            m_processor.saveConfig();
+            m_processor.getClient().reconnect();
+        });
         m.addSubMenu("Transfer Audio/MIDI", subm);
         subm.clear();
 
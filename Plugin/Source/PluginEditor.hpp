@@ -34,6 +34,8 @@ class AudioGridderAudioProcessorEditor : public AudioProcessorEditor,
 
     void setConnected(bool connected);
     void setCPULoad(float load);
+    void setDSPLoad(const std::vector<Client::DSPLoad>& load);
+    void setXruns(const Client::Xruns& xruns);
 
     void updateParamValue(int paramIdx);
 
@@ -58,6 +60,7 @@ class AudioGridderAudioProcessorEditor : public AudioProcessorEditor,
     Label m_srvLabel, m_versionLabel, m_cpuLabel;
     ImageComponent m_logo;
     bool m_connected = false;
+    bool m_unstable = false;
 
     struct ToolsButton : TextButton {
         void paintButton(Graphics& g, bool shouldDrawButtonAsHighlighted, bool shouldDrawButtonAsDown) override;
@@ -102,22 +102,65 @@ AudioGridderAudioProcessor::AudioGridderAudioProcessor(AudioProcessor::WrapperTy
         bool updLatency = false;
         std::vector<std::tuple<int, int, int>> automationParams;
         int idx = 0;
+        // a resumed session still has all plugins loaded, only the state, that could have changed while being
+        // disconnected, is sent again
+        bool resumed = m_client->isSessionResumed();
         {
             std::lock_guard<std::mutex> lock(m_loadedPluginsSyncMtx);
-            for (auto& p : m_loadedPlugins) {
-                logln("loading " << p.name << " (" << p.id << ") [on connect]... ");
+            // load all plugins with a single request, if the server supports it
+            bool batched = !resumed && m_client->canLoadChain() && m_loadedPlugins.size() > 1;
+            if (batched) {
+                logln("loading " << m_loadedPlugins.size() << " plugins [on connect]...");
+                std::vector<Client::ChainPlugin> chain;
+                for (auto& p : m_loadedPlugins) {
+                    Client::ChainPlugin cp;
+                    cp.id = p.id;
+                    cp.settings = p.settings;
+                    cp.params = p.params;
+                    chain.push_back(std::move(cp));
+                }
                 String err;
                 bool scDisabled;
-                p.ok = m_client->addPlugin(p.id, p.presets, p.params, p.hasEditor, scDisabled, p.settings, err);
-                if (p.ok) {
-                    logln("...ok");
-                } else {
+                bool success = m_client->loadChain(chain, scDisabled, err);
+                if (!success) {
                     logln("...failed: " << err);
                 }
+                for (size_t i = 0; i < m_loadedPlugins.size(); i++) {
+                    auto& p = m_loadedPlugins[i];
+                    auto& cp = chain[i];
+                    p.ok = success && cp.ok;
+                    if (p.ok) {
+                        p.presets = cp.presets;
+                        p.params = cp.params;
+                        p.hasEditor = cp.hasEditor;
+                        logln("..." << p.name << " ok");
+                    } else if (success) {
+                        logln("..." << p.name << " failed: " << cp.err);
+                    }
+                }
+            }
+            for (auto& p : m_loadedPlugins) {
+                // a resumed chain has the plugins, that were loaded before, as covered by the fingerprint
+                if (!resumed && !batched) {
+                    logln("loading " << p.name << " (" << p.id << ") [on connect]... ");
+                    String err;
+                    bool scDisabled;
+                    p.ok = m_client->addPlugin(p.id, p.presets, p.params, p.hasEditor, scDisabled, p.settings, err);
+                    if (p.ok) {
+                        logln("...ok");
+                    } else {
+                        logln("...failed: " << err);
+                    }
+                }
                 if (p.ok) {
                     updLatency = true;
                     if (p.bypassed) {
                         m_client->bypassPlugin(idx);
+                    } else if (resumed) {
+                        m_client->unbypassPlugin(idx);
+                    }
+                    if (p.branch > 0 || resumed) {
+                        m_client->setPluginBranch(idx, p.branch);
                     }
                     for (auto& param : p.params) {
                         if (param.automationSlot > -1) {
@@ -227,6 +270,7 @@ void AudioGridderAudioProcessor::loadConfig(const json& j, bool isUpdate) {
         m_activeServerFromCfg = jsonGetValue(j, "LastServer", m_activeServerFromCfg);
         m_activeServerLegacyFromCfg = jsonGetValue(j, "Last", m_activeServerLegacyFromCfg);
         m_client->NUM_OF_BUFFERS = jsonGetValue(j, "NumberOfBuffers", m_client->NUM_OF_BUFFERS.load());
+        m_client->ADAPTIVE_BUFFERS = jsonGetValue(j, "AdaptiveBuffers", m_client->ADAPTIVE_BUFFERS.load());
         m_client->LOAD_PLUGIN_TIMEOUT = jsonGetValue(j, "LoadPluginTimeoutMS", m_client->LOAD_PLUGIN_TIMEOUT.load());
 
         if (m_scale != Desktop::getInstance().getGlobalScaleFactor()) {
@@ -249,6 +293,24 @@ void AudioGridderAudioProcessor::loadConfig(const json& j, bool isUpdate) {
         m_noSrvPluginListFilter = noSrvPluginListFilter;
         m_client->reconnect();
     }
+    auto audioCompression = jsonGetValue(j, "AudioCompression", m_audioCompression);
+    if (audioCompression != m_audioCompression) {
+        m_audioCompression = audioCompression;
+        m_client->reconnect();
+    }
+    auto udpAudio = jsonGetValue(j, "UdpAudio", m_udpAudio);
+    if (udpAudio != m_udpAudio) {
+        m_udpAudio = udpAudio;
+        m_client->reconnect();
+    }
+    auto audioWireFormat = jsonGetValue(j, "AudioWireFormat", m_audioWireFormat);
+    if (!AudioWireFormat::isValid(audioWireFormat)) {
+        audioWireFormat = AudioWireFormat::NATIVE;
+    }
+    if (audioWireFormat != m_audioWireFormat) {
+        m_audioWireFormat = audioWireFormat;
+        m_client->reconnect();
+    }
     m_crashReporting = jsonGetValue(j, "CrashReporting", m_crashReporting);
     m_showSidechainDisabledInfo = jsonGetValue(j, "ShowSidechainDisabledInfo", m_showSidechainDisabledInfo);
     m_disableTray = jsonGetValue(j, "DisableTray", m_disableTray);
@@ -272,6 +334,7 @@ void AudioGridderAudioProcessor::saveConfig(int numOfBuffers) {
     jcfg["Servers"] = jservers;
     jcfg["LastServer"] = m_client->getServerHostAndID().toStdString();
     jcfg["NumberOfBuffers"] = numOfBuffers;
+    jcfg["AdaptiveBuffers"] = m_client->ADAPTIVE_BUFFERS.load();
     jcfg["NumberOfAutomationSlots"] = m_numberOfAutomationSlots;
     jcfg["LoadPluginTimeoutMS"] = m_client->LOAD_PLUGIN_TIMEOUT.load();
     jcfg["MenuShowCategory"] = m_menuShowCategory;
@@ -283,6 +346,9 @@ void AudioGridderAudioProcessor::saveConfig(int numOfBuffers) {
     jcfg["Logger"] = AGLogger::isEnabled();
     jcfg["SyncRemoteMode"] = m_syncRemote;
     jcfg["NoSrvPluginListFilter"] = m_noSrvPluginListFilter;
+    jcfg["AudioCompression"] = m_audioCompression;
+    jcfg["AudioWireFormat"] = m_audioWireFormat;
+    jcfg["UdpAudio"] = m_udpAudio;
     jcfg["ZoomFactor"] = m_scale;
     jcfg["PresetsDir"] = m_presetsDir.toStdString();
     jcfg["DefaultPreset"] = m_defaultPreset.toStdString();
@@ -420,6 +486,15 @@ void AudioGridderAudioProcessor::prepareToPlay(double sampleRate, int samplesPer
     m_activeChannels.setNumChannels(channelsIn + channelsSC, channelsOut);
     updateChannelMapping();
 
+    // allocate for all channels, so that changing the active channels does not allocate on the audio thread
+    if (isUsingDoublePrecision()) {
+        m_sendBufferD.setSize(Defaults::PLUGIN_CHANNELS_MAX, samplesPerBlock);
+        m_sendBufferF.setSize(0, 0);
+    } else {
+        m_sendBufferF.setSize(Defaults::PLUGIN_CHANNELS_MAX, samplesPerBlock);
+        m_sendBufferD.setSize(0, 0);
+    }
+
     m_client->init(channelsIn, channelsOut, channelsSC, sampleRate, samplesPerBlock, isUsingDoublePrecision());
 
     m_prepared = true;
@@ -494,9 +569,11 @@ void AudioGridderAudioProcessor::processBlockReal(AudioBuffer<T>& buffer, MidiBu
 
     // buffer to be send
     int sendBufChannels = m_activeChannels.getNumActiveChannelsCombined();
-    AudioBuffer<T>* sendBuffer = sendBufChannels != buffer.getNumChannels()
-                                     ? new AudioBuffer<T>(sendBufChannels, buffer.getNumSamples())
-                                     : &buffer;
+    AudioBuffer<T>* sendBuffer = &buffer;
+    if (sendBufChannels != buffer.getNumChannels()) {
+        sendBuffer = &getSendBuffer(T());
+        sendBuffer->setSize(sendBufChannels, buffer.getNumSamples(), false, false, true);
+    }
 
 #if JucePlugin_IsSynth || JucePlugin_IsMidiEffect
     buffer.clear();
@@ -686,7 +763,7 @@ json AudioGridderAudioProcessor::getState(bool withServers) {
                 jparams.push_back(p.toJson());
             }
             jplugs.push_back({plug.id.toStdString(), plug.name.toStdString(), plug.settings.toStdString(), jpresets,
-                              jparams, plug.bypassed});
+                              jparams, plug.bypassed, plug.branch});
         }
     }
     j["loadedPlugins"] = jplugs;
@@ -755,6 +832,9 @@ bool AudioGridderAudioProcessor::setState(const json& j) {
                     m_loadedPlugins.push_back({plug[0].get<std::string>(), plug[1].get<std::string>(),
                                                plug[2].get<std::string>(), presets, params, plug[5].get<bool>(),
                                                false});
+                    if (plug.size() > 6) {
+                        m_loadedPlugins.back().branch = plug[6].get<int>();
+                    }
                 }
             }
         }
@@ -901,6 +981,19 @@ String AudioGridderAudioProcessor::getLoadedPluginsString() const {
     return ret;
 }
 
+int64 AudioGridderAudioProcessor::getLoadedPluginsFingerprint() const {
+    traceScope();
+    StringArray ids;
+    std::lock_guard<std::mutex> lock(m_loadedPluginsSyncMtx);
+    for (auto& p : m_loadedPlugins) {
+        // plugins, that failed to load, are not part of the chain on the server
+        if (p.ok) {
+            ids.add(p.id);
+        }
+    }
+    return ResumeRequest::getChainFingerprint(ids);
+}
+
 void AudioGridderAudioProcessor::editPlugin(int idx, int x, int y) {
     traceScope();
     logln("edit plugin " << idx << " x=" << x << " y=" << y);
@@ -969,6 +1062,33 @@ void AudioGridderAudioProcessor::unbypassPlugin(int idx) {
     }
 }
 
+int AudioGridderAudioProcessor::getPluginBranch(int idx) {
+    traceScope();
+    std::lock_guard<std::mutex> lock(m_loadedPluginsSyncMtx);
+    if (idx > -1 && idx < (int)m_loadedPlugins.size()) {
+        return m_loadedPlugins[(size_t)idx].branch;
+    }
+    return 0;
+}
+
+void AudioGridderAudioProcessor::setPluginBranch(int idx, int branch) {
+    traceScope();
+    bool updateServer = false;
+    {
+        std::lock_guard<std::mutex> lock(m_loadedPluginsSyncMtx);
+        if (idx > -1 && idx < (int)m_loadedPlugins.size()) {
+            logln("setting branch of plugin " << idx << " to " << branch);
+            m_loadedPlugins[(size_t)idx].branch = branch;
+            updateServer = true;
+        } else {
+            logln("failed to set branch of plugin " << idx << ": out of range");
+        }
+    }
+    if (updateServer) {
+        m_client->setPluginBranch(idx, branch);
+    }
+}
+
 void AudioGridderAudioProcessor::exchangePlugins(int idxA, int idxB) {
     traceScope();
     bool idxOk = false;
@@ -1284,6 +1404,28 @@ void AudioGridderAudioProcessor::setCPULoad(float load) {
     });
 }
 
+void AudioGridderAudioProcessor::updateDSPLoad() {
+    traceScope();
+    runOnMsgThreadAsync([this] {
+        traceScope();
+        auto* editor = getActiveEditor();
+        if (editor != nullptr) {
+            dynamic_cast<AudioGridderAudioProcessorEditor*>(editor)->setDSPLoad(m_client->getDSPLoad());
+        }
+    });
+}
+
+void AudioGridderAudioProcessor::updateXruns() {
+    traceScope();
+    runOnMsgThreadAsync([this] {
+        traceScope();
+        auto* editor = getActiveEditor();
+        if (editor != nullptr) {
+            dynamic_cast<AudioGridderAudioProcessorEditor*>(editor)->setXruns(m_client->getXruns());
+        }
+    });
+}
+
 float AudioGridderAudioProcessor::Parameter::getValue() const {
     traceScope();
     if (m_idx > -1 && m_paramIdx > -1) {
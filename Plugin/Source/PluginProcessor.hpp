@@ -126,6 +126,7 @@ class AudioGridderAudioProcessor : public AudioProcessor,
         bool bypassed = false;
         bool hasEditor = true;
         bool ok = false;
+        int branch = 0;
     };
 
     // Called by the client object to trigger resyncing the remote plugin settings
@@ -154,6 +155,7 @@ class AudioGridderAudioProcessor : public AudioProcessor,
     bool loadPlugin(const ServerPlugin& plugin, String& err);
     void unloadPlugin(int idx);
     String getLoadedPluginsString() const;
+    int64 getLoadedPluginsFingerprint() const;
     void editPlugin(int idx, int x, int y);
     void hidePlugin(bool updateServer = true);
     int getActivePlugin() const { return m_activePlugin; }
@@ -164,6 +166,10 @@ class AudioGridderAudioProcessor : public AudioProcessor,
     void bypassPlugin(int idx);
     void unbypassPlugin(int idx);
     void exchangePlugins(int idxA, int idxB);
+    // Plugins with the same branch > 0 run in parallel to the other branches of their section, see
+    // ProcessorChain::setBranch on the server
+    int getPluginBranch(int idx);
+    void setPluginBranch(int idx, int branch);
     bool enableParamAutomation(int idx, int paramIdx, int slot = -1);
     void disableParamAutomation(int idx, int paramIdx);
     void getAllParameterValues(int idx);
@@ -191,6 +197,12 @@ class AudioGridderAudioProcessor : public AudioProcessor,
     void setShowSidechainDisabledInfo(bool b) { m_showSidechainDisabledInfo = b; }
     bool getNoSrvPluginListFilter() const { return m_noSrvPluginListFilter; }
     void setNoSrvPluginListFilter(bool b) { m_noSrvPluginListFilter = b; }
+    bool getAudioCompression() const { return m_audioCompression; }
+    void setAudioCompression(bool b) { m_audioCompression = b; }
+    uint8 getAudioWireFormat() const { return m_audioWireFormat; }
+    void setAudioWireFormat(uint8 fmt) { m_audioWireFormat = fmt; }
+    bool getUdpAudio() const { return m_udpAudio; }
+    void setUdpAudio(bool b) { m_udpAudio = b; }
     float getScaleFactor() const { return m_scale; }
     void setScaleFactor(float f) { m_scale = f; }
     bool getCrashReporting() const { return m_crashReporting; }
@@ -207,9 +219,11 @@ class AudioGridderAudioProcessor : public AudioProcessor,
     void setActiveServer(const ServerInfo& s);
     Array<ServerInfo> getServersMDNS();
     void setCPULoad(float load);
+    void updateDSPLoad();
+    void updateXruns();
 
     int getLatencyMillis() const {
-        return (int)lround(m_client->NUM_OF_BUFFERS * getBlockSize() * 1000 / getSampleRate());
+        return (int)lround(m_client->getNumOfBuffersActive() * getBlockSize() * 1000 / getSampleRate());
     }
 
     void showMonitor() { m_tray->showMonitor(); }
@@ -331,6 +345,13 @@ class AudioGridderAudioProcessor : public AudioProcessor,
     AudioRingBuffer<double> m_bypassBufferD;
     std::mutex m_bypassBufferMtx;
 
+    // buffers for sending the active channels, if they differ from the bus layout
+    AudioBuffer<float> m_sendBufferF;
+    AudioBuffer<double> m_sendBufferD;
+
+    AudioBuffer<float>& getSendBuffer(float) { return m_sendBufferF; }
+    AudioBuffer<double>& getSendBuffer(double) { return m_sendBufferD; }
+
     String m_settingsA, m_settingsB;
 
     bool m_menuShowCategory = true;
@@ -339,6 +360,9 @@ class AudioGridderAudioProcessor : public AudioProcessor,
     bool m_confirmDelete = true;
     bool m_showSidechainDisabledInfo = true;
     bool m_noSrvPluginListFilter = false;
+    bool m_audioCompression = false;
+    uint8 m_audioWireFormat = AudioWireFormat::NATIVE;
+    bool m_udpAudio = false;
     float m_scale = 1.0;
     bool m_crashReporting = true;
 
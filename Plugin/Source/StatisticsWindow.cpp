@@ -111,6 +111,18 @@ StatisticsWindow::StatisticsWindow()
 
     row++;
 
+    addLabel("Highest plugin DSP load (average/peak):", getLabelBounds(row, 15));
+    m_maxDSPLoad.setBounds(getFieldBounds(row));
+    m_maxDSPLoad.setJustificationType(Justification::right);
+    addChildAndSetID(&m_maxDSPLoad, "maxdspload");
+
+    row++;
+
+    m_maxDSPLoadName.setBounds(getLabelBounds(row, 30));
+    addChildAndSetID(&m_maxDSPLoadName, "maxdsploadname");
+
+    row++;
+
     line = std::make_unique<HirozontalLine>(getLineBounds(row++));
     addChildAndSetID(line.get(), "line");
     m_components.push_back(std::move(line));
@@ -146,6 +158,10 @@ StatisticsWindow::StatisticsWindow()
         m_audioPTavg.setText(String(hist.avg, 2) + " ms", NotificationType::dontSendNotification);
         m_audioPTmin.setText(String(hist.min, 2) + " ms", NotificationType::dontSendNotification);
         m_audioPTmax.setText(String(hist.max, 2) + " ms", NotificationType::dontSendNotification);
+        auto maxLoad = Client::getMaxDSPLoad();
+        m_maxDSPLoad.setText(String(lround(maxLoad.load)) + "% / " + String(lround(maxLoad.peak)) + "%",
+                             NotificationType::dontSendNotification);
+        m_maxDSPLoadName.setText(maxLoad.name, NotificationType::dontSendNotification);
 
         auto netOut = bytesOutMeter->rate_1min();
         auto netIn = bytesInMeter->rate_1min();
@@ -38,7 +38,7 @@ class StatisticsWindow : public DocumentWindow, public LogTag {
   private:
     std::vector<std::unique_ptr<Component>> m_components;
     Label m_totalClients, m_audioRPS, m_audioPTavg, m_audioPTmin, m_audioPTmax, m_audioPT95th, m_audioBytesOut,
-        m_audioBytesIn;
+        m_audioBytesIn, m_maxDSPLoad, m_maxDSPLoadName;
 
     static std::unique_ptr<StatisticsWindow> m_inst;
 
@@ -191,6 +191,9 @@ void App::initialise(const String& commandLineParameters) {
 
 void App::prepareShutdown(uint32 exitCode) {
     traceScope();
+    if (m_shutdownPrepared.exchange(true)) {
+        return;
+    }
     logln("preparing shutdown");
 
     m_exitCode = exitCode;
@@ -51,7 +51,8 @@ class App : public JUCEApplication, public MenuBarModel, public LogTag {
     const String getApplicationVersion() override { return ProjectInfo::versionString; }
     void initialise(const String& commandLineParameters) override;
     void shutdown() override;
-    void systemRequestedQuit() override { quit(); }
+    // the server has to be shut down, while the message loop is still running
+    void systemRequestedQuit() override { prepareShutdown(); }
 
     void prepareShutdown(uint32 exitCode = 0);
 
@@ -428,6 +429,7 @@ class App : public JUCEApplication, public MenuBarModel, public LogTag {
     std::atomic_bool m_stopChild{false};
 
     uint32 m_exitCode = 0;
+    std::atomic_bool m_shutdownPrepared{false};
 
     ENABLE_ASYNC_FUNCTORS();
 };
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#include "AudioScheduler.hpp"
+#include "CPUInfo.hpp"
+
+#include <thread>
+
+namespace e47 {
+
+AudioScheduler::AudioScheduler() : LogTag("scheduler"), m_jobs(SPIN_MICROSECONDS) {}
+
+AudioScheduler::~AudioScheduler() {
+    traceScope();
+    stop();
+    logln("audio scheduler stopped");
+}
+
+void AudioScheduler::start(int numThreads) {
+    traceScope();
+    if (numThreads <= 0) {
+        numThreads = SystemStats::getNumCpus();
+    }
+    for (int i = 0; i < numThreads; i++) {
+        m_threads.push_back(std::make_unique<PoolThread>(*this, i));
+    }
+    for (auto& t : m_threads) {
+        t->startThread(Thread::realtimeAudioPriority);
+    }
+    logln("audio scheduler started with " << numThreads << " thread(s)");
+}
+
+void AudioScheduler::stop() {
+    traceScope();
+    if (m_stopped.exchange(true)) {
+        return;
+    }
+    // jobs, that are being queued right now, have to be in the queues before draining them
+    while (m_enqueuing > 0) {
+        std::this_thread::yield();
+    }
+    for (auto& t : m_threads) {
+        t->signalThreadShouldExit();
+    }
+    for (auto& t : m_threads) {
+        t->waitForThreadToExit(-1);
+    }
+    // waiting threads get their jobs done
+    int drained = 0;
+    while (m_jobs.tryWait()) {
+        runEntry(take(0), -1);
+        drained++;
+    }
+    if (drained > 0) {
+        logln(drained << " queued job(s) processed after stopping the pool");
+    }
+}
+
+namespace {
+thread_local int t_poolThreadIdx = -1;
+}
+
+bool AudioScheduler::enqueue(Job& job) {
+    traceScope();
+    if (m_threads.empty()) {
+        return false;
+    }
+    m_enqueuing++;
+    if (m_stopped) {
+        m_enqueuing--;
+        return false;
+    }
+    int idx = job.client->m_lastThread;
+    if (idx < 0) {
+        // spread new clients over the pool
+        idx = (int)(m_nextThread++ % m_threads.size());
+    }
+    auto& t = m_threads[(size_t)idx];
+    if (nullptr != job.entries) {
+        job.entries->fetch_add(1);
+    }
+    job.queued = true;
+    if (!t->queue.bounded_push(&job)) {
+        m_enqueuing--;
+        logln("error: queue of thread " << idx << " is full");
+        if (nullptr != job.entries) {
+            job.entries->fetch_sub(1);
+        }
+        // a skipped entry of the job, that is still in a queue, might have taken it already
+        return !job.queued.exchange(false);
+    }
+    t->queueDepth->add(1);
+    m_jobs.post();
+    m_enqueuing--;
+    return true;
+}
+
+void AudioScheduler::wait(Semaphore& done, int num, Job* const* jobs, size_t numJobs) {
+    traceScope();
+    // jobs of the fan-out, that no pool thread has taken yet, are processed right away
+    for (size_t i = 0; i < numJobs; i++) {
+        if (jobs[i]->queued.exchange(false)) {
+            run(jobs[i], t_poolThreadIdx);
+        }
+    }
+    while (num > 0) {
+        if (done.wait(1000)) {
+            num--;
+        } else {
+            logln("warning: job not processed within 1s, still waiting");
+        }
+    }
+}
+
+AudioScheduler::Job* AudioScheduler::take(int idx) {
+    // every successful wait on m_jobs stands for one queue entry, so this finds one eventually
+    size_t num = m_threads.size();
+    Job* job = nullptr;
+    for (size_t i = 0; nullptr == job; i++) {
+        auto& t = m_threads[((size_t)idx + i) % num];
+        if (t->queue.pop(job)) {
+            t->queueDepth->add(-1);
+        }
+    }
+    return job;
+}
+
+AudioScheduler::PoolThread::PoolThread(AudioScheduler& scheduler, int idx)
+    : Thread("AudioScheduler" + String(idx)), m_scheduler(scheduler), m_idx(idx) {
+    queueDepth = Metrics::getStatistic<Gauge>("AudioScheduler" + String(idx) + ".queue");
+    deadlineMisses = Metrics::getStatistic<Gauge>("AudioScheduler" + String(idx) + ".misses");
+    if (idx < 32) {
+        setAffinityMask((uint32)1 << idx);
+    }
+}
+
+void AudioScheduler::runEntry(Job* job, int idx) {
+    auto* entries = job->entries;
+    bool taken = job->queued.exchange(false);
+    if (nullptr != entries) {
+        // a job, that is not taken here, can be gone after this
+        entries->fetch_sub(1);
+    }
+    if (taken) {
+        run(job, idx);
+    }
+}
+
+void AudioScheduler::run(Job* job, int idx) {
+    // the job can be queued again or go away as soon as fn returns, so it must not be touched afterwards
+    auto* done = job->done;
+    auto deadline = job->deadline;
+    if (idx > -1) {
+        job->client->m_lastThread = idx;
+    }
+    job->fn(job->arg);
+    if (idx > -1 && Time::getHighResolutionTicks() > deadline) {
+        m_threads[(size_t)idx]->deadlineMisses->add(1);
+    }
+    done->post();
+}
+
+void AudioScheduler::PoolThread::run() {
+    t_poolThreadIdx = m_idx;
+    CPUInfo::registerThread(getThreadName());
+    while (!currentThreadShouldExit()) {
+        if (m_scheduler.m_jobs.wait(100)) {
+            m_scheduler.runEntry(m_scheduler.take(m_idx), m_idx);
+        }
+    }
+    CPUInfo::unregisterThread();
+}
+
+}  // namespace e47
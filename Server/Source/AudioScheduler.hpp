@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef AudioScheduler_hpp
+#define AudioScheduler_hpp
+
+#include <JuceHeader.h>
+#include <boost/lockfree/queue.hpp>
+
+#include "SharedInstance.hpp"
+#include "Semaphore.hpp"
+#include "Metrics.hpp"
+#include "Utils.hpp"
+
+namespace e47 {
+
+/*
+ * A fixed pool of real-time threads, one per core by default. When enabled, it processes the audio blocks of all audio
+ * workers instead of one real-time thread per worker. The worker threads only read and send the blocks, and they hand
+ * the processing to the pool. The pool also runs the parallel branches and pipeline segments of the processor chains.
+ *
+ * Every pool thread has its own queue. A job is queued to the thread, that processed the previous job of the same
+ * client, and idle threads steal jobs from other queues.
+ */
+class AudioScheduler : public LogTag, public SharedInstance<AudioScheduler> {
+  public:
+    // Priority of the audio worker threads, when the scheduler is enabled
+    static constexpr int IO_THREAD_PRIORITY = 8;
+
+    AudioScheduler();
+    ~AudioScheduler() override;
+
+    // Starts the pool, numThreads <= 0 means one thread per core
+    void start(int numThreads);
+
+    // Stops the pool threads and processes the jobs, that are still queued, on the calling thread. Jobs can't be
+    // queued anymore afterwards, so callers process them on their own threads.
+    void stop();
+
+    static constexpr int SPIN_MICROSECONDS = 50;
+
+    // Jobs of the same client are preferably processed by the same thread
+    class Client {
+      public:
+        Client() : m_done(SPIN_MICROSECONDS) {}
+
+      private:
+        friend AudioScheduler;
+        Semaphore m_done;
+        std::atomic_int m_lastThread{-1};
+    };
+
+    struct Job {
+        Client* client = nullptr;
+        Semaphore* done = nullptr;
+        void (*fn)(void*) = nullptr;
+        void* arg = nullptr;
+        int64 deadline = 0;
+        // set while the job waits for a thread, the thread, that resets it, processes the job
+        std::atomic_bool queued{false};
+        // counts the queue entries of the job, that have not been taken yet, see wait(), it is set once when the job
+        // is created
+        std::atomic_int* entries = nullptr;
+    };
+
+    // Prepares a job, that calls fn. When processed, the job posts the given semaphore. The job should be done within
+    // deadlineMs, otherwise a deadline miss is counted for the thread, that processed it.
+    template <typename Fn>
+    static void prepareJob(Job& job, Client& client, Semaphore* done, double deadlineMs, Fn& fn) {
+        job.client = &client;
+        job.done = done;
+        job.fn = [](void* arg) { (*static_cast<Fn*>(arg))(); };
+        job.arg = &fn;
+        job.deadline = Time::getHighResolutionTicks() + Time::secondsToHighResolutionTicks(deadlineMs / 1000);
+    }
+
+    // Runs fn on a pool thread and waits for it to finish
+    template <typename Fn>
+    void process(Client& client, double deadlineMs, Fn& fn) {
+        Job job;
+        prepareJob(job, client, &client.m_done, deadlineMs, fn);
+        if (enqueue(job)) {
+            wait(client.m_done, 1);
+        } else {
+            fn();
+        }
+    }
+
+    // Queues a job without waiting for it, returns false if the job could not be queued. The job must stay valid
+    // until it is done.
+    bool enqueue(Job& job);
+
+    // Waits until the semaphore has been posted num times. Queued jobs of the same fan-out can be passed, the
+    // waiting thread processes the ones, that no pool thread has started yet, so waiting threads can't block the pool.
+    // A job processed this way leaves its entry in a queue, that a pool thread skips later. Such jobs need an entries
+    // counter and must stay valid until it dropped to 0.
+    void wait(Semaphore& done, int num, Job* const* jobs = nullptr, size_t numJobs = 0);
+
+  private:
+    static constexpr int QUEUE_SIZE = 1024;
+
+    class PoolThread : public Thread {
+      public:
+        PoolThread(AudioScheduler& scheduler, int idx);
+        void run() override;
+
+        boost::lockfree::queue<Job*, boost::lockfree::capacity<QUEUE_SIZE>> queue;
+        std::shared_ptr<Gauge> queueDepth, deadlineMisses;
+
+      private:
+        AudioScheduler& m_scheduler;
+        int m_idx;
+    };
+
+    std::vector<std::unique_ptr<PoolThread>> m_threads;
+    // counts the queue entries over all queues
+    Semaphore m_jobs;
+    std::atomic_uint m_nextThread{0};
+    std::atomic_bool m_stopped{false};
+    std::atomic_int m_enqueuing{0};
+
+    Job* take(int idx);
+    // Processes the job of a queue entry, unless it has been processed by the waiting thread already
+    void runEntry(Job* job, int idx);
+    void run(Job* job, int idx);
+};
+
+}  // namespace e47
+
+#endif /* AudioScheduler_hpp */
@@ -11,32 +11,56 @@
 #include "Defaults.hpp"
 #include "App.hpp"
 #include "Metrics.hpp"
+#include "CPUInfo.hpp"
+#include "PluginPool.hpp"
 
 namespace e47 {
 
 std::unordered_map<String, AudioWorker::RecentsListType> AudioWorker::m_recents;
 std::mutex AudioWorker::m_recentsMtx;
 
-AudioWorker::AudioWorker(LogTag* tag) : Thread("AudioWorker"), LogTagDelegate(tag), m_channelMapper(tag) {
+AudioWorker::AudioWorker(LogTag* tag)
+    : Thread("AudioWorker"),
+      LogTagDelegate(tag),
+      m_channelMapper(tag),
+      m_scheduler(getApp()->getServer()->isAudioSchedulerEnabled() ? AudioScheduler::getInstance() : nullptr) {
     initAsyncFunctors();
 }
 
 AudioWorker::~AudioWorker() {
     traceScope();
     stopAsyncFunctors();
+    if (nullptr != m_reactorReg) {
+        m_reactorReg->wakeUp();
+    }
+    if (nullptr != m_shm) {
+        m_shm->close();
+    }
+    if (nullptr != m_udp) {
+        m_udp->close();
+    }
     if (nullptr != m_socket && m_socket->isConnected()) {
         m_socket->close();
     }
     waitForThreadAndLog(getLogTagSource(), this);
 }
 
-void AudioWorker::init(std::unique_ptr<StreamingSocket> s, int channelsIn, int channelsOut, int channelsSC,
-                       uint64 activeChannels, double rate, int samplesPerBlock, bool doublePrecission) {
+void AudioWorker::init(std::unique_ptr<StreamingSocket> s, std::unique_ptr<SharedMemoryStream> shm,
+                       std::unique_ptr<DatagramStream> udp, int channelsIn, int channelsOut, int channelsSC,
+                       uint64 activeChannels, double rate, int samplesPerBlock, bool doublePrecission,
+                       bool compressedAudio, uint8 wireFormat) {
     traceScope();
     m_socket = std::move(s);
+    m_shm = std::move(shm);
+    m_udp = std::move(udp);
+    if (nullptr == m_shm && nullptr == m_udp) {
+        m_reactorReg = SocketReactor::add(m_socket.get());
+    }
     m_rate = rate;
     m_samplesPerBlock = samplesPerBlock;
     m_doublePrecission = doublePrecission;
+    m_compressedAudio = compressedAudio;
+    m_wireFormat = wireFormat;
     m_channelsIn = channelsIn;
     m_channelsOut = channelsOut;
     m_channelsSC = channelsSC;
@@ -45,93 +69,153 @@ void AudioWorker::init(std::unique_ptr<StreamingSocket> s, int channelsIn, int c
     m_activeChannels.setNumChannels(m_channelsIn + m_channelsSC, m_channelsOut);
     m_channelMapper.createMapping(m_activeChannels);
     m_channelMapper.print();
-    m_chain =
-        std::make_shared<ProcessorChain>(ProcessorChain::createBussesProperties(channelsIn, channelsOut, channelsSC));
+    if (nullptr == m_chain) {
+        m_chain = std::make_shared<ProcessorChain>(
+            ProcessorChain::createBussesProperties(channelsIn, channelsOut, channelsSC));
+    }
     m_chain->setLogTagSource(getLogTagSource());
     if (m_doublePrecission && m_chain->supportsDoublePrecisionProcessing()) {
         m_chain->setProcessingPrecision(AudioProcessor::doublePrecision);
     }
     m_chain->updateChannels(channelsIn, channelsOut, channelsSC);
+    m_chain->setConcurrentBranches(getApp()->getServer()->getChainBranches());
+    m_chain->setPipelineSegments(getApp()->getServer()->getChainPipelineSegments());
 }
 
 bool AudioWorker::waitForData() {
+    if (nullptr != m_reactorReg) {
+        // no need to lock, as the reactor wakes us up on shutdown
+        return m_reactorReg->waitUntilReady(1000) > 0;
+    }
     std::lock_guard<std::mutex> lock(m_mtx);
+    if (nullptr != m_shm) {
+        return m_shm->waitUntilReady(50);
+    }
+    if (nullptr != m_udp) {
+        return m_udp->waitUntilReady(50);
+    }
     return m_socket->waitUntilReady(true, 50);
 }
 
+void AudioWorker::closeStream() {
+    if (nullptr != m_shm) {
+        m_shm->close();
+    }
+    if (nullptr != m_udp) {
+        m_udp->close();
+    }
+    m_socket->close();
+}
+
 void AudioWorker::run() {
     traceScope();
     logln("audio processor started");
+    CPUInfo::registerThread(getLogTagExtra());
 
-    AudioBuffer<float> bufferF;
-    AudioBuffer<double> bufferD;
-    MidiBuffer midi;
-    AudioMessage msg(getLogTagSource());
-    AudioPlayHead::CurrentPositionInfo posInfo;
-    auto duration = TimeStatistic::getDuration("audio");
-    auto bytesIn = Metrics::getStatistic<Meter>("NetBytesIn");
-    auto bytesOut = Metrics::getStatistic<Meter>("NetBytesOut");
+    m_msg = std::make_unique<AudioMessage>(getLogTagSource());
+    m_msg->setCompression(m_compressedAudio);
+    m_msg->setWireFormat(m_wireFormat);
+    m_duration = TimeStatistic::getDuration("audio");
+    m_bytesIn = Metrics::getStatistic<Meter>("NetBytesIn");
+    m_bytesOut = Metrics::getStatistic<Meter>("NetBytesOut");
+    m_hasToSetPlayHead = true;
 
-    ProcessorChain::PlayHead playHead(&posInfo);
     m_chain->prepareToPlay(m_rate, m_samplesPerBlock);
-    bool hasToSetPlayHead = true;
 
-    MessageHelper::Error e;
+    if (nullptr != m_scheduler) {
+        // this thread reads and sends the blocks, only the processing is handed to the pool
+        logln("processing on the audio scheduler");
+    }
     while (isOk()) {
-        // Read audio chunk
-        if (waitForData()) {
-            if (msg.readFromClient(m_socket.get(), bufferF, bufferD, midi, posInfo, &e, *bytesIn)) {
-                std::lock_guard<std::mutex> lock(m_mtx);
-                duration.reset();
-                if (hasToSetPlayHead) {  // do not set the playhead before it's initialized
-                    m_chain->setPlayHead(&playHead);
-                    hasToSetPlayHead = false;
-                }
-                int bufferChannels = msg.isDouble() ? bufferD.getNumChannels() : bufferF.getNumChannels();
-                int neededChannels = m_activeChannels.getNumActiveChannels(true);
-                if (neededChannels > bufferChannels) {
-                    logln("error processing audio message: buffer has not enough channels: needed channels is "
-                          << neededChannels << ", but buffer has " << bufferChannels);
-                    m_chain->releaseResources();
-                    m_socket->close();
-                    break;
-                }
-                bool sendOk;
-                if (msg.isDouble()) {
-                    if (m_chain->supportsDoublePrecisionProcessing()) {
-                        processBlock(bufferD, midi);
-                    } else {
-                        bufferF.makeCopyOf(bufferD);
-                        processBlock(bufferF, midi);
-                        bufferD.makeCopyOf(bufferF);
-                    }
-                    sendOk = msg.sendToClient(m_socket.get(), bufferD, midi, m_chain->getLatencySamples(),
-                                              bufferD.getNumChannels(), &e, *bytesOut);
-                } else {
-                    processBlock(bufferF, midi);
-                    sendOk = msg.sendToClient(m_socket.get(), bufferF, midi, m_chain->getLatencySamples(),
-                                              bufferF.getNumChannels(), &e, *bytesOut);
-                }
-                if (!sendOk) {
-                    logln("error: failed to send audio data to client: " << e.toString());
-                    m_socket->close();
-                }
-                duration.update();
-            } else {
-                logln("error: failed to read audio message: " << e.toString());
-                m_socket->close();
-            }
+        if (waitForData() && !processNextBlock()) {
+            break;
         }
     }
 
     m_chain->setPlayHead(nullptr);
 
-    duration.clear();
-    clear();
+    m_duration.clear();
     signalThreadShouldExit();
+    if (m_msg->getCompression()) {
+        logln("audio compression ratio " << String(m_msg->getCompressionRatio(), 2));
+    }
+    if (m_xruns.count > 0) {
+        logln(m_xruns.count.load() << " block(s) missed the deadline, max overrun "
+                                   << String(m_xruns.maxOverrunMs.load(), 2) << "ms");
+    }
+    CPUInfo::unregisterThread();
     logln("audio processor terminated");
 }
 
+bool AudioWorker::processNextBlock() {
+    MessageHelper::Error e;
+    auto readStart = Time::getHighResolutionTicks();
+    bool readOk = withStream([&](auto* stream) {
+        return m_msg->readFromClient(stream, m_bufferF, m_bufferD, m_midi, m_posInfo, &e, *m_bytesIn);
+    });
+    auto ioTicks = Time::getHighResolutionTicks() - readStart;
+    if (!readOk) {
+        logln("error: failed to read audio message: " << e.toString());
+        closeStream();
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_duration.reset();
+    if (m_hasToSetPlayHead) {  // do not set the playhead before it's initialized
+        m_chain->setPlayHead(&m_playHead);
+        m_hasToSetPlayHead = false;
+    }
+    bool isDouble = m_msg->isDouble();
+    int bufferChannels = isDouble ? m_bufferD.getNumChannels() : m_bufferF.getNumChannels();
+    int neededChannels = m_activeChannels.getNumActiveChannels(true);
+    if (neededChannels > bufferChannels) {
+        logln("error processing audio message: buffer has not enough channels: needed channels is "
+              << neededChannels << ", but buffer has " << bufferChannels);
+        m_chain->releaseResources();
+        closeStream();
+        return false;
+    }
+    auto sendToClient = [&](auto& buffer) {
+        return withStream([&](auto* stream) {
+            return m_msg->sendToClient(stream, buffer, m_midi, m_chain->getLatencySamples(), buffer.getNumChannels(),
+                                       &e, *m_bytesOut);
+        });
+    };
+    auto process = [&] {
+        if (isDouble) {
+            if (m_chain->supportsDoublePrecisionProcessing()) {
+                processBlock(m_bufferD, m_midi);
+            } else {
+                m_bufferF.makeCopyOf(m_bufferD);
+                processBlock(m_bufferF, m_midi);
+                m_bufferD.makeCopyOf(m_bufferF);
+            }
+        } else {
+            processBlock(m_bufferF, m_midi);
+        }
+    };
+    int samples = isDouble ? m_bufferD.getNumSamples() : m_bufferF.getNumSamples();
+    double blockMs = samples / m_rate * 1000;
+    auto procStart = Time::getHighResolutionTicks();
+    if (nullptr != m_scheduler) {
+        // the deadline is taken from the block, that has just been read
+        m_scheduler->process(m_schedulerClient, blockMs, process);
+    } else {
+        process();
+    }
+    auto procEnd = Time::getHighResolutionTicks();
+    bool sendOk = isDouble ? sendToClient(m_bufferD) : sendToClient(m_bufferF);
+    ioTicks += Time::getHighResolutionTicks() - procEnd;
+    updateXruns(Time::highResolutionTicksToSeconds(procEnd - procStart) * 1000,
+                Time::highResolutionTicksToSeconds(ioTicks) * 1000, blockMs);
+    if (!sendOk) {
+        logln("error: failed to send audio data to client: " << e.toString());
+        closeStream();
+    }
+    m_duration.update();
+    return sendOk;
+}
+
 template <typename T>
 void AudioWorker::processBlock(AudioBuffer<T>& buffer, MidiBuffer& midi) {
     int numChannels = jmax(m_channelsIn + m_channelsSC, m_channelsOut) + m_chain->getExtraChannels();
@@ -154,6 +238,9 @@ void AudioWorker::processBlock(AudioBuffer<T>& buffer, MidiBuffer& midi) {
 void AudioWorker::shutdown() {
     traceScope();
     signalThreadShouldExit();
+    if (nullptr != m_reactorReg) {
+        m_reactorReg->wakeUp();
+    }
 }
 
 void AudioWorker::clear() {
@@ -168,6 +255,11 @@ bool AudioWorker::addPlugin(const String& id, String& err) {
     return m_chain->addPluginProcessor(id, err);
 }
 
+std::vector<std::shared_ptr<AGProcessor>> AudioWorker::addPlugins(const StringArray& ids, StringArray& errors) {
+    traceScope();
+    return m_chain->addPluginProcessors(ids, errors);
+}
+
 void AudioWorker::delPlugin(int idx) {
     traceScope();
     logln("deleting plugin " << idx);
@@ -180,6 +272,54 @@ void AudioWorker::exchangePlugins(int idxA, int idxB) {
     m_chain->exchangeProcessors(idxA, idxB);
 }
 
+void AudioWorker::setPluginBranch(int idx, int branch) {
+    traceScope();
+    logln("setting branch of plugin " << idx << " to " << branch);
+    m_chain->setBranch(idx, branch);
+}
+
+json AudioWorker::getPluginDSPLoad() {
+    traceScope();
+    if (nullptr == m_chain) {
+        return json::array();
+    }
+    return m_chain->getLoad();
+}
+
+void AudioWorker::updateXruns(double processingMs, double networkMs, double blockMs) {
+    // smooth the network share, a single slow read should not move the budget
+    m_networkMs = m_networkMs * 0.95 + networkMs * 0.05;
+    double budget = jmax(0.0, blockMs - m_networkMs);
+    double overrun = processingMs - budget;
+    m_xruns.budgetMs.store(budget, std::memory_order_relaxed);
+    if (overrun > 0) {
+        m_xruns.count.store(m_xruns.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_xruns.lastOverrunMs.store(overrun, std::memory_order_relaxed);
+        m_xruns.maxOverrunMs.store(jmax(overrun, m_xruns.maxOverrunMs.load(std::memory_order_relaxed)),
+                                   std::memory_order_relaxed);
+        m_xruns.totalOverrunMs.store(m_xruns.totalOverrunMs.load(std::memory_order_relaxed) + overrun,
+                                     std::memory_order_relaxed);
+        m_chain->markSlowestProcessor();
+    }
+}
+
+json AudioWorker::getXruns() {
+    traceScope();
+    String plugin;
+    if (nullptr != m_chain) {
+        auto proc = m_chain->getXrunProcessor();
+        if (nullptr != proc) {
+            plugin = proc->getName();
+        }
+    }
+    return {{"count", m_xruns.count.load(std::memory_order_relaxed)},
+            {"budget", m_xruns.budgetMs.load(std::memory_order_relaxed)},
+            {"lastOverrun", m_xruns.lastOverrunMs.load(std::memory_order_relaxed)},
+            {"maxOverrun", m_xruns.maxOverrunMs.load(std::memory_order_relaxed)},
+            {"totalOverrun", m_xruns.totalOverrunMs.load(std::memory_order_relaxed)},
+            {"plugin", plugin.toStdString()}};
+}
+
 String AudioWorker::getRecentsList(String host) const {
     traceScope();
     std::lock_guard<std::mutex> lock(m_recentsMtx);
@@ -207,6 +347,24 @@ void AudioWorker::addToRecentsList(const String& id, const String& host) {
             recents.removeLast(toRemove);
         }
     }
+    if (auto pool = PluginPool::getInstance()) {
+        pool->update();
+    }
+}
+
+StringArray AudioWorker::getRecentPluginIds(const String& host, int num) {
+    std::lock_guard<std::mutex> lock(m_recentsMtx);
+    StringArray ids;
+    auto it = m_recents.find(host);
+    if (it != m_recents.end()) {
+        for (auto& r : it->second) {
+            if (ids.size() >= num) {
+                break;
+            }
+            ids.add(AGProcessor::createPluginID(r));
+        }
+    }
+    return ids;
 }
 
 }  // namespace e47
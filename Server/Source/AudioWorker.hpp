@@ -16,6 +16,10 @@
 #include "Message.hpp"
 #include "Utils.hpp"
 #include "ChannelMapper.hpp"
+#include "SharedMemoryStream.hpp"
+#include "DatagramStream.hpp"
+#include "SocketReactor.hpp"
+#include "AudioScheduler.hpp"
 
 namespace e47 {
 
@@ -32,16 +36,24 @@ class AudioWorker : public Thread, public LogTagDelegate {
     AudioWorker(LogTag* tag);
     virtual ~AudioWorker() override;
 
-    void init(std::unique_ptr<StreamingSocket> s, int channelsIn, int channelsOut, int channelsSC,
-              uint64 activeChannels, double rate, int samplesPerBlock, bool doublePrecission);
+    void init(std::unique_ptr<StreamingSocket> s, std::unique_ptr<SharedMemoryStream> shm,
+              std::unique_ptr<DatagramStream> udp, int channelsIn, int channelsOut, int channelsSC,
+              uint64 activeChannels, double rate, int samplesPerBlock, bool doublePrecission, bool compressedAudio,
+              uint8 wireFormat);
 
     void run() override;
     void shutdown();
     void clear();
 
+    // The chain is kept after the audio processor terminated, until it gets cleared or handed over to another
+    // session. A chain, that has been set before init, is used instead of creating a new one.
+    std::shared_ptr<ProcessorChain> getChain() const { return m_chain; }
+    void setChain(std::shared_ptr<ProcessorChain> chain) { m_chain = chain; }
+
     bool isOk() {
         std::lock_guard<std::mutex> lock(m_mtx);
-        m_wasOk = !currentThreadShouldExit() && nullptr != m_socket && m_socket->isConnected();
+        m_wasOk = !currentThreadShouldExit() && nullptr != m_socket && m_socket->isConnected() &&
+                  (nullptr == m_shm || m_shm->isConnected()) && (nullptr == m_udp || m_udp->isConnected());
         return m_wasOk;
     }
 
@@ -52,8 +64,12 @@ class AudioWorker : public Thread, public LogTagDelegate {
     int getChannelsSC() const { return m_channelsSC; }
 
     bool addPlugin(const String& id, String& err);
+    std::vector<std::shared_ptr<AGProcessor>> addPlugins(const StringArray& ids, StringArray& errors);
     void delPlugin(int idx);
     void exchangePlugins(int idxA, int idxB);
+    void setPluginBranch(int idx, int branch);
+    json getPluginDSPLoad();
+    json getXruns();
     std::shared_ptr<AGProcessor> getProcessor(int idx) const { return m_chain->getProcessor(idx); }
     int getSize() const { return static_cast<int>(m_chain->getSize()); }
     int getLatencySamples() const { return m_chain->getLatencySamples(); }
@@ -70,11 +86,16 @@ class AudioWorker : public Thread, public LogTagDelegate {
     using RecentsListType = Array<ComparablePluginDescription>;
     String getRecentsList(String host) const;
     void addToRecentsList(const String& id, const String& host);
+    // IDs of the most recently used plugins of a host, newest first
+    static StringArray getRecentPluginIds(const String& host, int num);
 
   private:
     std::mutex m_mtx;
     std::atomic_bool m_wasOk{true};
     std::unique_ptr<StreamingSocket> m_socket;
+    std::unique_ptr<SharedMemoryStream> m_shm;
+    std::unique_ptr<DatagramStream> m_udp;
+    std::unique_ptr<SocketReactor::Registration> m_reactorReg;
     int m_channelsIn;
     int m_channelsOut;
     int m_channelsSC;
@@ -83,14 +104,61 @@ class AudioWorker : public Thread, public LogTagDelegate {
     double m_rate;
     int m_samplesPerBlock;
     bool m_doublePrecission;
+    bool m_compressedAudio = false;
+    uint8 m_wireFormat = AudioWireFormat::NATIVE;
     std::shared_ptr<ProcessorChain> m_chain;
+    std::shared_ptr<AudioScheduler> m_scheduler;
+    AudioScheduler::Client m_schedulerClient;
+
+    // the state of the audio stream, used by the thread, that processes the next block
+    std::unique_ptr<AudioMessage> m_msg;
+    AudioBuffer<float> m_bufferF;
+    AudioBuffer<double> m_bufferD;
+    MidiBuffer m_midi;
+    AudioPlayHead::CurrentPositionInfo m_posInfo;
+    ProcessorChain::PlayHead m_playHead{&m_posInfo};
+    bool m_hasToSetPlayHead = true;
+    TimeStatistic::Duration m_duration;
+    std::shared_ptr<Meter> m_bytesIn, m_bytesOut;
+
     static std::unordered_map<String, RecentsListType> m_recents;
     static std::mutex m_recentsMtx;
 
     AudioBuffer<float> m_procBufferF;
     AudioBuffer<double> m_procBufferD;
 
+    // A block missed its deadline, if processing took longer than the block period minus the time needed for
+    // reading and sending the audio data. Written by the audio thread only, the reader might see values of
+    // different blocks. The slowest processor is marked in the chain and looked up by the reader.
+    struct Xruns {
+        std::atomic<uint64> count{0};
+        std::atomic<double> budgetMs{0};
+        std::atomic<double> lastOverrunMs{0};
+        std::atomic<double> maxOverrunMs{0};
+        std::atomic<double> totalOverrunMs{0};
+    };
+    Xruns m_xruns;
+    double m_networkMs = 0;
+
+    void updateXruns(double processingMs, double networkMs, double blockMs);
+
     bool waitForData();
+    void closeStream();
+
+    // Reads, processes and sends the next block, returns false if the stream has been closed
+    bool processNextBlock();
+
+    // Calls fn with the stream that transports the audio data
+    template <typename Fn>
+    auto withStream(Fn fn) -> decltype(fn(m_socket.get())) {
+        if (nullptr != m_shm) {
+            return fn(m_shm.get());
+        }
+        if (nullptr != m_udp) {
+            return fn(m_udp.get());
+        }
+        return fn(m_socket.get());
+    }
 
     template <typename T>
     AudioBuffer<T>* getProcBuffer();
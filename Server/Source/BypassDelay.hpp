@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef BypassDelay_hpp
+#define BypassDelay_hpp
+
+#include <JuceHeader.h>
+#include <mutex>
+
+#include "AudioRingBuffer.hpp"
+
+namespace e47 {
+
+/*
+ * Delays the dry signal by the latency of a bypassed plugin, so that the chain stays in time. The delay line is fed
+ * while the plugin is active as well, so that bypassing can crossfade between the plugin output and the delayed
+ * signal.
+ *
+ * The delay line is allocated by reserve() off the audio thread and handed over to the audio thread, that picks it up
+ * with the next call to prepare(). The replaced delay line is handed back and released by the next reserve() call.
+ */
+template <typename T>
+class BypassDelay {
+  public:
+    ~BypassDelay() {
+        delete m_pending.exchange(nullptr);
+        delete m_retired.exchange(nullptr);
+    }
+
+    // Make sure the delay line fits the given buffer and latency, must not be called from the audio thread. This only
+    // allocates, if the delay line has to grow, and leaves some headroom for further latency changes.
+    void reserve(int channels, int samples, int latency) {
+        std::lock_guard<std::mutex> lock(m_reserveMtx);
+        delete m_retired.exchange(nullptr);
+        int needed = latency + samples;
+        if (channels <= m_reservedChannels && needed <= m_reservedSamples && samples <= m_reservedBlockSize) {
+            return;
+        }
+        m_reservedChannels = jmax(channels, m_reservedChannels);
+        m_reservedSamples = jmax(nextPowerOfTwo(needed * 2), m_reservedSamples);
+        m_reservedBlockSize = jmax(samples, m_reservedBlockSize);
+        auto* storage = new Storage;
+        storage->ring.resize(m_reservedChannels, m_reservedSamples, true);
+        storage->dry.setSize(m_reservedChannels, m_reservedBlockSize);
+        // a delay line, that the audio thread did not pick up yet, is replaced
+        delete m_pending.exchange(storage);
+    }
+
+    // Set the latency, called from the audio thread. This does not allocate, the latency is limited to the reserved
+    // delay line. The delayed samples are kept, when the latency changes.
+    void prepare(int samples, int latency) {
+        if (auto* pending = m_pending.exchange(nullptr)) {
+            pending->ring.copyContentFrom(m_storage->ring);
+            m_retired = m_storage.release();
+            m_storage.reset(pending);
+            m_latency = -1;
+        }
+        latency = jlimit(0, jmax(0, m_storage->ring.getNumSamples() - samples), latency);
+        if (latency != m_latency) {
+            m_latency = latency;
+            m_storage->ring.setReadOffset(m_storage->ring.getWriteOffset() + m_storage->ring.getNumSamples() - latency);
+        }
+    }
+
+    int getLatency() const { return m_latency; }
+
+    // Feed the delay line without reading the delayed signal
+    void push(const AudioBuffer<T>& buffer) {
+        auto& ring = m_storage->ring;
+        int channels = jmin(buffer.getNumChannels(), ring.getNumChannels());
+        ring.write(buffer.getArrayOfReadPointers(), buffer.getNumSamples(), channels);
+        ring.incReadOffset(buffer.getNumSamples());
+    }
+
+    // Replace the buffer with the delayed signal
+    void process(AudioBuffer<T>& buffer) {
+        auto& ring = m_storage->ring;
+        int channels = jmin(buffer.getNumChannels(), ring.getNumChannels());
+        ring.write(buffer.getArrayOfReadPointers(), buffer.getNumSamples(), channels);
+        ring.read(buffer.getArrayOfWritePointers(), buffer.getNumSamples(), channels);
+    }
+
+    // Feed the delay line and return the delayed signal without touching the buffer
+    const AudioBuffer<T>& processDry(const AudioBuffer<T>& buffer) {
+        auto& ring = m_storage->ring;
+        auto& dry = m_storage->dry;
+        int channels = jmin(buffer.getNumChannels(), ring.getNumChannels());
+        dry.setSize(dry.getNumChannels(), buffer.getNumSamples(), false, false, true);
+        ring.write(buffer.getArrayOfReadPointers(), buffer.getNumSamples(), channels);
+        ring.read(dry.getArrayOfWritePointers(), buffer.getNumSamples(), channels);
+        return dry;
+    }
+
+  private:
+    struct Storage {
+        AudioRingBuffer<T> ring;
+        AudioBuffer<T> dry;
+    };
+
+    // used by the audio thread only
+    std::unique_ptr<Storage> m_storage = std::make_unique<Storage>();
+    int m_latency = -1;
+
+    // handover between reserve() and the audio thread
+    std::atomic<Storage*> m_pending{nullptr};
+    std::atomic<Storage*> m_retired{nullptr};
+
+    std::mutex m_reserveMtx;
+    int m_reservedChannels = 0;
+    int m_reservedSamples = 0;
+    int m_reservedBlockSize = 0;
+};
+
+}  // namespace e47
+
+#endif /* BypassDelay_hpp */
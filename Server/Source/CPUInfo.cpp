@@ -39,11 +39,125 @@ typedef struct _SYSTEM_BASIC_INFORMATION {
 } SYSTEM_BASIC_INFORMATION;
 
 typedef DWORD(WINAPI* fpNtQuerySystemInformation)(DWORD infoClass, void* sysInfo, DWORD sysInfoSize, DWORD* retSize);
+#elif defined(JUCE_LINUX)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <fstream>
+#include <sstream>
 #endif
 
 namespace e47 {
 
 std::atomic<float> CPUInfo::m_usage{0.0f};
+std::map<int, CPUInfo::ThreadInfo> CPUInfo::m_threads;
+std::mutex CPUInfo::m_threadsMtx;
+
+#if defined(JUCE_LINUX)
+namespace {
+
+// Busy and idle ticks of every core
+bool readCoreTicks(std::vector<std::pair<uint64, uint64>>& ticks) {
+    ticks.clear();
+    std::ifstream f("/proc/stat");
+    std::string line;
+    while (std::getline(f, line)) {
+        // skip the aggregated "cpu" line and everything else
+        if (line.compare(0, 3, "cpu") != 0 || line.size() < 4 || !isdigit(line[3])) {
+            continue;
+        }
+        std::istringstream ss(line);
+        std::string name;
+        uint64 user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+        ss >> name >> user >> nice >> system >> idle >> iowait >> irq >> softirq >> steal;
+        // the iowait counter of a core can go backwards, so it is left out
+        ticks.push_back({user + nice + system + irq + softirq + steal, idle});
+    }
+    return !ticks.empty();
+}
+
+// User and system ticks of a thread of this process
+bool readThreadTicks(int tid, uint64& ticks) {
+    std::ifstream f("/proc/self/task/" + std::to_string(tid) + "/stat");
+    std::string stat;
+    if (!std::getline(f, stat)) {
+        return false;
+    }
+    // the thread name can contain spaces, so start after its closing bracket with field 3
+    auto pos = stat.rfind(')');
+    if (pos == std::string::npos) {
+        return false;
+    }
+    std::istringstream ss(stat.substr(pos + 1));
+    std::string skip;
+    for (int field = 3; field < 14; field++) {
+        ss >> skip;
+    }
+    uint64 utime, stime;
+    ss >> utime >> stime;
+    if (ss.fail()) {
+        return false;
+    }
+    ticks = utime + stime;
+    return true;
+}
+
+}  // namespace
+#endif
+
+void CPUInfo::registerThread(const String& name) {
+#if defined(JUCE_LINUX)
+    int tid = (int)syscall(SYS_gettid);
+    ThreadInfo info;
+    info.name = name;
+    std::lock_guard<std::mutex> lock(m_threadsMtx);
+    m_threads[tid] = info;
+#else
+    ignoreUnused(name);
+#endif
+}
+
+void CPUInfo::unregisterThread() {
+#if defined(JUCE_LINUX)
+    int tid = (int)syscall(SYS_gettid);
+    std::lock_guard<std::mutex> lock(m_threadsMtx);
+    m_threads.erase(tid);
+#endif
+}
+
+std::map<String, float> CPUInfo::getThreadUsage() {
+    std::map<String, float> ret;
+    std::lock_guard<std::mutex> lock(m_threadsMtx);
+    for (auto& t : m_threads) {
+        ret[t.second.name] += t.second.usage;
+    }
+    return ret;
+}
+
+void CPUInfo::updateThreadUsage(double seconds) {
+#if defined(JUCE_LINUX)
+    static const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+    std::lock_guard<std::mutex> lock(m_threadsMtx);
+    for (auto it = m_threads.begin(); it != m_threads.end();) {
+        uint64 ticks;
+        if (!readThreadTicks(it->first, ticks)) {
+            // the thread is gone
+            it = m_threads.erase(it);
+            continue;
+        }
+        auto& info = it->second;
+        if (ticks < info.lastTicks) {
+            // the id has been reused for a new thread, the counter starts over
+            info.usage = 0;
+        } else if (info.lastTicks > 0 && seconds > 0) {
+            info.usage = (float)((double)(ticks - info.lastTicks) / ticksPerSecond / seconds * 100);
+        }
+        info.lastTicks = ticks;
+        it++;
+    }
+#else
+    ignoreUnused(seconds);
+#endif
+}
 
 void CPUInfo::run() {
     traceScope();
@@ -63,6 +177,7 @@ void CPUInfo::run() {
 
     while (!currentThreadShouldExit()) {
         const int waitTime = 1000;
+        auto start = Time::getMillisecondCounterHiRes();
 
 #if defined(JUCE_MAC)
         natural_t procCount = 0;
@@ -141,7 +256,33 @@ void CPUInfo::run() {
         }
         auto usageTime = (float)totalTime - idleTime;
         float usage = usageTime / totalTime * 100;
+#elif defined(JUCE_LINUX)
+        std::vector<std::pair<uint64, uint64>> ticksStart, ticksEnd;
+
+        if (!readCoreTicks(ticksStart)) {
+            logln("failed to read /proc/stat");
+            return;
+        }
+
+        sleep(waitTime);
+
+        if (!readCoreTicks(ticksEnd) || ticksEnd.size() != ticksStart.size()) {
+            // the number of online cores changed
+            continue;
+        }
+
+        uint64 usageTime, totalTime;
+        usageTime = totalTime = 0;
+        for (size_t i = 0; i < ticksStart.size(); i++) {
+            // the counters are not guaranteed to be monotonic, e.g. when a core went offline and back
+            auto busy = ticksEnd[i].first > ticksStart[i].first ? ticksEnd[i].first - ticksStart[i].first : 0;
+            auto idle = ticksEnd[i].second > ticksStart[i].second ? ticksEnd[i].second - ticksStart[i].second : 0;
+            usageTime += busy;
+            totalTime += busy + idle;
+        }
+        float usage = totalTime > 0 ? (float)usageTime / totalTime * 100 : 0.0f;
 #endif
+        updateThreadUsage((Time::getMillisecondCounterHiRes() - start) / 1000);
         lastValues[valueIdx++ % lastValues.size()] = usage;
         usage = 0;
         for (auto u : lastValues) {
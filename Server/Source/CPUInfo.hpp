@@ -9,6 +9,8 @@
 #define CPUInfo_hpp
 
 #include <JuceHeader.h>
+#include <map>
+#include <mutex>
 
 #include "SharedInstance.hpp"
 #include "Utils.hpp"
@@ -24,8 +26,27 @@ class CPUInfo : public Thread, public LogTag, public SharedInstance<CPUInfo> {
 
     static float getUsage() { return m_usage; }
 
+    // Accounts the CPU time of the calling thread under the given name, e.g. the client of an audio worker. Only
+    // supported on Linux.
+    static void registerThread(const String& name);
+    static void unregisterThread();
+
+    // CPU usage of the registered threads in percent of one core, summed up per name
+    static std::map<String, float> getThreadUsage();
+
   private:
     static std::atomic<float> m_usage;
+
+    struct ThreadInfo {
+        String name;
+        uint64 lastTicks = 0;
+        float usage = 0.0f;
+    };
+
+    static std::map<int, ThreadInfo> m_threads;
+    static std::mutex m_threadsMtx;
+
+    void updateThreadUsage(double seconds);
 };
 
 }  // namespace e47
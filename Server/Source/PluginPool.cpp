@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#include "PluginPool.hpp"
+#include "AudioWorker.hpp"
+#include "ProcessorChain.hpp"
+#include "App.hpp"
+
+namespace e47 {
+
+PluginPool::PluginPool() : Thread("PluginPool"), LogTag("pluginpool") {}
+
+PluginPool::~PluginPool() {
+    traceScope();
+    signalThreadShouldExit();
+    notify();
+    waitForThreadToExit(-1);
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_instances.clear();
+    logln("plugin pool stopped");
+}
+
+void PluginPool::start(int pluginsPerHost) {
+    traceScope();
+    m_pluginsPerHost = pluginsPerHost;
+    startThread(Thread::lowPriority);
+    logln("plugin pool started, keeping " << pluginsPerHost << " plugin(s) per host");
+}
+
+void PluginPool::drain() {
+    traceScope();
+    signalThreadShouldExit();
+    notify();
+    waitForThreadToExit(-1);
+    std::lock_guard<std::mutex> lock(m_mtx);
+    logln("releasing " << m_instances.size() << " pooled plugin(s)");
+    m_instances.clear();
+}
+
+void PluginPool::run() {
+    traceScope();
+    while (!currentThreadShouldExit()) {
+        refill();
+        wait(REFILL_INTERVAL_MS);
+    }
+}
+
+void PluginPool::setConfig(const String& host, double sampleRate, int blockSize) {
+    traceScope();
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_configs[host] = {sampleRate, blockSize};
+    }
+    notify();
+}
+
+std::shared_ptr<AudioPluginInstance> PluginPool::take(const String& id, double sampleRate, int blockSize) {
+    traceScope();
+    std::shared_ptr<AudioPluginInstance> inst;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        auto it = m_instances.find(getKey(id, sampleRate, blockSize));
+        if (it == m_instances.end()) {
+            return nullptr;
+        }
+        inst = it->second;
+        m_instances.erase(it);
+    }
+    logln("handing out " << id << " from the pool");
+    notify();
+    return inst;
+}
+
+void PluginPool::clientLoadStarted() { m_clientLoads++; }
+
+void PluginPool::clientLoadFinished() {
+    m_lastClientLoad = Time::getMillisecondCounter();
+    m_clientLoads--;
+}
+
+bool PluginPool::waitForClientLoads() {
+    while (!currentThreadShouldExit()) {
+        if (m_clientLoads == 0) {
+            auto idleMs = (int)(Time::getMillisecondCounter() - m_lastClientLoad);
+            if (m_lastClientLoad == 0 || idleMs >= REFILL_DELAY_MS) {
+                return true;
+            }
+            wait(REFILL_DELAY_MS - idleMs);
+        } else {
+            wait(REFILL_DELAY_MS);
+        }
+    }
+    return false;
+}
+
+String PluginPool::getKey(const String& id, double sampleRate, int blockSize) {
+    return id + "|" + String(sampleRate) + "|" + String(blockSize);
+}
+
+void PluginPool::refill() {
+    traceScope();
+    struct Wanted {
+        String id;
+        Config cfg;
+    };
+    std::map<String, Wanted> wanted;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        for (auto& c : m_configs) {
+            for (auto& id : AudioWorker::getRecentPluginIds(c.first, m_pluginsPerHost)) {
+                wanted[getKey(id, c.second.sampleRate, c.second.blockSize)] = {id, c.second};
+            }
+        }
+        // drop instances, that are not among the recents anymore
+        for (auto it = m_instances.begin(); it != m_instances.end();) {
+            if (wanted.find(it->first) == wanted.end()) {
+                logln("removing " << it->first << " from the pool");
+                it = m_instances.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+    for (auto& w : wanted) {
+        // loading plugins for clients goes first
+        if (!waitForClientLoads()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            if (m_instances.find(w.first) != m_instances.end()) {
+                continue;
+            }
+        }
+        auto inst = createInstance(w.second.id, w.second.cfg.sampleRate, w.second.cfg.blockSize);
+        if (nullptr != inst) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_instances[w.first] = inst;
+        }
+    }
+}
+
+std::shared_ptr<AudioPluginInstance> PluginPool::createInstance(const String& id, double sampleRate, int blockSize) {
+    traceScope();
+    logln("loading " << id << " into the pool (" << sampleRate << "Hz, " << blockSize << " samples)");
+    String err;
+    std::shared_ptr<AudioPluginInstance> inst;
+    {
+        // plugins, that can't be loaded in parallel, can't be loaded while a client loads a plugin either
+        std::unique_lock<std::mutex> lock(AGProcessor::getPluginLoaderMtx(), std::defer_lock);
+        if (!getApp()->getServer()->getParallelPluginLoad()) {
+            lock.lock();
+        }
+        inst = AGProcessor::loadPlugin(id, sampleRate, blockSize, err);
+    }
+    if (nullptr == inst) {
+        logln("failed to load " << id << " into the pool: " << err);
+        return nullptr;
+    }
+    // warm up with the default layout, like a chain does after loading a plugin
+    inst->prepareToPlay(sampleRate, blockSize);
+    inst->enableAllBuses();
+    AudioBuffer<float> buf(jmax(1, inst->getTotalNumInputChannels(), inst->getTotalNumOutputChannels()), blockSize);
+    MidiBuffer midi;
+    for (int samples = 0; samples < 16384 && !currentThreadShouldExit(); samples += blockSize) {
+        buf.clear();
+        inst->processBlock(buf, midi);
+    }
+    inst->releaseResources();
+    return inst;
+}
+
+}  // namespace e47
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef PluginPool_hpp
+#define PluginPool_hpp
+
+#include <JuceHeader.h>
+#include <map>
+
+#include "SharedInstance.hpp"
+#include "Utils.hpp"
+
+namespace e47 {
+
+/*
+ * Keeps instances of the most recently used plugins of every client host loaded, so that adding such a plugin does
+ * not have to wait for the plugin to be instantiated and warmed up. The instances are created for the sample rate and
+ * block size of the last client of a host. A background thread refills the pool, when an instance has been handed
+ * out or the recents of a host changed. Refills are held back, while clients load plugins.
+ */
+class PluginPool : public Thread, public LogTag, public SharedInstance<PluginPool> {
+  public:
+    PluginPool();
+    ~PluginPool() override;
+
+    // Starts the pool, keeping up to the given number of plugins per host
+    void start(int pluginsPerHost);
+
+    // Stops refilling and releases all instances. The instances are deleted on the message thread, so this has to be
+    // called before the message loop stops.
+    void drain();
+
+    void run() override;
+
+    // The audio config of a client, the pool prepares instances of the recent plugins of the host for it
+    void setConfig(const String& host, double sampleRate, int blockSize);
+
+    // Triggers a refill, e.g. after the recents of a host changed
+    void update() { notify(); }
+
+    // Hands out an instance, if there is one for the given plugin and audio config. The instance has been prepared
+    // and warmed up, but its resources have been released again, as its bus layout still has to be set.
+    std::shared_ptr<AudioPluginInstance> take(const String& id, double sampleRate, int blockSize);
+
+    // Called around loading a plugin for a client
+    void clientLoadStarted();
+    void clientLoadFinished();
+
+  private:
+    static constexpr int REFILL_INTERVAL_MS = 10000;
+    // time without client loads before refilling
+    static constexpr int REFILL_DELAY_MS = 2000;
+
+    struct Config {
+        double sampleRate;
+        int blockSize;
+    };
+
+    int m_pluginsPerHost = 0;
+    std::map<String, Config> m_configs;
+    std::map<String, std::shared_ptr<AudioPluginInstance>> m_instances;
+    std::mutex m_mtx;
+    std::atomic_int m_clientLoads{0};
+    std::atomic_uint32_t m_lastClientLoad{0};
+
+    static String getKey(const String& id, double sampleRate, int blockSize);
+    void refill();
+    // Returns false, if the thread should exit
+    bool waitForClientLoads();
+    std::shared_ptr<AudioPluginInstance> createInstance(const String& id, double sampleRate, int blockSize);
+};
+
+}  // namespace e47
+
+#endif /* PluginPool_hpp */
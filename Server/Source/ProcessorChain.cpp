@@ -7,11 +7,15 @@
 
 #include "ProcessorChain.hpp"
 #include "App.hpp"
+#include "Message.hpp"
+#include "PluginPool.hpp"
 
 namespace e47 {
 
 std::atomic_uint32_t AGProcessor::loadedCount{0};
 std::mutex AGProcessor::m_pluginLoaderMtx;
+std::mutex ProcessorChain::m_chainsMtx;
+std::set<ProcessorChain*> ProcessorChain::m_chains;
 
 AGProcessor::AGProcessor(ProcessorChain& chain, const String& id, double sampleRate, int blockSize)
     : LogTagDelegate(chain.getLogTagSource()),
@@ -135,23 +139,40 @@ bool AGProcessor::load(String& err) {
         if (!m_parallelLoadAllowed) {
             m_pluginLoaderMtx.lock();
         }
-        p = loadPlugin(m_id, m_sampleRate, m_blockSize, err);
+        bool pooled = false;
+        auto pool = PluginPool::getInstance();
+        if (nullptr != pool) {
+            pool->clientLoadStarted();
+            p = pool->take(m_id, m_sampleRate, m_blockSize);
+            pooled = nullptr != p;
+        }
+        if (!pooled) {
+            p = loadPlugin(m_id, m_sampleRate, m_blockSize, err);
+        }
         if (nullptr != p) {
             {
                 std::lock_guard<std::mutex> lock(m_pluginMtx);
                 m_plugin = p;
             }
-            if (m_chain.initPluginInstance(this, err)) {
+            if (m_chain.initPluginInstance(this, err, !pooled)) {
                 loaded = true;
                 for (auto* param : m_plugin->getParameters()) {
                     param->addListener(this);
                 }
+                m_latency = p->getLatencySamples();
+                m_suspended = false;
+                reserveBypassDelay(m_blockSize);
+                p->addListener(this);
+                m_processingPlugin = p.get();
                 loadedCount++;
             } else {
                 std::lock_guard<std::mutex> lock(m_pluginMtx);
                 m_plugin.reset();
             }
         }
+        if (nullptr != pool) {
+            pool->clientLoadFinished();
+        }
         if (!m_parallelLoadAllowed) {
             m_pluginLoaderMtx.unlock();
         }
@@ -171,6 +192,8 @@ void AGProcessor::unload() {
             for (auto* param : m_plugin->getParameters()) {
                 param->removeListener(this);
             }
+            m_plugin->removeListener(this);
+            m_processingPlugin = nullptr;
             p = m_plugin;
             m_plugin.reset();
             loadedCount--;
@@ -185,43 +208,101 @@ void AGProcessor::unload() {
     }
 }
 
-void AGProcessor::processBlockBypassed(AudioBuffer<float>& buffer) {
-    auto totalNumInputChannels = m_chain.getTotalNumInputChannels();
-    auto totalNumOutputChannels = m_chain.getTotalNumOutputChannels();
+bool AGProcessor::processBlock(AudioBuffer<float>& buffer, MidiBuffer& midiMessages) {
+    auto start = Time::getHighResolutionTicks();
+    bool ret = processBlockReal(buffer, midiMessages);
+    updateProcessingTime(start, buffer.getNumSamples());
+    return ret;
+}
 
-    if (totalNumInputChannels > buffer.getNumChannels()) {
-        logln("buffer has less channels than main input channels");
-        totalNumInputChannels = buffer.getNumChannels();
-    }
-    if (totalNumOutputChannels > buffer.getNumChannels()) {
-        logln("buffer has less channels than main output channels");
-        totalNumOutputChannels = buffer.getNumChannels();
-    }
+bool AGProcessor::processBlock(AudioBuffer<double>& buffer, MidiBuffer& midiMessages) {
+    auto start = Time::getHighResolutionTicks();
+    bool ret = processBlockReal(buffer, midiMessages);
+    updateProcessingTime(start, buffer.getNumSamples());
+    return ret;
+}
 
-    for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i) {
-        buffer.clear(i, 0, buffer.getNumSamples());
+void AGProcessor::updateProcessingTime(int64 startTicks, int numSamples) {
+    double ms = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks) * 1000;
+    // only the audio thread writes
+    m_lastProcessingTime.store(ms, std::memory_order_relaxed);
+    m_processingTime.store(m_processingTime.load(std::memory_order_relaxed) * 0.95 + ms * 0.05,
+                           std::memory_order_relaxed);
+    if (numSamples > 0 && m_sampleRate > 0) {
+        double load = ms * m_sampleRate / numSamples / 10;
+        m_load.store(m_load.load(std::memory_order_relaxed) * 0.95 + load * 0.05, std::memory_order_relaxed);
+        // the peak halves within about 700 blocks
+        m_peakLoad.store(jmax(load, m_peakLoad.load(std::memory_order_relaxed) * 0.999), std::memory_order_relaxed);
     }
+}
 
-    if (m_bypassBufferF.size() < totalNumOutputChannels) {
-        logln("bypass buffer has less channels than needed, buffer: " << m_bypassBufferF.size()
-                                                                      << ", needed: " << totalNumOutputChannels);
-        for (auto i = 0; i < totalNumOutputChannels; ++i) {
-            buffer.clear(i, 0, buffer.getNumSamples());
-        }
-        return;
+template <typename T>
+bool AGProcessor::processBlockReal(AudioBuffer<T>& buffer, MidiBuffer& midiMessages) {
+    traceScope();
+    auto* p = m_processingPlugin;
+    if (nullptr == p) {
+        return false;
     }
 
-    for (auto c = 0; c < totalNumOutputChannels; ++c) {
-        auto& buf = m_bypassBufferF.getReference(c);
-        for (auto s = 0; s < buffer.getNumSamples(); ++s) {
-            buf.add(buffer.getSample(c, s));
-            buffer.setSample(c, s, buf.getFirst());
-            buf.remove(0);
+    m_inProcessBlock = true;
+
+    int numSamples = buffer.getNumSamples();
+    auto& delay = getBypassDelay(T());
+    // the delay line has been reserved, when the latency changed, this only moves the read position
+    delay.prepare(numSamples, m_latency.load(std::memory_order_relaxed));
+
+    bool suspended = m_suspended.load(std::memory_order_relaxed);
+    int state = m_bypassState;
+
+    auto mixDry = [&](const AudioBuffer<T>& dry, T gainStart, T gainEnd) {
+        // crossfade over the whole block, the plugin output has to be faded already
+        for (int ch = 0; ch < jmin(buffer.getNumChannels(), dry.getNumChannels()); ch++) {
+            buffer.addFromWithRamp(ch, 0, dry.getReadPointer(ch), numSamples, gainStart, gainEnd);
         }
+    };
+
+    if (state == ACTIVE && !suspended) {
+        delay.push(buffer);
+        p->processBlock(buffer, midiMessages);
+    } else if (state == ACTIVE && m_bypassState.compare_exchange_strong(state, FADING_OUT)) {
+        auto& dry = delay.processDry(buffer);
+        p->processBlock(buffer, midiMessages);
+        buffer.applyGainRamp(0, numSamples, 1, 0);
+        mixDry(dry, 0, 1);
+        state = FADING_OUT;
+        m_bypassState.compare_exchange_strong(state, BYPASSED);
+    } else if (state == BYPASSED && !suspended) {
+        // give the plugin the time to fill its latency, before fading in
+        m_warmupSamples = delay.getLatency();
+        m_bypassState.compare_exchange_strong(state, FADING_IN);
+        processBlockBypassed(buffer);
+    } else if (state == FADING_IN && !suspended) {
+        auto& dry = delay.processDry(buffer);
+        p->processBlock(buffer, midiMessages);
+        if (m_warmupSamples > 0) {
+            m_warmupSamples -= numSamples;
+            for (int ch = 0; ch < jmin(buffer.getNumChannels(), dry.getNumChannels()); ch++) {
+                buffer.copyFrom(ch, 0, dry, ch, 0, numSamples);
+            }
+        } else {
+            buffer.applyGainRamp(0, numSamples, 0, 1);
+            mixDry(dry, 1, 0);
+            m_bypassState.compare_exchange_strong(state, ACTIVE);
+        }
+    } else {
+        if (state == FADING_IN) {
+            // suspended again while warming up
+            m_bypassState.compare_exchange_strong(state, BYPASSED);
+        }
+        processBlockBypassed(buffer);
     }
+
+    m_inProcessBlock = false;
+    return true;
 }
 
-void AGProcessor::processBlockBypassed(AudioBuffer<double>& buffer) {
+template <typename T>
+void AGProcessor::processBlockBypassed(AudioBuffer<T>& buffer) {
     auto totalNumInputChannels = m_chain.getTotalNumInputChannels();
     auto totalNumOutputChannels = m_chain.getTotalNumOutputChannels();
 
@@ -238,73 +319,77 @@ void AGProcessor::processBlockBypassed(AudioBuffer<double>& buffer) {
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    if (m_bypassBufferD.size() < totalNumOutputChannels) {
-        logln("bypass buffer has less channels than needed");
-        for (auto i = 0; i < totalNumOutputChannels; ++i) {
-            buffer.clear(i, 0, buffer.getNumSamples());
+    getBypassDelay(T()).process(buffer);
+}
+
+void AGProcessor::waitForBypass() {
+    traceScope();
+    // one block should be enough for the audio thread to fade out
+    auto timeout = Time::getMillisecondCounter() + 500;
+    int state;
+    while ((state = m_bypassState) != BYPASSED) {
+        if (Time::getMillisecondCounter() > timeout && state != FADING_OUT &&
+            m_bypassState.compare_exchange_strong(state, BYPASSED)) {
+            logln("no audio processing, bypassing without fade");
+            break;
         }
-        return;
+        Thread::sleep(1);
+    }
+    while (m_inProcessBlock) {
+        Thread::sleep(1);
     }
+}
 
-    for (auto c = 0; c < totalNumOutputChannels; ++c) {
-        auto& buf = m_bypassBufferD.getReference(c);
-        for (auto s = 0; s < buffer.getNumSamples(); ++s) {
-            buf.add(buffer.getSample(c, s));
-            buffer.setSample(c, s, buf.getFirst());
-            buf.remove(0);
-        }
+void AGProcessor::audioProcessorChanged(AudioProcessor* processor, const ChangeDetails& details) {
+    if (details.latencyChanged) {
+        m_latency = processor->getLatencySamples();
+        reserveBypassDelay(m_chain.getBlockSize());
+        m_chain.processorLatencyChanged();
     }
 }
 
+void AGProcessor::reserveBypassDelay(int samples) {
+    traceScope();
+    if (m_chain.isUsingDoublePrecision()) {
+        m_bypassDelayD.reserve(getNumChannels(), samples, m_latency);
+    } else {
+        m_bypassDelayF.reserve(getNumChannels(), samples, m_latency);
+    }
+}
+
+int AGProcessor::getNumChannels() const {
+    return jmax(m_chain.getTotalNumInputChannels(), m_chain.getTotalNumOutputChannels()) + m_chain.getExtraChannels();
+}
+
 void AGProcessor::suspendProcessing(const bool shouldBeSuspended) {
     traceScope();
     auto p = getPlugin();
     if (nullptr != p) {
         if (shouldBeSuspended) {
+            m_suspended = true;
+            waitForBypass();
             p->suspendProcessing(true);
             p->releaseResources();
         } else {
             p->prepareToPlay(m_chain.getSampleRate(), m_chain.getBlockSize());
             p->suspendProcessing(false);
+            m_suspended = false;
         }
     }
 }
 
-void AGProcessor::updateLatencyBuffers() {
-    traceScope();
-    logln("updating latency buffers for " << m_lastKnownLatency << " samples");
-    auto p = getPlugin();
-    int channels = p->getTotalNumOutputChannels();
-    while (m_bypassBufferF.size() < channels) {
-        Array<float> buf;
-        for (int i = 0; i < m_lastKnownLatency; i++) {
-            buf.add(0);
-        }
-        m_bypassBufferF.add(std::move(buf));
-    }
-    while (m_bypassBufferD.size() < channels) {
-        Array<double> buf;
-        for (int i = 0; i < m_lastKnownLatency; i++) {
-            buf.add(0);
-        }
-        m_bypassBufferD.add(std::move(buf));
-    }
-    for (int c = 0; c < channels; c++) {
-        auto& bufF = m_bypassBufferF.getReference(c);
-        while (bufF.size() > m_lastKnownLatency) {
-            bufF.remove(0);
-        }
-        while (bufF.size() < m_lastKnownLatency) {
-            bufF.add(0);
-        }
-        auto& bufD = m_bypassBufferD.getReference(c);
-        while (bufD.size() > m_lastKnownLatency) {
-            bufD.remove(0);
-        }
-        while (bufD.size() < m_lastKnownLatency) {
-            bufD.add(0);
-        }
+ProcessorChain::~ProcessorChain() {
+    {
+        std::lock_guard<std::mutex> lock(m_chainsMtx);
+        m_chains.erase(this);
     }
+    std::lock_guard<std::mutex> lock(m_processors_mtx);
+    auto* snapshot = m_snapshot.exchange(nullptr);
+    // nothing is processed anymore
+    int pending = Snapshot::HANDOVER_PENDING;
+    snapshot->handover.compare_exchange_strong(pending, Snapshot::HANDOVER_DONE);
+    m_retiredSnapshots.push_back({std::unique_ptr<Snapshot>(snapshot), m_epoch.load()});
+    reclaimSnapshotsNoLock(true);
 }
 
 void ProcessorChain::prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) {
@@ -314,6 +399,8 @@ void ProcessorChain::prepareToPlay(double sampleRate, int maximumExpectedSamples
     for (auto& proc : m_processors) {
         proc->prepareToPlay(sampleRate, maximumExpectedSamplesPerBlock);
     }
+    // resize the branch buffers
+    publishNoLock();
 }
 
 void ProcessorChain::releaseResources() {
@@ -457,10 +544,10 @@ bool ProcessorChain::setProcessorBusesLayout(AGProcessor* proc) {
 
             proc->setExtraChannels(extraInChannels, extraOutChannels);
 
-            m_extraChannels = jmax(m_extraChannels, extraInChannels, extraOutChannels);
+            m_extraChannels = jmax(m_extraChannels.load(), extraInChannels, extraOutChannels);
 
             logln(extraInChannels << " extra input(s), " << extraOutChannels << " extra output(s) -> "
-                                  << m_extraChannels << " extra channel(s) in total");
+                                  << m_extraChannels.load() << " extra channel(s) in total");
 
             layout = procLayout;
             supported = true;
@@ -479,15 +566,17 @@ bool ProcessorChain::setProcessorBusesLayout(AGProcessor* proc) {
 
 int ProcessorChain::getExtraChannels() {
     traceScope();
-    std::lock_guard<std::mutex> lock(m_processors_mtx);
     return m_extraChannels;
 }
 
-bool ProcessorChain::initPluginInstance(AGProcessor* proc, String& err) {
+bool ProcessorChain::initPluginInstance(AGProcessor* proc, String& err, bool warmUp) {
     traceScope();
-    if (!setProcessorBusesLayout(proc)) {
-        err = "failed to find working I/O configuration";
-        return false;
+    {
+        std::lock_guard<std::mutex> lock(m_layoutMtx);
+        if (!setProcessorBusesLayout(proc)) {
+            err = "failed to find working I/O configuration";
+            return false;
+        }
     }
     auto inst = proc->getPlugin();
     AudioProcessor::ProcessingPrecision prec = AudioProcessor::singlePrecision;
@@ -502,6 +591,9 @@ bool ProcessorChain::initPluginInstance(AGProcessor* proc, String& err) {
     inst->prepareToPlay(getSampleRate(), getBlockSize());
     inst->setPlayHead(getPlayHead());
     inst->enableAllBuses();
+    if (!warmUp) {
+        return true;
+    }
     if (prec == AudioProcessor::doublePrecision) {
         preProcessBlocks<double>(inst);
     } else {
@@ -520,11 +612,53 @@ bool ProcessorChain::addPluginProcessor(const String& id, String& err) {
     return false;
 }
 
+std::vector<std::shared_ptr<AGProcessor>> ProcessorChain::addPluginProcessors(const StringArray& ids,
+                                                                             StringArray& errors) {
+    traceScope();
+    std::vector<std::shared_ptr<AGProcessor>> procs;
+    errors.clearQuick();
+    for (auto& id : ids) {
+        procs.push_back(std::make_shared<AGProcessor>(*this, id, getSampleRate(), getBlockSize()));
+        errors.add({});
+    }
+    auto loadProcessor = [&](size_t i) {
+        if (!procs[i]->load(errors.getReference((int)i))) {
+            procs[i].reset();
+        }
+    };
+    // the processors serialize loading via the plugin loader mutex, if parallel loading is disabled
+    if (getApp()->getServer()->getParallelPluginLoad() && procs.size() > 1) {
+        ThreadPool pool(jmin((int)procs.size(), MAX_PARALLEL_LOADS));
+        std::atomic_int pending{(int)procs.size()};
+        WaitableEvent done;
+        for (size_t i = 0; i < procs.size(); i++) {
+            pool.addJob([&, i] {
+                loadProcessor(i);
+                if (--pending == 0) {
+                    done.signal();
+                }
+            });
+        }
+        done.wait(-1);
+    } else {
+        for (size_t i = 0; i < procs.size(); i++) {
+            loadProcessor(i);
+        }
+    }
+    for (auto& proc : procs) {
+        if (nullptr != proc) {
+            addProcessor(proc);
+        }
+    }
+    return procs;
+}
+
 void ProcessorChain::addProcessor(std::shared_ptr<AGProcessor> processor) {
     traceScope();
     std::lock_guard<std::mutex> lock(m_processors_mtx);
     processor->setChainIndex((int)m_processors.size());
     m_processors.push_back(processor);
+    publishNoLock();
     updateNoLock();
 }
 
@@ -538,6 +672,9 @@ void ProcessorChain::delProcessor(int idx) {
             break;
         }
     }
+    publishNoLock();
+    // make sure the removed processor is released now
+    reclaimSnapshotsNoLock(true);
     updateNoLock();
 }
 
@@ -553,14 +690,32 @@ void ProcessorChain::updateNoLock() {
     bool supportsDouble = true;
     m_extraChannels = 0;
     m_sidechainDisabled = false;
+    for (auto& stage : m_snapshot.load()->stages) {
+        if (nullptr != stage.proc) {
+            latency += stage.proc->getLatencySamples();
+        } else {
+            int sectionLatency = 0;
+            for (auto& branch : stage.branches) {
+                int branchLatency = 0;
+                for (auto* proc : branch->procs) {
+                    branchLatency += proc->getLatencySamples();
+                }
+                sectionLatency = jmax(sectionLatency, branchLatency);
+            }
+            latency += sectionLatency;
+        }
+    }
+    auto segments = m_snapshot.load()->segments.size();
+    if (segments > 1) {
+        latency += (int)(segments - 1) * getBlockSize();
+    }
     for (auto& proc : m_processors) {
         auto p = proc->getPlugin();
         if (nullptr != p) {
-            latency += p->getLatencySamples();
             if (!p->supportsDoublePrecisionProcessing()) {
                 supportsDouble = false;
             }
-            m_extraChannels = jmax(m_extraChannels, proc->getExtraInChannels(), proc->getExtraOutChannels());
+            m_extraChannels = jmax(m_extraChannels.load(), proc->getExtraInChannels(), proc->getExtraOutChannels());
             m_sidechainDisabled = m_hasSidechain && (m_sidechainDisabled || proc->getNeedsDisabledSidechain());
         }
     }
@@ -596,6 +751,29 @@ void ProcessorChain::exchangeProcessors(int idxA, int idxB) {
         std::swap(m_processors[(size_t)idxA], m_processors[(size_t)idxB]);
         m_processors[(size_t)idxA]->setChainIndex(idxA);
         m_processors[(size_t)idxB]->setChainIndex(idxB);
+        publishNoLock();
+        updateNoLock();
+    }
+}
+
+void ProcessorChain::setBranch(int idx, int branch) {
+    traceScope();
+    std::lock_guard<std::mutex> lock(m_processors_mtx);
+    if (idx > -1 && (size_t)idx < m_processors.size()) {
+        m_processors[(size_t)idx]->setBranch(jmax(0, branch));
+        publishNoLock();
+        updateNoLock();
+    }
+}
+
+void ProcessorChain::setPipelineSegments(int num) {
+    traceScope();
+    std::lock_guard<std::mutex> lock(m_processors_mtx);
+    if (num != m_pipelineSegments) {
+        logln("setting pipeline segments to " << num);
+        m_pipelineSegments = num;
+        publishNoLock();
+        updateNoLock();
     }
 }
 
@@ -620,23 +798,399 @@ void ProcessorChain::clear() {
     releaseResources();
     std::lock_guard<std::mutex> lock(m_processors_mtx);
     m_processors.clear();
+    publishNoLock();
+    reclaimSnapshotsNoLock(true);
+}
+
+void ProcessorChain::publishNoLock() {
+    traceScope();
+    auto* snapshot = new Snapshot;
+    snapshot->processors = m_processors;
+    int channels = jmax(getTotalNumInputChannels(), getTotalNumOutputChannels()) + m_extraChannels;
+    int prevBranch = 0;
+    for (auto& proc : m_processors) {
+        int branchId = proc->getBranch();
+        if (branchId == 0) {
+            snapshot->stages.emplace_back();
+            snapshot->stages.back().proc = proc.get();
+        } else {
+            if (prevBranch == 0) {
+                snapshot->stages.emplace_back();
+            }
+            auto& branches = snapshot->stages.back().branches;
+            auto it = std::find_if(branches.begin(), branches.end(),
+                                   [branchId](const std::unique_ptr<Branch>& b) { return b->id == branchId; });
+            if (it == branches.end()) {
+                auto branch = std::make_unique<Branch>();
+                branch->id = branchId;
+                // allocate the buffers up front, so the audio thread does not have to
+                if (branches.size() > 0 && getBlockSize() > 0) {
+                    if (isUsingDoublePrecision()) {
+                        branch->bufferD.setSize(channels, getBlockSize());
+                    } else {
+                        branch->bufferF.setSize(channels, getBlockSize());
+                    }
+                    branch->midi.ensureSize(4096);
+                }
+                branches.push_back(std::move(branch));
+                it = branches.end() - 1;
+            }
+            (*it)->procs.push_back(proc.get());
+            if (nullptr == snapshot->stages.back().branchesDone) {
+                snapshot->stages.back().branchesDone = std::make_unique<Semaphore>(AudioScheduler::SPIN_MICROSECONDS);
+            }
+        }
+        prevBranch = branchId;
+    }
+    // a section with a single branch is just serial processing
+    std::vector<Stage> stages;
+    for (auto& stage : snapshot->stages) {
+        if (stage.branches.size() == 1) {
+            for (auto* proc : stage.branches[0]->procs) {
+                stages.emplace_back();
+                stages.back().proc = proc;
+            }
+        } else {
+            stages.push_back(std::move(stage));
+        }
+    }
+    snapshot->stages = std::move(stages);
+    for (auto& stage : snapshot->stages) {
+        for (size_t i = 1; i < stage.branches.size(); i++) {
+            stage.branches[i]->job.entries = &snapshot->queuedJobs;
+            stage.branchJobs.push_back(&stage.branches[i]->job);
+        }
+    }
+    reserveBranchDelays(*snapshot);
+    auto* current = m_snapshot.load();
+    initPipelineNoLock(*snapshot, *current);
+    if (!snapshot->segments.empty() && !current->segments.empty()) {
+        // a snapshot, that has not been processed yet, passes on the blocks in flight of its predecessor
+        int pending = Snapshot::HANDOVER_PENDING;
+        if (current->handover.compare_exchange_strong(pending, Snapshot::HANDOVER_DONE)) {
+            snapshot->previous = current->previous;
+        } else {
+            snapshot->previous = current;
+        }
+        snapshot->handover = Snapshot::HANDOVER_PENDING;
+    }
+    auto* old = m_snapshot.exchange(snapshot);
+    m_retiredSnapshots.push_back({std::unique_ptr<Snapshot>(old), m_epoch.load()});
+    reclaimSnapshotsNoLock(false);
+}
+
+void ProcessorChain::reserveBranchDelays(Snapshot& snapshot) {
+    traceScope();
+    int channels = jmax(getTotalNumInputChannels(), getTotalNumOutputChannels()) + m_extraChannels;
+    int blockSize = jmax(0, getBlockSize());
+    for (auto& stage : snapshot.stages) {
+        // a branch is delayed by the difference to the slowest branch at most
+        int latency = 0;
+        for (auto& branch : stage.branches) {
+            int branchLatency = 0;
+            for (auto* proc : branch->procs) {
+                branchLatency += proc->getLatencySamples();
+            }
+            latency = jmax(latency, branchLatency);
+        }
+        for (auto& branch : stage.branches) {
+            if (isUsingDoublePrecision()) {
+                branch->delayD.reserve(channels, blockSize, latency);
+            } else {
+                branch->delayF.reserve(channels, blockSize, latency);
+            }
+        }
+    }
+}
+
+void ProcessorChain::processorLatencyChanged() {
+    traceScope();
+    SnapshotReader reader(*this);
+    reserveBranchDelays(reader.get());
+}
+
+void ProcessorChain::initPipelineNoLock(Snapshot& snapshot, const Snapshot& current) {
+    traceScope();
+    size_t num = (size_t)jmin(m_pipelineSegments, (int)snapshot.stages.size());
+    if (num < 2 || nullptr == m_scheduler) {
+        return;
+    }
+    int channels = jmax(getTotalNumInputChannels(), getTotalNumOutputChannels()) + m_extraChannels;
+    int blockSize = jmax(0, getBlockSize());
+    for (size_t i = 0; i < num; i++) {
+        auto segment = std::make_unique<Segment>();
+        segment->chain = this;
+        segment->snapshot = &snapshot;
+        if (i > 0) {
+            if (isUsingDoublePrecision()) {
+                segment->bufferD.setSize(channels, blockSize);
+                segment->bufferD.clear();
+            } else {
+                segment->bufferF.setSize(channels, blockSize);
+                segment->bufferF.clear();
+            }
+            segment->midi.ensureSize(4096);
+            segment->job.entries = &snapshot.queuedJobs;
+            snapshot.segmentJobs.push_back(&segment->job);
+        }
+        snapshot.segments.push_back(std::move(segment));
+    }
+    if (isUsingDoublePrecision()) {
+        snapshot.spareD.setSize(channels, blockSize);
+    } else {
+        snapshot.spareF.setSize(channels, blockSize);
+    }
+    snapshot.spareMidi.ensureSize(4096);
+    snapshot.stageCosts.resize(snapshot.stages.size());
+    snapshot.bounds.resize(num + 1);
+    if (current.segments.size() == num && sameStages(current, snapshot)) {
+        // moving the boundaries would drop the blocks in flight
+        for (size_t i = 0; i < num; i++) {
+            snapshot.bounds[i] = current.segments[i]->begin;
+        }
+        snapshot.bounds[num] = snapshot.stages.size();
+    } else {
+        updateStageCosts(snapshot);
+        partition(snapshot);
+    }
+    for (size_t i = 0; i < num; i++) {
+        snapshot.segments[i]->begin = snapshot.bounds[i];
+        snapshot.segments[i]->end = snapshot.bounds[i + 1];
+    }
+    snapshot.blocksUntilFadeIn = (int)num;
+}
+
+void ProcessorChain::updateStageCosts(Snapshot& snapshot) {
+    for (size_t i = 0; i < snapshot.stages.size(); i++) {
+        auto& stage = snapshot.stages[i];
+        double cost = 0;
+        if (nullptr != stage.proc) {
+            cost = stage.proc->getProcessingTime();
+        } else {
+            // the branches run in parallel
+            for (auto& branch : stage.branches) {
+                double branchCost = 0;
+                for (auto* proc : branch->procs) {
+                    branchCost += proc->getProcessingTime();
+                }
+                cost = jmax(cost, branchCost);
+            }
+        }
+        snapshot.stageCosts[i] = cost;
+    }
+}
+
+void ProcessorChain::partition(Snapshot& snapshot) {
+    auto& costs = snapshot.stageCosts;
+    auto& bounds = snapshot.bounds;
+    size_t numStages = costs.size();
+    size_t numSegments = bounds.size() - 1;
+    double total = 0;
+    for (auto c : costs) {
+        total += c;
+    }
+    // without measurements yet, split by the number of stages
+    bool byCount = total <= 0;
+    auto getCost = [&](size_t i) { return byCount ? 1.0 : costs[i]; };
+    if (byCount) {
+        total = (double)numStages;
+    }
+    // cut before a stage, once its center is beyond the share of the current segment, but leave at least one stage
+    // for each of the remaining segments
+    size_t seg = 0;
+    double sum = 0;
+    bounds[0] = 0;
+    for (size_t i = 0; i < numStages; i++) {
+        if (seg < numSegments - 1 && i > bounds[seg]) {
+            bool mustCut = numStages - i == numSegments - 1 - seg;
+            bool shouldCut = sum + getCost(i) / 2 > total * (double)(seg + 1) / (double)numSegments;
+            if (mustCut || shouldCut) {
+                bounds[++seg] = i;
+            }
+        }
+        sum += getCost(i);
+    }
+    bounds[numSegments] = numStages;
+}
+
+bool ProcessorChain::sameStage(const Stage& a, const Stage& b) {
+    if (a.proc != b.proc || a.branches.size() != b.branches.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.branches.size(); i++) {
+        if (a.branches[i]->procs != b.branches[i]->procs) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ProcessorChain::sameStages(const Snapshot& a, const Snapshot& b) {
+    if (a.stages.size() != b.stages.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.stages.size(); i++) {
+        if (!sameStage(a.stages[i], b.stages[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ProcessorChain::samePartitioning(const Snapshot& a, const Snapshot& b) {
+    if (a.segments.size() != b.segments.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.segments.size(); i++) {
+        auto& segA = *a.segments[i];
+        auto& segB = *b.segments[i];
+        if (segA.end - segA.begin != segB.end - segB.begin) {
+            return false;
+        }
+        for (size_t s = 0; s < segA.end - segA.begin; s++) {
+            if (!sameStage(a.stages[segA.begin + s], b.stages[segB.begin + s])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void ProcessorChain::reclaimSnapshotsNoLock(bool waitForReaders) {
+    traceScope();
+    int waitedMs = 0;
+    while (!m_retiredSnapshots.empty()) {
+        auto epoch = m_epoch.load();
+        // snapshots, that still hand over their blocks in flight to a successor
+        std::vector<Snapshot*> handingOver;
+        auto* current = m_snapshot.load();
+        if (nullptr != current && current->handover != Snapshot::HANDOVER_DONE) {
+            handingOver.push_back(current->previous);
+        }
+        for (auto& r : m_retiredSnapshots) {
+            if (r.snapshot->handover != Snapshot::HANDOVER_DONE) {
+                handingOver.push_back(r.snapshot->previous);
+            }
+        }
+        // queue entries of jobs, that the audio thread processed itself, are skipped by the pool threads later
+        m_retiredSnapshots.erase(
+            std::remove_if(m_retiredSnapshots.begin(), m_retiredSnapshots.end(),
+                           [&](const RetiredSnapshot& r) {
+                               bool noReaders = r.epoch + 1 < epoch ||
+                                                (r.epoch + 1 == epoch && m_epochReaders[r.epoch & 1] == 0);
+                               return noReaders && r.snapshot->queuedJobs == 0 &&
+                                      std::find(handingOver.begin(), handingOver.end(), r.snapshot.get()) ==
+                                          handingOver.end();
+                           }),
+            m_retiredSnapshots.end());
+        if (m_retiredSnapshots.empty()) {
+            break;
+        }
+        if (waitForReaders && waitedMs >= HANDOVER_TIMEOUT_MS && nullptr != current) {
+            // the chain is not processed, so the blocks in flight are dropped
+            int pending = Snapshot::HANDOVER_PENDING;
+            current->handover.compare_exchange_strong(pending, Snapshot::HANDOVER_DONE);
+        }
+        // readers, that start in a new epoch, see the current snapshot only
+        bool needsEpoch = std::any_of(m_retiredSnapshots.begin(), m_retiredSnapshots.end(),
+                                      [epoch](const RetiredSnapshot& r) { return r.epoch == epoch; });
+        if (needsEpoch && m_epochReaders[(epoch + 1) & 1] == 0) {
+            m_epoch = epoch + 1;
+        } else if (waitForReaders) {
+            // only readers, that started before the snapshot has been retired, are waited for
+            Thread::sleep(1);
+            waitedMs++;
+        } else {
+            break;
+        }
+    }
+}
+
+json ProcessorChain::getLoad() {
+    traceScope();
+    auto j = json::array();
+    SnapshotReader reader(*this);
+    for (auto& proc : reader.get().processors) {
+        j.push_back({{"name", proc->getName().toStdString()},
+                     {"load", proc->isSuspended() ? 0.0 : proc->getLoad()},
+                     {"peak", proc->getPeakLoad()}});
+    }
+    return j;
+}
+
+void ProcessorChain::markSlowestProcessor() {
+    SnapshotReader reader(*this);
+    AGProcessor* slowest = nullptr;
+    double maxTime = -1;
+    for (auto& proc : reader.get().processors) {
+        double t = proc->getLastProcessingTime();
+        if (!proc->isSuspended() && t > maxTime) {
+            maxTime = t;
+            slowest = proc.get();
+        }
+    }
+    if (nullptr != slowest) {
+        slowest->setLastXrun(++m_xruns);
+    }
+}
+
+std::shared_ptr<AGProcessor> ProcessorChain::getXrunProcessor() {
+    traceScope();
+    SnapshotReader reader(*this);
+    std::shared_ptr<AGProcessor> ret;
+    uint64 latest = 0;
+    for (auto& proc : reader.get().processors) {
+        if (proc->getLastXrun() > latest) {
+            latest = proc->getLastXrun();
+            ret = proc;
+        }
+    }
+    return ret;
+}
+
+int64 ProcessorChain::getFingerprint() {
+    SnapshotReader reader(*this);
+    StringArray ids;
+    for (auto& proc : reader.get().processors) {
+        ids.add(proc->getId());
+    }
+    return ResumeRequest::getChainFingerprint(ids);
+}
+
+json ProcessorChain::getLoadOfAllChains() {
+    auto j = json::array();
+    std::lock_guard<std::mutex> lock(m_chainsMtx);
+    for (auto* chain : m_chains) {
+        j.push_back({{"client", chain->getLogTagExtra().toStdString()}, {"plugins", chain->getLoad()}});
+    }
+    return j;
 }
 
 String ProcessorChain::toString() {
     traceScope();
     String ret;
-    std::lock_guard<std::mutex> lock(m_processors_mtx);
+    // called from the audio thread as well
+    SnapshotReader reader(*this);
+    auto getName = [](AGProcessor* proc) { return proc->isSuspended() ? String("<bypassed>") : proc->getName(); };
     bool first = true;
-    for (auto& proc : m_processors) {
+    for (auto& stage : reader.get().stages) {
         if (!first) {
             ret << " > ";
         } else {
             first = false;
         }
-        if (proc->isSuspended()) {
-            ret << "<bypassed>";
+        if (nullptr != stage.proc) {
+            ret << getName(stage.proc);
         } else {
-            ret << proc->getName();
+            StringArray branches;
+            for (auto& branch : stage.branches) {
+                StringArray names;
+                for (auto* proc : branch->procs) {
+                    names.add(getName(proc));
+                }
+                branches.add(names.joinIntoString(" > "));
+            }
+            ret << "[" << branches.joinIntoString(" | ") << "]";
         }
     }
     return ret;
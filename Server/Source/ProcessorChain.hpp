@@ -9,15 +9,19 @@
 #define ProcessorChain_hpp
 
 #include <JuceHeader.h>
+#include <set>
+#include <thread>
 
 #include "Utils.hpp"
 #include "Defaults.hpp"
+#include "BypassDelay.hpp"
+#include "AudioScheduler.hpp"
 
 namespace e47 {
 
 class ProcessorChain;
 
-class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Listener {
+class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Listener, public AudioProcessorListener {
   public:
     static std::atomic_uint32_t loadedCount;
 
@@ -27,6 +31,8 @@ class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Liste
     static String createPluginID(const PluginDescription& d);
     static String convertJUCEtoAGPluginID(const String& id);
 
+    const String& getId() const { return m_id; }
+
     inline static String createString(const PluginDescription& d) {
         json j = {{"name", d.name.toStdString()},          {"company", d.manufacturerName.toStdString()},
                   {"id", createPluginID(d).toStdString()}, {"type", d.pluginFormatName.toStdString()},
@@ -69,27 +75,18 @@ class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Liste
     bool load(String& err);
     void unload();
 
+    // Held while loading a plugin, if parallel loading is disabled
+    static std::mutex& getPluginLoaderMtx() { return m_pluginLoaderMtx; }
+
     void setChainIndex(int idx) { m_chainIdx = idx; }
 
-    template <typename T>
-    bool processBlock(AudioBuffer<T>& buffer, MidiBuffer& midiMessages) {
-        traceScope();
-        auto p = getPlugin();
-        if (nullptr != p) {
-            if (!p->isSuspended()) {
-                p->processBlock(buffer, midiMessages);
-            } else {
-                if (m_lastKnownLatency > 0) {
-                    processBlockBypassed(buffer);
-                }
-            }
-            return true;
-        }
-        return false;
-    }
+    // 0 means serial processing, see ProcessorChain::setBranch
+    int getBranch() const { return m_branch; }
+    void setBranch(int branch) { m_branch = branch; }
 
-    void processBlockBypassed(AudioBuffer<float>& buffer);
-    void processBlockBypassed(AudioBuffer<double>& buffer);
+    // Called by the chain for processors of the current snapshot, so the plugin can't be unloaded while processing
+    bool processBlock(AudioBuffer<float>& buffer, MidiBuffer& midiMessages);
+    bool processBlock(AudioBuffer<double>& buffer, MidiBuffer& midiMessages);
 
     void prepareToPlay(double sampleRate, int maximumExpectedSamplesPerBlock) {
         traceScope();
@@ -97,6 +94,7 @@ class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Liste
         if (nullptr != p) {
             p->prepareToPlay(sampleRate, maximumExpectedSamplesPerBlock);
             m_prepared = true;
+            reserveBypassDelay(maximumExpectedSamplesPerBlock);
         }
     }
 
@@ -109,19 +107,21 @@ class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Liste
         }
     }
 
-    int getLatencySamples() {
-        traceScope();
-        auto p = getPlugin();
-        if (nullptr != p) {
-            int latency = p->getLatencySamples();
-            if (latency != m_lastKnownLatency) {
-                m_lastKnownLatency = latency;
-                updateLatencyBuffers();
-            }
-            return latency;
-        }
-        return 0;
-    }
+    int getLatencySamples() const { return m_latency.load(std::memory_order_relaxed); }
+
+    // Average time in milliseconds the processor needs for a block
+    double getProcessingTime() const { return m_processingTime.load(std::memory_order_relaxed); }
+
+    // Time in milliseconds the processor needed for the last block
+    double getLastProcessingTime() const { return m_lastProcessingTime.load(std::memory_order_relaxed); }
+
+    // Number of the last xrun of the chain, while this processor was the slowest one, 0 if none
+    uint64 getLastXrun() const { return m_lastXrun.load(std::memory_order_relaxed); }
+    void setLastXrun(uint64 n) { m_lastXrun.store(n, std::memory_order_relaxed); }
+
+    // DSP load in percent of the block period, as moving average and as slowly decaying peak
+    double getLoad() const { return m_load.load(std::memory_order_relaxed); }
+    double getPeakLoad() const { return m_peakLoad.load(std::memory_order_relaxed); }
 
     const String getName() {
         traceScope();
@@ -141,14 +141,7 @@ class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Liste
         return false;
     }
 
-    bool isSuspended() {
-        traceScope();
-        auto p = getPlugin();
-        if (nullptr != p) {
-            return p->isSuspended();
-        }
-        return true;
-    }
+    bool isSuspended() const { return nullptr == m_processingPlugin || m_suspended; }
 
     double getTailLengthSeconds() {
         traceScope();
@@ -193,8 +186,9 @@ class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Liste
         }
     }
 
+    // Suspending crossfades to the delayed dry signal before the plugin gets released, resuming crossfades back to
+    // the plugin once it had the time to fill its latency
     void suspendProcessing(const bool shouldBeSuspended);
-    void updateLatencyBuffers();
 
     int getExtraInChannels() const { return m_extraInChannels; }
     int getExtraOutChannels() const { return m_extraOutChannels; }
@@ -227,9 +221,15 @@ class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Liste
         }
     }
 
+    // AudioProcessorListener
+    void audioProcessorChanged(AudioProcessor* processor, const ChangeDetails& details) override;
+
+    void audioProcessorParameterChanged(AudioProcessor*, int, float) override {}
+
   private:
     ProcessorChain& m_chain;
     int m_chainIdx = -1;
+    int m_branch = 0;
     String m_id;
     double m_sampleRate;
     int m_blockSize;
@@ -237,15 +237,48 @@ class AGProcessor : public LogTagDelegate, public AudioProcessorParameter::Liste
     static std::mutex m_pluginLoaderMtx;
     std::shared_ptr<AudioPluginInstance> m_plugin;
     std::mutex m_pluginMtx;
+    // The processing path uses the plugin without locking, it is set after loading and reset when unloading, which
+    // can only happen once the processor is not part of a chain snapshot anymore. Latency and suspension state are
+    // cached, the latency is updated by the plugin's change notifications.
+    AudioPluginInstance* m_processingPlugin = nullptr;
+    std::atomic_int m_latency{0};
+    std::atomic_bool m_suspended{false};
+    std::atomic<double> m_processingTime{0};
+    std::atomic<double> m_lastProcessingTime{0};
+    std::atomic<uint64> m_lastXrun{0};
+    std::atomic<double> m_load{0};
+    std::atomic<double> m_peakLoad{0};
     int m_additionalScreenSpace = 0;
     bool m_fullscreen = false;
     bool m_prepared = false;
     int m_extraInChannels = 0;
     int m_extraOutChannels = 0;
     bool m_needsDisabledSidechain = false;
-    Array<Array<float>> m_bypassBufferF;
-    Array<Array<double>> m_bypassBufferD;
-    int m_lastKnownLatency = 0;
+
+    // Bypass state, ACTIVE and BYPASSED are stable, the audio thread moves between them with one fade block. The
+    // command thread only waits for the transition, unless the audio thread is not processing.
+    enum BypassState { ACTIVE, FADING_OUT, BYPASSED, FADING_IN };
+    std::atomic_int m_bypassState{ACTIVE};
+    std::atomic_bool m_inProcessBlock{false};
+    int m_warmupSamples = 0;
+    BypassDelay<float> m_bypassDelayF;
+    BypassDelay<double> m_bypassDelayD;
+
+    BypassDelay<float>& getBypassDelay(float) { return m_bypassDelayF; }
+    BypassDelay<double>& getBypassDelay(double) { return m_bypassDelayD; }
+
+    // Allocates the delay line for the current latency, must not be called from the audio thread
+    void reserveBypassDelay(int samples);
+
+    template <typename T>
+    bool processBlockReal(AudioBuffer<T>& buffer, MidiBuffer& midiMessages);
+
+    template <typename T>
+    void processBlockBypassed(AudioBuffer<T>& buffer);
+
+    void waitForBypass();
+    void updateProcessingTime(int64 startTicks, int numSamples);
+    int getNumChannels() const;
     Point<int> m_lastPosition = {0, 0};
 };
 
@@ -263,7 +296,12 @@ class ProcessorChain : public AudioProcessor, public LogTagDelegate {
         AudioPlayHead::CurrentPositionInfo* m_posInfo;
     };
 
-    ProcessorChain(const BusesProperties& props) : AudioProcessor(props) {}
+    ProcessorChain(const BusesProperties& props)
+        : AudioProcessor(props), m_snapshot(new Snapshot), m_scheduler(AudioScheduler::getInstance()) {
+        std::lock_guard<std::mutex> lock(m_chainsMtx);
+        m_chains.insert(this);
+    }
+    ~ProcessorChain() override;
 
     static BusesProperties createBussesProperties(int in, int out, int sc) {
         setLogTagStatic("processorchain");
@@ -305,29 +343,253 @@ class ProcessorChain : public AudioProcessor, public LogTagDelegate {
     void getStateInformation(juce::MemoryBlock& /* destData */) override {}
     void setStateInformation(const void* /* data */, int /* sizeInBytes */) override {}
 
-    bool initPluginInstance(AGProcessor* proc, String& err);
+    // Plugins, that have been warmed up already, don't need to process the warm up blocks again
+    bool initPluginInstance(AGProcessor* proc, String& err, bool warmUp = true);
     bool addPluginProcessor(const String& id, String& err);
+
+    // Loads the plugins concurrently, if parallel plugin loading is enabled, and adds the loaded ones in the given
+    // order. Returns a processor for every ID, nullptr if loading failed. Up to MAX_PARALLEL_LOADS plugins are loaded
+    // at the same time.
+    std::vector<std::shared_ptr<AGProcessor>> addPluginProcessors(const StringArray& ids, StringArray& errors);
     void addProcessor(std::shared_ptr<AGProcessor> processor);
-    size_t getSize() const { return m_processors.size(); }
+    size_t getSize() {
+        SnapshotReader reader(*this);
+        return reader.get().processors.size();
+    }
     std::shared_ptr<AGProcessor> getProcessor(int index);
 
     void delProcessor(int idx);
     void exchangeProcessors(int idxA, int idxB);
+
+    // Consecutive processors with a branch > 0 form a parallel section. Processors with the same branch are processed
+    // in series within the section, the different branches get the same input, run concurrently on the audio
+    // scheduler pool and their outputs are summed up after compensating their latencies.
+    void setBranch(int idx, int branch);
+
+    // With concurrent branches disabled, the branches of a section are processed one after the other on the audio
+    // thread
+    void setConcurrentBranches(bool b) { m_concurrentBranches = b; }
+
+    // Pipelining splits the chain into up to the given number of segments, that process consecutive blocks
+    // concurrently on the audio scheduler pool. This adds one block of latency per additional segment. The segment
+    // boundaries follow the measured processing times of the plugins and only move, when the chain changes. 0 or 1
+    // disables pipelining.
+    void setPipelineSegments(int num);
+
+    // Called, when the latency of a processor changed, the branches of the parallel sections might need longer delay
+    // lines to stay aligned
+    void processorLatencyChanged();
+
     float getParameterValue(int idx, int paramIdx);
     void update();
     void clear();
     String toString();
 
+    // DSP load of every processor
+    json getLoad();
+
+    // DSP load of the processors of all chains
+    static json getLoadOfAllChains();
+
+    // Marks the processor, that took the longest for the last block, as cause of an xrun, audio thread only
+    void markSlowestProcessor();
+
+    // The processor, that has been marked for the latest xrun, or nullptr
+    std::shared_ptr<AGProcessor> getXrunProcessor();
+
+    // See ResumeRequest::getChainFingerprint
+    int64 getFingerprint();
+
   private:
-    std::vector<std::shared_ptr<AGProcessor>> m_processors;
+    using Processors = std::vector<std::shared_ptr<AGProcessor>>;
+
+    static std::mutex m_chainsMtx;
+    static std::set<ProcessorChain*> m_chains;
+
+    // The processors list is modified by the command threads only, m_processors_mtx serializes the modifications
+    Processors m_processors;
     std::mutex m_processors_mtx;
 
+    // A serial sub-chain of a parallel section, all but the first branch of a section work on their own buffers
+    struct Branch {
+        int id;
+        std::vector<AGProcessor*> procs;
+        AudioBuffer<float> bufferF;
+        AudioBuffer<double> bufferD;
+        MidiBuffer midi;
+        BypassDelay<float> delayF;
+        BypassDelay<double> delayD;
+        AudioScheduler::Client client;
+        AudioScheduler::Job job;
+        bool doublePrecision = false;
+        int latency = 0;
+
+        AudioBuffer<float>& getBuffer(float) { return bufferF; }
+        AudioBuffer<double>& getBuffer(double) { return bufferD; }
+        BypassDelay<float>& getDelay(float) { return delayF; }
+        BypassDelay<double>& getDelay(double) { return delayD; }
+
+        template <typename T>
+        void process(AudioBuffer<T>& buffer, MidiBuffer& midiMessages) {
+            latency = 0;
+            for (auto* proc : procs) {
+                if (proc->processBlock(buffer, midiMessages)) {
+                    latency += proc->getLatencySamples();
+                }
+            }
+        }
+
+        // called by the scheduler
+        void operator()() {
+            if (doublePrecision) {
+                process(bufferD, midi);
+            } else {
+                process(bufferF, midi);
+            }
+        }
+    };
+
+    // A single processor or a parallel section
+    struct Stage {
+        AGProcessor* proc = nullptr;
+        std::vector<std::unique_ptr<Branch>> branches;
+        std::unique_ptr<Semaphore> branchesDone;
+        // the jobs of all but the first branch, the audio thread processes the ones, that no pool thread took yet
+        std::vector<AudioScheduler::Job*> branchJobs;
+    };
+
+    struct Snapshot;
+
+    // A range of stages, that processes the block it got from the previous segment in the previous cycle
+    struct Segment {
+        size_t begin = 0;
+        size_t end = 0;
+        AudioBuffer<float> bufferF;
+        AudioBuffer<double> bufferD;
+        MidiBuffer midi;
+        ProcessorChain* chain = nullptr;
+        Snapshot* snapshot = nullptr;
+        AudioScheduler::Client client;
+        AudioScheduler::Job job;
+        bool doublePrecision = false;
+        int latency = 0;
+
+        AudioBuffer<float>& getBuffer(float) { return bufferF; }
+        AudioBuffer<double>& getBuffer(double) { return bufferD; }
+
+        // called by the scheduler
+        void operator()() {
+            if (doublePrecision) {
+                latency = chain->processStages(*snapshot, begin, end, bufferD, midi);
+            } else {
+                latency = chain->processStages(*snapshot, begin, end, bufferF, midi);
+            }
+        }
+    };
+
+    struct Snapshot {
+        Processors processors;
+        std::vector<Stage> stages;
+
+        // pipelining state, the buffers of all segments but the first hold the blocks in flight
+        std::vector<std::unique_ptr<Segment>> segments;
+        std::vector<AudioScheduler::Job*> segmentJobs;
+        Semaphore segmentsDone{AudioScheduler::SPIN_MICROSECONDS};
+        AudioBuffer<float> spareF;
+        AudioBuffer<double> spareD;
+        MidiBuffer spareMidi;
+        std::vector<double> stageCosts;
+        std::vector<size_t> bounds;
+        // the output is silent until the first block, that went through all segments, comes out and gets faded in
+        int blocksUntilFadeIn = 0;
+
+        // A pipelined snapshot takes over the blocks in flight of the previous pipelined snapshot, when it gets
+        // processed for the first time. The previous snapshot is kept until then, unless the handover is cancelled,
+        // because the chain is not processed.
+        enum Handover { HANDOVER_PENDING, HANDOVER_RUNNING, HANDOVER_DONE };
+        Snapshot* previous = nullptr;
+        std::atomic_int handover{HANDOVER_DONE};
+
+        // queue entries of the branch and segment jobs, the snapshot can't be deleted before they have been taken
+        std::atomic_int queuedJobs{0};
+
+        AudioBuffer<float>& getSpare(float) { return spareF; }
+        AudioBuffer<double>& getSpare(double) { return spareD; }
+    };
+
+    // After each modification, a copy of the list is published as immutable snapshot, that the audio thread reads
+    // without locking. Replaced snapshots are retired and deleted by the modifying thread, so processors are never
+    // released on the audio thread. The branch buffers of a snapshot are only used by the audio thread.
+    //
+    // Readers are counted per epoch. A snapshot retired in an epoch can only be seen by readers of that epoch or
+    // earlier ones, so it is deleted once the epoch moved on and the readers of its epoch left. Readers, that start
+    // later, don't hold it back. The epoch only moves on after the readers of the previous epoch left, so two
+    // counters are enough.
+    std::atomic<Snapshot*> m_snapshot;
+    std::atomic<uint64> m_epoch{0};
+    std::atomic_int m_epochReaders[2] = {{0}, {0}};
+
+    struct RetiredSnapshot {
+        std::unique_ptr<Snapshot> snapshot;
+        uint64 epoch;
+    };
+    std::vector<RetiredSnapshot> m_retiredSnapshots;
+
+    class SnapshotReader {
+      public:
+        SnapshotReader(ProcessorChain& chain) {
+            while (true) {
+                auto epoch = chain.m_epoch.load();
+                m_readers = &chain.m_epochReaders[epoch & 1];
+                m_readers->fetch_add(1);
+                // if the epoch moved on meanwhile, the modifying thread might not have seen this reader
+                if (chain.m_epoch.load() == epoch) {
+                    break;
+                }
+                m_readers->fetch_sub(1);
+            }
+            m_snapshot = chain.m_snapshot.load();
+        }
+        ~SnapshotReader() { m_readers->fetch_sub(1); }
+        Snapshot& get() const { return *m_snapshot; }
+
+      private:
+        std::atomic_int* m_readers;
+        Snapshot* m_snapshot;
+    };
+
+    std::shared_ptr<AudioScheduler> m_scheduler;
+    bool m_concurrentBranches = true;
+    uint64 m_xruns = 0;
+    int m_pipelineSegments = 0;
+
+    static constexpr int MAX_PARALLEL_LOADS = 4;
+    // time to wait for the audio thread to take over the blocks in flight, before a snapshot is released anyway
+    static constexpr int HANDOVER_TIMEOUT_MS = 50;
+
+    void publishNoLock();
+    // Allocates the delay lines, that align the branches of the parallel sections, for the current latencies
+    void reserveBranchDelays(Snapshot& snapshot);
+    // Sets up the segments of a new snapshot. If the stages did not change, the boundaries of the current snapshot are
+    // kept, so that the blocks in flight can be handed over.
+    void initPipelineNoLock(Snapshot& snapshot, const Snapshot& current);
+
+    // Splits the stages into segments of similar cost by filling snapshot.bounds
+    static void partition(Snapshot& snapshot);
+    static void updateStageCosts(Snapshot& snapshot);
+    static bool sameStage(const Stage& a, const Stage& b);
+    static bool sameStages(const Snapshot& a, const Snapshot& b);
+    static bool samePartitioning(const Snapshot& a, const Snapshot& b);
+    void reclaimSnapshotsNoLock(bool waitForReaders);
+
     std::atomic_bool m_supportsDoublePrecission{true};
     std::atomic<double> m_tailSecs{0.0};
 
-    int m_extraChannels = 0;
+    std::atomic_int m_extraChannels{0};
     bool m_hasSidechain = false;
     bool m_sidechainDisabled = false;
+    // plugins loading concurrently negotiate their layouts one after the other
+    std::mutex m_layoutMtx;
 
     template <typename T>
     void processBlockReal(AudioBuffer<T>& buffer, MidiBuffer& midiMessages) {
@@ -337,11 +599,12 @@ class ProcessorChain : public AudioProcessor, public LogTagDelegate {
             auto sidechainBuffer = getBusBuffer(buffer, true, 1);
             sidechainBuffer.clear();
         }
-        std::lock_guard<std::mutex> lock(m_processors_mtx);
-        for (auto& proc : m_processors) {
-            if (proc->processBlock(buffer, midiMessages)) {
-                latency += proc->getLatencySamples();
-            }
+        SnapshotReader reader(*this);
+        auto& snapshot = reader.get();
+        if (snapshot.segments.empty()) {
+            latency = processStages(snapshot, 0, snapshot.stages.size(), buffer, midiMessages);
+        } else {
+            latency = processPipelined(snapshot, buffer, midiMessages);
         }
         if (latency != getLatencySamples()) {
             logln("updating latency samples to " << latency);
@@ -349,6 +612,168 @@ class ProcessorChain : public AudioProcessor, public LogTagDelegate {
         }
     }
 
+    // Returns the latency of the stages
+    template <typename T>
+    int processStages(Snapshot& snapshot, size_t begin, size_t end, AudioBuffer<T>& buffer, MidiBuffer& midiMessages) {
+        int latency = 0;
+        for (size_t i = begin; i < end; i++) {
+            auto& stage = snapshot.stages[i];
+            if (nullptr != stage.proc) {
+                if (stage.proc->processBlock(buffer, midiMessages)) {
+                    latency += stage.proc->getLatencySamples();
+                }
+            } else {
+                latency += processBranches(stage, buffer, midiMessages);
+            }
+        }
+        return latency;
+    }
+
+    // Returns the latency of the chain including the pipeline delay
+    template <typename T>
+    int processPipelined(Snapshot& snapshot, AudioBuffer<T>& buffer, MidiBuffer& midiMessages) {
+        traceScope();
+        int latency = 0;
+        if (nullptr != snapshot.previous && takeOverPipeline(snapshot, buffer, midiMessages, latency)) {
+            return latency;
+        }
+        latency = processSegments(snapshot, buffer, midiMessages);
+        if (snapshot.blocksUntilFadeIn > 0 && --snapshot.blocksUntilFadeIn == 0) {
+            buffer.applyGainRamp(0, buffer.getNumSamples(), (T)0, (T)1);
+        }
+        return latency;
+    }
+
+    // Takes over the blocks in flight from the previous snapshot, if the segments did not change. Otherwise the
+    // block is processed by the previous segments and faded out. Returns true in this case.
+    template <typename T>
+    bool takeOverPipeline(Snapshot& snapshot, AudioBuffer<T>& buffer, MidiBuffer& midiMessages, int& latency) {
+        int pending = Snapshot::HANDOVER_PENDING;
+        if (!snapshot.handover.compare_exchange_strong(pending, Snapshot::HANDOVER_RUNNING)) {
+            return false;
+        }
+        auto& previous = *snapshot.previous;
+        bool fadedOut = false;
+        if (samePartitioning(previous, snapshot)) {
+            for (size_t i = 1; i < snapshot.segments.size(); i++) {
+                std::swap(previous.segments[i]->getBuffer(T()), snapshot.segments[i]->getBuffer(T()));
+                previous.segments[i]->midi.swapWith(snapshot.segments[i]->midi);
+                snapshot.segments[i]->latency = previous.segments[i]->latency;
+            }
+            snapshot.blocksUntilFadeIn = previous.blocksUntilFadeIn;
+        } else {
+            latency = processSegments(previous, buffer, midiMessages);
+            buffer.applyGainRamp(0, buffer.getNumSamples(), (T)1, (T)0);
+            fadedOut = true;
+        }
+        // the previous snapshot can be deleted after this
+        snapshot.handover = Snapshot::HANDOVER_DONE;
+        return fadedOut;
+    }
+
+    template <typename T>
+    int processSegments(Snapshot& snapshot, AudioBuffer<T>& buffer, MidiBuffer& midiMessages) {
+        auto& segments = snapshot.segments;
+        int channels = buffer.getNumChannels();
+        int samples = buffer.getNumSamples();
+        double blockMs = getSampleRate() > 0 ? samples * 1000.0 / getSampleRate() : 0;
+        int queued = 0;
+        for (size_t i = 1; i < segments.size(); i++) {
+            auto& segment = *segments[i];
+            segment.getBuffer(T()).setSize(channels, samples, true, true, true);
+            segment.doublePrecision = std::is_same<T, double>::value;
+            AudioScheduler::prepareJob(segment.job, segment.client, &snapshot.segmentsDone, blockMs, segment);
+            if (nullptr != m_scheduler && m_scheduler->enqueue(segment.job)) {
+                queued++;
+            } else {
+                segment();
+            }
+        }
+        auto& first = *segments[0];
+        first.latency = processStages(snapshot, first.begin, first.end, buffer, midiMessages);
+        if (queued > 0) {
+            m_scheduler->wait(snapshot.segmentsDone, queued, snapshot.segmentJobs.data(), snapshot.segmentJobs.size());
+        }
+
+        // move every block on to the next segment, the block of the last segment is the output
+        for (size_t i = segments.size() - 1; i > 1; i--) {
+            std::swap(segments[i]->getBuffer(T()), segments[i - 1]->getBuffer(T()));
+            segments[i]->midi.swapWith(segments[i - 1]->midi);
+        }
+        auto& second = *segments[1];
+        auto& spare = snapshot.getSpare(T());
+        spare.setSize(channels, samples, false, false, true);
+        for (int c = 0; c < channels; c++) {
+            spare.copyFrom(c, 0, buffer, c, 0, samples);
+            buffer.copyFrom(c, 0, second.getBuffer(T()), c, 0, samples);
+        }
+        std::swap(spare, second.getBuffer(T()));
+        snapshot.spareMidi.clear();
+        snapshot.spareMidi.addEvents(midiMessages, 0, samples, 0);
+        midiMessages.clear();
+        midiMessages.addEvents(second.midi, 0, samples, 0);
+        second.midi.swapWith(snapshot.spareMidi);
+
+        int latency = (int)(segments.size() - 1) * samples;
+        for (auto& segment : segments) {
+            latency += segment->latency;
+        }
+        return latency;
+    }
+
+    // Returns the latency of the section
+    template <typename T>
+    int processBranches(Stage& stage, AudioBuffer<T>& buffer, MidiBuffer& midiMessages) {
+        traceScope();
+        int channels = buffer.getNumChannels();
+        int samples = buffer.getNumSamples();
+        double blockMs = getSampleRate() > 0 ? samples * 1000.0 / getSampleRate() : 0;
+        int queued = 0;
+        for (size_t i = 1; i < stage.branches.size(); i++) {
+            auto& branch = *stage.branches[i];
+            auto& branchBuffer = branch.getBuffer(T());
+            branchBuffer.setSize(channels, samples, false, false, true);
+            for (int c = 0; c < channels; c++) {
+                branchBuffer.copyFrom(c, 0, buffer, c, 0, samples);
+            }
+            branch.midi.clear();
+            branch.midi.addEvents(midiMessages, 0, samples, 0);
+            branch.doublePrecision = std::is_same<T, double>::value;
+            AudioScheduler::prepareJob(branch.job, branch.client, stage.branchesDone.get(), blockMs, branch);
+            if (m_concurrentBranches && nullptr != m_scheduler && m_scheduler->enqueue(branch.job)) {
+                queued++;
+            } else {
+                branch();
+            }
+        }
+        // the first branch works on the buffer itself
+        auto& first = *stage.branches[0];
+        first.process(buffer, midiMessages);
+        if (queued > 0) {
+            m_scheduler->wait(*stage.branchesDone, queued, stage.branchJobs.data(), stage.branchJobs.size());
+        }
+        int latency = 0;
+        for (auto& branch : stage.branches) {
+            latency = jmax(latency, branch->latency);
+        }
+        for (size_t i = 0; i < stage.branches.size(); i++) {
+            auto& branch = *stage.branches[i];
+            auto& branchBuffer = i == 0 ? buffer : branch.getBuffer(T());
+            auto& delay = branch.getDelay(T());
+            int delaySamples = latency - branch.latency;
+            if (delaySamples > 0 || delay.getLatency() > 0) {
+                delay.prepare(samples, delaySamples);
+                delay.process(branchBuffer);
+            }
+            if (i > 0) {
+                for (int c = 0; c < channels; c++) {
+                    buffer.addFrom(c, 0, branchBuffer, c, 0, samples);
+                }
+            }
+        }
+        return latency;
+    }
+
     template <typename T>
     void preProcessBlocks(std::shared_ptr<AudioPluginInstance> inst) {
         traceScope();
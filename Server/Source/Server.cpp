@@ -11,6 +11,9 @@
 #include "Metrics.hpp"
 #include "ServiceResponder.hpp"
 #include "CPUInfo.hpp"
+#include "SocketReactor.hpp"
+#include "AudioScheduler.hpp"
+#include "PluginPool.hpp"
 #include "WindowPositions.hpp"
 #include "ChannelSet.hpp"
 #include "Sentry.hpp"
@@ -39,8 +42,25 @@ void Server::initialize() {
     loadConfig();
     Metrics::initialize();
     CPUInfo::initialize();
+    SocketReactor::initialize();
     WindowPositions::initialize();
 
+    // with sandboxing the chains are processed by the sandbox processes, the pool is needed there for the audio
+    // workers, concurrent branches and pipelining only
+    bool processesAudio = !m_sandboxing || getOpt("sandboxMode", false);
+    m_audioSchedulerStarted = processesAudio && (m_audioScheduler || m_chainBranches || m_chainPipelining);
+    if (m_audioSchedulerStarted) {
+        AudioScheduler::initialize([this](std::shared_ptr<AudioScheduler> s) { s->start(m_audioSchedulerThreads); });
+    }
+    // sandboxes process a single chain each, so their audio workers keep their own thread
+    m_audioSchedulerEnabled = m_audioScheduler && m_audioSchedulerStarted && !getOpt("sandboxMode", false);
+
+    // the plugins of a sandbox are loaded by the sandbox process
+    m_pluginPoolEnabled = m_pluginPool && !m_sandboxing && !getOpt("sandboxMode", false);
+    if (m_pluginPoolEnabled) {
+        PluginPool::initialize([this](std::shared_ptr<PluginPool> p) { p->start(m_pluginPoolSize); });
+    }
+
     if (!getOpt("sandboxMode", false)) {
         Metrics::getStatistic<TimeStatistic>("audio")->enableExtData(true);
         Metrics::getStatistic<TimeStatistic>("audio")->getMeter().enableExtData(true);
@@ -131,6 +151,14 @@ void Server::loadConfig() {
     }
     m_scanForPlugins = jsonGetValue(cfg, "ScanForPlugins", m_scanForPlugins);
     m_parallelPluginLoad = jsonGetValue(cfg, "ParallelPluginLoad", m_parallelPluginLoad);
+    m_pluginPool = jsonGetValue(cfg, "PluginPool", m_pluginPool);
+    m_pluginPoolSize = jsonGetValue(cfg, "PluginPoolSize", m_pluginPoolSize);
+    m_audioScheduler = jsonGetValue(cfg, "AudioScheduler", m_audioScheduler);
+    m_audioSchedulerThreads = jsonGetValue(cfg, "AudioSchedulerThreads", m_audioSchedulerThreads);
+    m_chainBranches = jsonGetValue(cfg, "ChainBranches", m_chainBranches);
+    m_chainPipelining = jsonGetValue(cfg, "ChainPipelining", m_chainPipelining);
+    m_chainPipelineSegments = jsonGetValue(cfg, "ChainPipelineSegments", m_chainPipelineSegments);
+    m_sharedMemoryAudio = jsonGetValue(cfg, "SharedMemoryAudio", m_sharedMemoryAudio);
     m_crashReporting = jsonGetValue(cfg, "CrashReporting", m_crashReporting);
     logln("crash reporting is " << (m_crashReporting ? "enabled" : "disabled"));
     m_sandboxing = jsonGetValue(cfg, "Sandboxing", m_sandboxing);
@@ -182,6 +210,14 @@ void Server::saveConfig() {
     }
     j["ScanForPlugins"] = m_scanForPlugins;
     j["ParallelPluginLoad"] = m_parallelPluginLoad;
+    j["PluginPool"] = m_pluginPool;
+    j["PluginPoolSize"] = m_pluginPoolSize;
+    j["AudioScheduler"] = m_audioScheduler;
+    j["AudioSchedulerThreads"] = m_audioSchedulerThreads;
+    j["ChainBranches"] = m_chainBranches;
+    j["ChainPipelining"] = m_chainPipelining;
+    j["ChainPipelineSegments"] = m_chainPipelineSegments;
+    j["SharedMemoryAudio"] = m_sharedMemoryAudio;
     j["CrashReporting"] = m_crashReporting;
     j["Sandboxing"] = m_sandboxing;
     j["SandboxLogAutoclean"] = m_sandboxLogAutoclean;
@@ -297,6 +333,14 @@ Server::~Server() {
     Metrics::cleanup();
     ServiceResponder::cleanup();
     CPUInfo::cleanup();
+    SocketReactor::cleanup();
+    if (m_audioSchedulerStarted) {
+        // run what is left in the queues, before the pool goes away
+        AudioScheduler::cleanup([](std::shared_ptr<AudioScheduler> s) { s->stop(); });
+    }
+    if (m_pluginPoolEnabled) {
+        PluginPool::cleanup();
+    }
     WindowPositions::cleanup();
     logln("server terminated");
     if (!getOpt("sandboxMode", false)) {
@@ -312,15 +356,25 @@ void Server::shutdown() {
     if (!getOpt("sandboxMode", false)) {
         m_masterSocket.close();
     }
-    logln("shutting down " << m_workers.size() << " workers");
-    for (auto& w : m_workers) {
+    WorkerList workers;
+    {
+        std::lock_guard<std::mutex> lock(m_workersMtx);
+        workers = m_workers;
+    }
+    logln("shutting down " << workers.size() << " workers");
+    for (auto& w : workers) {
         logln("shutting down worker, isRunning=" << (int)w->isThreadRunning());
         w->shutdown();
     }
-    logln("waiting for " << m_workers.size() << " workers");
-    for (auto& w : m_workers) {
+    logln("waiting for " << workers.size() << " workers");
+    for (auto& w : workers) {
         w->waitForThreadToExit(-1);
     }
+    if (m_pluginPoolEnabled) {
+        if (auto pool = PluginPool::getInstance()) {
+            pool->drain();
+        }
+    }
     signalThreadShouldExit();
     logln("thread signaled");
 }
@@ -629,149 +683,12 @@ void Server::runServer() {
     logln("creating listener " << (m_host.length() == 0 ? "*" : m_host) << ":" << (m_port + getId()));
     if (m_masterSocket.createListener(m_port + getId(), m_host)) {
         logln("server started: ID=" << getId() << ", PORT=" << m_port + getId() << ", NAME=" << m_name);
+        m_handshakePool = std::make_unique<ThreadPool>(HANDSHAKE_THREADS);
         while (!currentThreadShouldExit()) {
             auto* clnt = accept(&m_masterSocket, 1000, [] { return currentThreadShouldExit(); });
             if (nullptr != clnt) {
-                HandshakeRequest cfg;
-                int len = clnt->read(&cfg, sizeof(cfg), true);
-                bool handshakeOk = true;
-                if (len > 0) {
-                    if (cfg.version >= AG_PROTOCOL_VERSION) {
-                        logln("new client " << clnt->getHostName());
-                        logln("  version                   = " << cfg.version);
-                        logln("  clientId                  = " << String::toHexString(cfg.clientId));
-                        logln("  channelsIn                = " << cfg.channelsIn);
-                        logln("  channelsOut               = " << cfg.channelsOut);
-                        logln("  channelsSC                = " << cfg.channelsSC);
-
-                        ChannelSet activeChannels(cfg.activeChannels, cfg.channelsIn > 0);
-                        activeChannels.setNumChannels(cfg.channelsIn + cfg.channelsSC, cfg.channelsOut);
-                        String active;
-                        if (cfg.channelsIn > 0) {
-                            active << "inputs: ";
-                            if (activeChannels.isInputRangeActive()) {
-                                active << "all";
-                            } else {
-                                bool first = true;
-                                for (auto ch : activeChannels.getActiveChannels(true)) {
-                                    active << (first ? "" : ",") << ch;
-                                    first = false;
-                                }
-                            }
-                            active << " ";
-                        }
-                        active << "outputs: ";
-                        if (activeChannels.isOutputRangeActive()) {
-                            active << "all";
-                        } else {
-                            bool first = true;
-                            for (auto ch : activeChannels.getActiveChannels(false)) {
-                                active << (first ? "" : ",") << ch;
-                                first = false;
-                            }
-                        }
-                        logln("  active channels           = " << active);
-
-                        logln("  rate                      = " << cfg.rate);
-                        logln("  samplesPerBlock           = " << cfg.samplesPerBlock);
-                        logln("  doublePrecission          = " << static_cast<int>(cfg.doublePrecission));
-                        logln("  flags.NoPluginListFilter  = "
-                              << (int)cfg.isFlag(HandshakeRequest::NO_PLUGINLIST_FILTER));
-                    } else {
-                        logln("client " << clnt->getHostName() << " with old protocol version");
-                        handshakeOk = false;
-                    }
-                } else {
-                    logln("client " << clnt->getHostName() << " with protocol error");
-                    handshakeOk = false;
-                }
-
-                if (!handshakeOk) {
-                    clnt->close();
-                    delete clnt;
-                    continue;
-                }
-
-                if (m_sandboxing) {
-                    // Spawn a sandbox child process for a new client and tell the client the port to connect to
-                    int num = 0;
-                    String id = String::toHexString(cfg.clientId) + "-" + String(num);
-                    while (m_sandboxes.contains(id)) {
-                        num++;
-                        id = String::toHexString(cfg.clientId) + "-" + String(num);
-                    }
-                    auto sandbox = std::make_shared<SandboxMaster>(*this, id);
-                    logln("creating sandbox " << id);
-                    if (sandbox->launchSlaveProcess(File::getSpecialLocation(File::currentExecutableFile),
-                                                    Defaults::SANDBOX_CMD_PREFIX, 30000)) {
-                        sandbox->onPortReceived = [this, id, clnt](int sandboxPort) {
-                            traceScope();
-                            if (!sendHandshakeResponse(clnt, true, sandboxPort)) {
-                                logln("failed to send handshake response for sandbox " << id);
-                                m_sandboxes.remove(id);
-                            }
-                            clnt->close();
-                            delete clnt;
-                        };
-                        if (sandbox->send(SandboxMessage(SandboxMessage::CONFIG, cfg.toJson()), nullptr, true)) {
-                            m_sandboxes.set(id, sandbox);
-                        } else {
-                            logln("failed to send message to sandbox");
-                        }
-                    } else {
-                        logln("failed to launch sandbox");
-                    }
-                } else {
-                    auto masterSocket = std::make_shared<StreamingSocket>();
-
-#ifndef JUCE_WINDOWS
-                    setsockopt(masterSocket->getRawSocketHandle(), SOL_SOCKET, SO_NOSIGPIPE, nullptr, 0);
-#endif
-
-                    int workerPort = Defaults::CLIENT_PORT;
-                    while (!masterSocket->createListener(workerPort, m_host)) {
-                        workerPort++;
-                        if (workerPort > Defaults::CLIENT_PORT + 1000) {
-                            logln("failed to create client listener");
-                            clnt->close();
-                            delete clnt;
-                            clnt = nullptr;
-                            break;
-                        }
-                    }
-
-                    if (nullptr == clnt) {
-                        continue;
-                    }
-
-                    // Create a new worker thread for a new client
-                    logln("creating worker");
-                    if (!sendHandshakeResponse(clnt, false, workerPort)) {
-                        logln("failed to send handshake response");
-                        clnt->close();
-                        delete clnt;
-                        continue;
-                    }
-
-                    clnt->close();
-                    delete clnt;
-
-                    auto w = std::make_shared<Worker>(masterSocket, cfg);
-                    w->startThread();
-                    m_workers.add(w);
-                    // lazy cleanup
-                    std::shared_ptr<WorkerList> deadWorkers = std::make_shared<WorkerList>();
-                    for (int i = 0; i < m_workers.size();) {
-                        if (!m_workers.getReference(i)->isThreadRunning()) {
-                            deadWorkers->add(m_workers.getReference(i));
-                            m_workers.remove(i);
-                        } else {
-                            i++;
-                        }
-                    }
-                    traceln("about to remove " << deadWorkers->size() << " dead workers");
-                    deadWorkers->clear();
-                }
+                auto acceptTicks = Time::getHighResolutionTicks();
+                m_handshakePool->addJob([this, clnt, acceptTicks] { handleClient(clnt, acceptTicks); });
             }
             {
                 std::lock_guard<std::mutex> lock(m_sandboxesForDeletionMtx);
@@ -779,7 +696,12 @@ void Server::runServer() {
                     std::thread([deleters = std::move(m_sandboxesForDeletion)] {}).detach();
                 }
             }
+            expireParkedSessions();
         }
+        // launching a sandbox can take up to 30s
+        m_handshakePool->removeAllJobs(true, 35000);
+        m_handshakePool.reset();
+        expireParkedSessions(true);
         if (m_sandboxes.size() > 0) {
             for (auto sandbox : m_sandboxes) {
                 m_sandboxesForDeletion.add(sandbox);
@@ -812,6 +734,404 @@ void Server::runServer() {
     }
 }
 
+bool Server::isLocalAddress(const String& host) {
+    IPAddress addr(host);
+    if (addr.isNull()) {
+        return false;
+    }
+    if (IPAddress::isIPv4MappedAddress(addr)) {
+        addr = IPAddress::convertIPv4MappedAddressToIPv4(addr);
+    }
+    // the whole 127.0.0.0/8 range is loopback
+    if (addr == IPAddress::local(true) || (!addr.isIPv6 && addr.address[0] == 127)) {
+        return true;
+    }
+    for (auto& local : IPAddress::getAllAddresses(true)) {
+        if (addr == local) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Server::handleClient(StreamingSocket* clnt, int64 acceptTicks) {
+    traceScope();
+    HandshakeRequest cfg;
+    ResumeRequest resume = {0, 0, 0};
+    MessageHelper::Error err;
+    bool handshakeOk = true;
+    if (!read(clnt, &cfg, sizeof(cfg), HANDSHAKE_TIMEOUT, &err)) {
+        logln("client " << clnt->getHostName() << " with protocol error: " << err.toString());
+        handshakeOk = false;
+    } else if (cfg.version >= AG_PROTOCOL_VERSION && cfg.isFlag(HandshakeRequest::RESUME_SESSION) &&
+               !read(clnt, &resume, sizeof(resume), HANDSHAKE_TIMEOUT, &err)) {
+        logln("client " << clnt->getHostName() << " failed to send resume request: " << err.toString());
+        handshakeOk = false;
+    } else if (cfg.version >= AG_PROTOCOL_VERSION && cfg.isFlag(HandshakeRequest::ATTACH_STREAM)) {
+        attachStream(clnt, cfg);
+        return;
+    } else {
+        if (cfg.version >= AG_PROTOCOL_VERSION) {
+            logln("new client " << clnt->getHostName());
+            logln("  version                   = " << cfg.version);
+            logln("  clientId                  = " << String::toHexString(cfg.clientId));
+            logln("  channelsIn                = " << cfg.channelsIn);
+            logln("  channelsOut               = " << cfg.channelsOut);
+            logln("  channelsSC                = " << cfg.channelsSC);
+
+            ChannelSet activeChannels(cfg.activeChannels, cfg.channelsIn > 0);
+            activeChannels.setNumChannels(cfg.channelsIn + cfg.channelsSC, cfg.channelsOut);
+            String active;
+            if (cfg.channelsIn > 0) {
+                active << "inputs: ";
+                if (activeChannels.isInputRangeActive()) {
+                    active << "all";
+                } else {
+                    bool first = true;
+                    for (auto ch : activeChannels.getActiveChannels(true)) {
+                        active << (first ? "" : ",") << ch;
+                        first = false;
+                    }
+                }
+                active << " ";
+            }
+            active << "outputs: ";
+            if (activeChannels.isOutputRangeActive()) {
+                active << "all";
+            } else {
+                bool first = true;
+                for (auto ch : activeChannels.getActiveChannels(false)) {
+                    active << (first ? "" : ",") << ch;
+                    first = false;
+                }
+            }
+            logln("  active channels           = " << active);
+
+            logln("  rate                      = " << cfg.rate);
+            logln("  samplesPerBlock           = " << cfg.samplesPerBlock);
+            logln("  doublePrecission          = " << static_cast<int>(cfg.doublePrecission));
+            logln("  flags.NoPluginListFilter  = "
+                  << (int)cfg.isFlag(HandshakeRequest::NO_PLUGINLIST_FILTER));
+
+            // shared memory audio is only possible, if the client runs on the same machine
+            if (!m_sharedMemoryAudio || !isLocalAddress(clnt->getHostName())) {
+                cfg.unsetFlag(HandshakeRequest::SHARED_MEMORY_AUDIO);
+            }
+            logln("  flags.SharedMemoryAudio   = "
+                  << (int)cfg.isFlag(HandshakeRequest::SHARED_MEMORY_AUDIO));
+
+            // reducing the size of the audio data does not pay off without a network in between
+            if (cfg.isFlag(HandshakeRequest::SHARED_MEMORY_AUDIO) ||
+                !AudioWireFormat::isValid(cfg.wireFormat)) {
+                cfg.wireFormat = AudioWireFormat::NATIVE;
+            }
+            logln("  wireFormat                = " << AudioWireFormat::toString(cfg.wireFormat));
+            // the wire format takes precedence over compression
+            if (cfg.isFlag(HandshakeRequest::SHARED_MEMORY_AUDIO) ||
+                cfg.wireFormat != AudioWireFormat::NATIVE) {
+                cfg.unsetFlag(HandshakeRequest::COMPRESSED_AUDIO);
+            }
+            logln("  flags.CompressedAudio     = "
+                  << (int)cfg.isFlag(HandshakeRequest::COMPRESSED_AUDIO));
+
+            if (cfg.isFlag(HandshakeRequest::SHARED_MEMORY_AUDIO)) {
+                cfg.unsetFlag(HandshakeRequest::UDP_AUDIO);
+            }
+            logln("  flags.UdpAudio            = " << (int)cfg.isFlag(HandshakeRequest::UDP_AUDIO));
+
+            // the connections of a sandbox go to the sandbox process
+            if (m_sandboxing) {
+                cfg.unsetFlag(HandshakeRequest::SESSION_ATTACH);
+            }
+            logln("  flags.SessionAttach       = "
+                  << (int)cfg.isFlag(HandshakeRequest::SESSION_ATTACH));
+            logln("  flags.ResumeSession       = "
+                  << (int)cfg.isFlag(HandshakeRequest::RESUME_SESSION));
+        } else {
+            logln("client " << clnt->getHostName() << " with old protocol version");
+            handshakeOk = false;
+        }
+    }
+
+    if (!handshakeOk || threadShouldExit()) {
+        clnt->close();
+        delete clnt;
+        return;
+    }
+
+    if (m_sandboxing) {
+        // Spawn a sandbox child process for a new client and tell the client the port to connect to
+        String id;
+        std::shared_ptr<SandboxMaster> sandbox;
+        {
+            // reserve the ID, other handshakes run concurrently
+            const ScopedLock lock(m_sandboxes.getLock());
+            int num = 0;
+            id = String::toHexString(cfg.clientId) + "-" + String(num);
+            while (m_sandboxes.contains(id)) {
+                num++;
+                id = String::toHexString(cfg.clientId) + "-" + String(num);
+            }
+            sandbox = std::make_shared<SandboxMaster>(*this, id);
+            m_sandboxes.set(id, sandbox);
+        }
+        logln("creating sandbox " << id);
+        if (sandbox->launchSlaveProcess(File::getSpecialLocation(File::currentExecutableFile),
+                                        Defaults::SANDBOX_CMD_PREFIX, 30000)) {
+            sandbox->onPortReceived = [this, id, clnt, cfg, acceptTicks](int sandboxPort) {
+                traceScope();
+                if (sendHandshakeResponse(clnt, cfg, true, sandboxPort)) {
+                    updateHandshakeTime(acceptTicks);
+                } else {
+                    logln("failed to send handshake response for sandbox " << id);
+                    m_sandboxes.remove(id);
+                }
+                clnt->close();
+                delete clnt;
+            };
+            if (!sandbox->send(SandboxMessage(SandboxMessage::CONFIG, cfg.toJson()), nullptr, true)) {
+                logln("failed to send message to sandbox");
+                m_sandboxes.remove(id);
+            }
+        } else {
+            logln("failed to launch sandbox");
+            m_sandboxes.remove(id);
+        }
+        return;
+    }
+
+    // Resuming hands over the chain of the previous session of the client, so the plugins don't have to be loaded
+    // again. Every session gets a new token.
+    String host = clnt->getHostName();
+    std::shared_ptr<ProcessorChain> chain;
+    if (cfg.isFlag(HandshakeRequest::RESUME_SESSION)) {
+        chain = resumeSession(cfg, resume, host);
+    }
+    uint32 token = 0;
+    while (token == 0) {
+        token = (uint32)Random::getSystemRandom().nextInt();
+    }
+
+    if (cfg.isFlag(HandshakeRequest::SESSION_ATTACH)) {
+        // The client keeps the handshake connection as command connection and attaches the other
+        // connections via the server port. The worker has to be known before the client attaches.
+        logln("creating worker");
+        auto w = std::make_shared<Worker>(std::unique_ptr<StreamingSocket>(clnt), cfg);
+        w->setSession(token, host, chain);
+        w->startThread();
+        addWorker(w);
+        if (sendHandshakeResponse(clnt, cfg, false, m_port + getId(), token, nullptr != chain)) {
+            updateHandshakeTime(acceptTicks);
+        } else {
+            logln("failed to send handshake response");
+            w->shutdown();
+        }
+    } else {
+        auto masterSocket = std::make_shared<StreamingSocket>();
+
+#ifndef JUCE_WINDOWS
+        setsockopt(masterSocket->getRawSocketHandle(), SOL_SOCKET, SO_NOSIGPIPE, nullptr, 0);
+#endif
+
+        int workerPort = Defaults::CLIENT_PORT;
+        while (!masterSocket->createListener(workerPort, m_host)) {
+            workerPort++;
+            if (workerPort > Defaults::CLIENT_PORT + 1000) {
+                logln("failed to create client listener");
+                clnt->close();
+                delete clnt;
+                clnt = nullptr;
+                break;
+            }
+        }
+
+        if (nullptr == clnt) {
+            return;
+        }
+
+        // Create a new worker thread for a new client
+        logln("creating worker");
+        if (!sendHandshakeResponse(clnt, cfg, false, workerPort, token, nullptr != chain)) {
+            logln("failed to send handshake response");
+            clnt->close();
+            delete clnt;
+            return;
+        }
+
+        clnt->close();
+        delete clnt;
+
+        auto w = std::make_shared<Worker>(masterSocket, cfg);
+        w->setSession(token, host, chain);
+        w->startThread();
+        addWorker(w);
+        updateHandshakeTime(acceptTicks);
+    }
+}
+
+void Server::addWorker(std::shared_ptr<Worker> w) {
+    traceScope();
+    {
+        std::lock_guard<std::mutex> lock(m_workersMtx);
+        m_workers.add(w);
+    }
+    removeDeadWorkers();
+}
+
+void Server::updateHandshakeTime(int64 acceptTicks) {
+    double ms = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - acceptTicks) * 1000;
+    Metrics::getStatistic<TimeStatistic>("handshake")->update(ms);
+    logln("handshake finished after " << String(ms, 1) << "ms");
+}
+
+void Server::removeDeadWorkers() {
+    traceScope();
+    // lazy cleanup
+    std::shared_ptr<WorkerList> deadWorkers = std::make_shared<WorkerList>();
+    {
+        std::lock_guard<std::mutex> lock(m_workersMtx);
+        for (int i = 0; i < m_workers.size();) {
+            if (!m_workers.getReference(i)->isThreadRunning()) {
+                deadWorkers->add(m_workers.getReference(i));
+                m_workers.remove(i);
+            } else {
+                i++;
+            }
+        }
+    }
+    traceln("about to remove " << deadWorkers->size() << " dead workers");
+    deadWorkers->clear();
+}
+
+void Server::attachStream(StreamingSocket* clnt, const HandshakeRequest& cfg) {
+    traceScope();
+    std::unique_ptr<StreamingSocket> sock(clnt);
+    std::lock_guard<std::mutex> lock(m_workersMtx);
+    for (auto& w : m_workers) {
+        if (w->getClientId() == cfg.clientId && w->attachStream(cfg.stream, sock)) {
+            return;
+        }
+    }
+    logln("no session for stream " << cfg.stream << " of client " << String::toHexString(cfg.clientId) << " from "
+                                   << sock->getHostName());
+    sock->close();
+}
+
+void Server::parkSession(uint32 token, const String& host, const HandshakeRequest& cfg,
+                         std::shared_ptr<ProcessorChain> chain) {
+    traceScope();
+    if (threadShouldExit()) {
+        chain->clear();
+        return;
+    }
+    logln("parking session of client " << String::toHexString(cfg.clientId) << " with " << chain->getSize()
+                                       << " plugin(s) for " << SESSION_GRACE_SECONDS << "s");
+    ParkedSession session = {token, host, cfg, chain,
+                             Time::getApproximateMillisecondCounter() + SESSION_GRACE_SECONDS * 1000};
+    std::shared_ptr<ProcessorChain> replaced;
+    {
+        std::lock_guard<std::mutex> lock(m_parkedSessionsMtx);
+        auto it = m_parkedSessions.find(cfg.clientId);
+        if (it != m_parkedSessions.end()) {
+            replaced = it->second.chain;
+        }
+        m_parkedSessions[cfg.clientId] = session;
+    }
+    if (nullptr != replaced) {
+        replaced->clear();
+    }
+}
+
+std::shared_ptr<ProcessorChain> Server::resumeSession(const HandshakeRequest& cfg, const ResumeRequest& resume,
+                                                      const String& host) {
+    traceScope();
+    // The loss of the previous connection might not have been noticed yet. The worker of the previous session has to
+    // park it first.
+    std::shared_ptr<Worker> previous;
+    {
+        std::lock_guard<std::mutex> lock(m_workersMtx);
+        for (auto& w : m_workers) {
+            if (w->getClientId() == cfg.clientId && w->getSessionToken() == resume.token &&
+                w->getSessionHost() == host && w->isThreadRunning()) {
+                previous = w;
+                break;
+            }
+        }
+    }
+    if (nullptr != previous) {
+        logln("previous session of client " << String::toHexString(cfg.clientId)
+                                            << " is still active, shutting it down");
+        previous->parkSession();
+        if (!previous->waitForThreadToExit(SESSION_TAKEOVER_TIMEOUT_MS)) {
+            logln("previous session of client " << String::toHexString(cfg.clientId) << " did not terminate in time");
+        }
+    }
+    std::shared_ptr<ProcessorChain> chain;
+    {
+        std::lock_guard<std::mutex> lock(m_parkedSessionsMtx);
+        auto it = m_parkedSessions.find(cfg.clientId);
+        if (it == m_parkedSessions.end()) {
+            logln("no parked session for client " << String::toHexString(cfg.clientId));
+            return nullptr;
+        }
+        auto& parked = it->second;
+        if (parked.token != resume.token || parked.host != host) {
+            logln("not resuming session of client " << String::toHexString(cfg.clientId) << ": token mismatch");
+            return nullptr;
+        }
+        chain = parked.chain;
+        bool match = parked.cfg.channelsIn == cfg.channelsIn && parked.cfg.channelsOut == cfg.channelsOut &&
+                     parked.cfg.channelsSC == cfg.channelsSC && parked.cfg.rate == cfg.rate &&
+                     parked.cfg.samplesPerBlock == cfg.samplesPerBlock &&
+                     parked.cfg.doublePrecission == cfg.doublePrecission &&
+                     parked.cfg.activeChannels == cfg.activeChannels && chain->getFingerprint() == resume.chain;
+        // the session can't be resumed anymore, as the client has a new one now
+        m_parkedSessions.erase(it);
+        if (!match) {
+            logln("not resuming session of client " << String::toHexString(cfg.clientId)
+                                                    << ": audio config or plugins changed");
+            chain.reset();
+        }
+    }
+    if (nullptr == chain) {
+        return nullptr;
+    }
+    logln("resuming session of client " << String::toHexString(cfg.clientId) << " with " << chain->getSize()
+                                        << " plugin(s)");
+    return chain;
+}
+
+void Server::expireParkedSessions(bool all) {
+    auto now = Time::getApproximateMillisecondCounter();
+    std::vector<std::shared_ptr<ProcessorChain>> expired;
+    {
+        std::lock_guard<std::mutex> lock(m_parkedSessionsMtx);
+        for (auto it = m_parkedSessions.begin(); it != m_parkedSessions.end();) {
+            if (all || it->second.expires <= now) {
+                logln("session of client " << String::toHexString(it->first) << " expired");
+                expired.push_back(it->second.chain);
+                it = m_parkedSessions.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+    if (expired.empty()) {
+        return;
+    }
+    auto unload = [expired] {
+        for (auto& chain : expired) {
+            chain->clear();
+        }
+    };
+    if (all) {
+        unload();
+    } else {
+        // unloading plugins can take a while, don't block the accept loop
+        std::thread(unload).detach();
+    }
+}
+
 void Server::runSandbox() {
     traceScope();
 
@@ -887,6 +1207,11 @@ void Server::runSandbox() {
                 jmetrics["NetBytesOut"] = bytesOutMeter->rate_1min();
                 jmetrics["NetBytesIn"] = bytesInMeter->rate_1min();
                 jmetrics["RPS"] = audioTime->getMeter().rate_1min();
+                float threadUsage = 0.0f;
+                for (auto& t : CPUInfo::getThreadUsage()) {
+                    threadUsage += t.second;
+                }
+                jmetrics["ThreadUsage"] = threadUsage;
                 json jtimes = json::array();
                 for (auto& hist : audioTime->get1minValues()) {
                     jtimes.push_back(hist.toJson());
@@ -912,7 +1237,8 @@ void Server::runSandbox() {
     }
 }
 
-bool Server::sendHandshakeResponse(StreamingSocket* sock, bool sandboxEnabled, int port) {
+bool Server::sendHandshakeResponse(StreamingSocket* sock, const HandshakeRequest& cfg, bool sandboxEnabled, int port,
+                                   uint32 sessionToken, bool resumed) {
     HandshakeResponse resp = {AG_PROTOCOL_VERSION, 0, 0};
     if (sandboxEnabled) {
         resp.setFlag(HandshakeResponse::SANDBOX_ENABLED);
@@ -920,6 +1246,29 @@ bool Server::sendHandshakeResponse(StreamingSocket* sock, bool sandboxEnabled, i
     if (m_screenLocalMode) {
         resp.setFlag(HandshakeResponse::LOCAL_MODE);
     }
+    if (cfg.isFlag(HandshakeRequest::SHARED_MEMORY_AUDIO)) {
+        resp.setFlag(HandshakeResponse::SHARED_MEMORY_AUDIO);
+    }
+    if (cfg.isFlag(HandshakeRequest::COMPRESSED_AUDIO)) {
+        resp.setFlag(HandshakeResponse::COMPRESSED_AUDIO);
+    }
+    if (cfg.isFlag(HandshakeRequest::UDP_AUDIO)) {
+        resp.setFlag(HandshakeResponse::UDP_AUDIO);
+    }
+    resp.setFlag(HandshakeResponse::PLUGIN_DSP_LOAD);
+    resp.setFlag(HandshakeResponse::XRUN_REPORTING);
+    resp.setFlag(HandshakeResponse::LOAD_CHAIN);
+    if (cfg.isFlag(HandshakeRequest::SESSION_ATTACH)) {
+        resp.setFlag(HandshakeResponse::SESSION_ATTACH);
+    }
+    if (sessionToken != 0) {
+        resp.setFlag(HandshakeResponse::SESSION_RESUME);
+        resp.sessionToken = sessionToken;
+    }
+    if (resumed) {
+        resp.setFlag(HandshakeResponse::SESSION_RESUMED);
+    }
+    resp.wireFormat = cfg.wireFormat;
     resp.port = port;
     return send(sock, reinterpret_cast<const char*>(&resp), sizeof(resp));
 }
@@ -935,6 +1284,7 @@ void Server::handleMessageFromSandbox(SandboxMaster& sandbox, const SandboxMessa
         m_sandboxHasScreen.clear();
     } else if (msg.type == SandboxMessage::METRICS) {
         m_sandboxLoadedCount.set(sandbox.id, jsonGetValue(msg.data, "LoadedCount", (uint32)0));
+        m_sandboxThreadUsage.set(sandbox.id, jsonGetValue(msg.data, "ThreadUsage", 0.0f));
 
         auto bytesOutMeter = Metrics::getStatistic<Meter>("NetBytesOut");
         bytesOutMeter->updateExtRate1min(sandbox.id, jsonGetValue(msg.data, "NetBytesOut", 0.0));
@@ -962,6 +1312,7 @@ void Server::handleDisconnectFromSandbox(SandboxMaster& sandbox) {
     if (m_sandboxes.contains(sandbox.id)) {
         logln("disconnected from sandbox " << sandbox.id);
         m_sandboxLoadedCount.remove(sandbox.id);
+        m_sandboxThreadUsage.remove(sandbox.id);
         Metrics::getStatistic<TimeStatistic>("audio")->removeExt1minValues(sandbox.id);
         Metrics::getStatistic<TimeStatistic>("audio")->getMeter().removeExtRate1min(sandbox.id);
         Metrics::getStatistic<Meter>("NetBytesOut")->removeExtRate1min(sandbox.id);
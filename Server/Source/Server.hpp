@@ -9,6 +9,7 @@
 #define Server_hpp
 
 #include <JuceHeader.h>
+#include <map>
 #include <set>
 #include <thread>
 
@@ -72,6 +73,18 @@ class Server : public Thread, public LogTag {
     void setScanForPlugins(bool b) { m_scanForPlugins = b; }
     bool getParallelPluginLoad() const { return m_parallelPluginLoad; }
     void setParallelPluginLoad(bool b) { m_parallelPluginLoad = b; }
+    bool getPluginPool() const { return m_pluginPool; }
+    void setPluginPool(bool b) { m_pluginPool = b; }
+    bool getAudioScheduler() const { return m_audioScheduler; }
+    void setAudioScheduler(bool b) { m_audioScheduler = b; }
+    bool isAudioSchedulerEnabled() const { return m_audioSchedulerEnabled; }
+    bool getChainBranches() const { return m_chainBranches; }
+    void setChainBranches(bool b) { m_chainBranches = b; }
+    bool getChainPipelining() const { return m_chainPipelining; }
+    void setChainPipelining(bool b) { m_chainPipelining = b; }
+    int getChainPipelineSegments() const { return m_chainPipelining ? m_chainPipelineSegments : 0; }
+    bool getSharedMemoryAudio() const { return m_sharedMemoryAudio; }
+    void setSharedMemoryAudio(bool b) { m_sharedMemoryAudio = b; }
     bool getSandboxing() const { return m_sandboxing; }
     void setSandboxing(bool b) { m_sandboxing = b; }
     bool getCrashReporting() const { return m_crashReporting; }
@@ -98,6 +111,11 @@ class Server : public Thread, public LogTag {
     void handleDisconnectedFromMaster();
     void handleConnectedToMaster();
 
+    // Keeps the chain of a client, that lost the connection, for SESSION_GRACE_SECONDS, so that the client can resume
+    // the session without reloading the plugins
+    void parkSession(uint32 token, const String& host, const HandshakeRequest& cfg,
+                     std::shared_ptr<ProcessorChain> chain);
+
     int getNumSandboxes() { return m_sandboxes.size(); }
     int getNumLoadedBySandboxes() {
         int sum = 0;
@@ -106,6 +124,14 @@ class Server : public Thread, public LogTag {
         }
         return sum;
     }
+    std::map<String, float> getThreadUsageBySandboxes() {
+        std::map<String, float> ret;
+        for (HashMap<String, float, DefaultHashFunctions, CriticalSection>::Iterator it(m_sandboxThreadUsage);
+             it.next();) {
+            ret[it.getKey()] = it.getValue();
+        }
+        return ret;
+    }
 
   private:
     json m_opts;
@@ -117,6 +143,26 @@ class Server : public Thread, public LogTag {
     StreamingSocket m_masterSocket;
     using WorkerList = Array<std::shared_ptr<Worker>>;
     WorkerList m_workers;
+    std::mutex m_workersMtx;
+
+    // Handshakes are processed concurrently, so that the accept loop does not wait for slow clients or sandbox launches
+    static constexpr int HANDSHAKE_THREADS = 8;
+    static constexpr int HANDSHAKE_TIMEOUT = 5000;
+    std::unique_ptr<ThreadPool> m_handshakePool;
+
+    static constexpr int SESSION_GRACE_SECONDS = 30;
+    // time to wait for a session, that is still active, to be parked, when the client resumes it
+    static constexpr int SESSION_TAKEOVER_TIMEOUT_MS = 5000;
+    struct ParkedSession {
+        uint32 token;
+        String host;
+        HandshakeRequest cfg;
+        std::shared_ptr<ProcessorChain> chain;
+        uint32 expires;
+    };
+    std::map<uint64, ParkedSession> m_parkedSessions;
+    std::mutex m_parkedSessionsMtx;
+
     KnownPluginList m_pluginlist;
     std::set<String> m_pluginexclude;
     bool m_enableAU = true;
@@ -135,6 +181,17 @@ class Server : public Thread, public LogTag {
     bool m_vstNoStandardFolders;
     bool m_scanForPlugins = true;
     bool m_parallelPluginLoad = false;
+    bool m_pluginPool = false;
+    int m_pluginPoolSize = 3;  // plugins per host
+    bool m_pluginPoolEnabled = false;
+    bool m_audioScheduler = false;
+    int m_audioSchedulerThreads = 0;  // one per core
+    bool m_audioSchedulerEnabled = false;
+    bool m_audioSchedulerStarted = false;
+    bool m_chainBranches = true;
+    bool m_chainPipelining = false;
+    int m_chainPipelineSegments = 2;
+    bool m_sharedMemoryAudio = true;
     bool m_crashReporting = true;
     bool m_sandboxing = false;
     bool m_sandboxLogAutoclean = true;
@@ -146,6 +203,7 @@ class Server : public Thread, public LogTag {
     std::unique_ptr<SandboxSlave> m_sandboxController;
 
     HashMap<String, uint32, DefaultHashFunctions, CriticalSection> m_sandboxLoadedCount;
+    HashMap<String, float, DefaultHashFunctions, CriticalSection> m_sandboxThreadUsage;
 
     std::atomic_bool m_sandboxReady{false};
     std::atomic_bool m_sandboxConnectedToMaster{false};
@@ -162,8 +220,21 @@ class Server : public Thread, public LogTag {
 
     void runServer();
     void runSandbox();
-
-    bool sendHandshakeResponse(StreamingSocket* sock, bool sandboxEnabled = false, int sandboxPort = 0);
+    void handleClient(StreamingSocket* clnt, int64 acceptTicks);
+    void addWorker(std::shared_ptr<Worker> w);
+    void removeDeadWorkers();
+    void updateHandshakeTime(int64 acceptTicks);
+    // Returns true, if the address belongs to this machine
+    static bool isLocalAddress(const String& host);
+    // Hands over a connection, that attaches a stream to the session of a client
+    void attachStream(StreamingSocket* clnt, const HandshakeRequest& cfg);
+    // Returns the parked chain of the client, if token, host, audio config and plugins match
+    std::shared_ptr<ProcessorChain> resumeSession(const HandshakeRequest& cfg, const ResumeRequest& resume,
+                                                  const String& host);
+    void expireParkedSessions(bool all = false);
+
+    bool sendHandshakeResponse(StreamingSocket* sock, const HandshakeRequest& cfg, bool sandboxEnabled = false,
+                               int sandboxPort = 0, uint32 sessionToken = 0, bool resumed = false);
 
     template <typename T>
     inline T getOpt(const String& name, T def) const {
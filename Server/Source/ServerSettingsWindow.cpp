@@ -432,6 +432,54 @@ ServerSettingsWindow::ServerSettingsWindow(App* app)
 
     row++;
 
+    label = std::make_unique<Label>();
+    label->setText("Keep recently used Plugins loaded in advance:", NotificationType::dontSendNotification);
+    label->setBounds(getLabelBounds(row));
+    addChildAndSetID(label.get(), "lbl");
+    m_components.push_back(std::move(label));
+
+    m_pluginPool.setBounds(getCheckBoxBounds(row));
+    m_pluginPool.setToggleState(m_app->getServer()->getPluginPool(), NotificationType::dontSendNotification);
+    addChildAndSetID(&m_pluginPool, "ppool");
+
+    row++;
+
+    label = std::make_unique<Label>();
+    label->setText("Process audio on a shared thread pool:", NotificationType::dontSendNotification);
+    label->setBounds(getLabelBounds(row));
+    addChildAndSetID(label.get(), "lbl");
+    m_components.push_back(std::move(label));
+
+    m_audioScheduler.setBounds(getCheckBoxBounds(row));
+    m_audioScheduler.setToggleState(m_app->getServer()->getAudioScheduler(), NotificationType::dontSendNotification);
+    addChildAndSetID(&m_audioScheduler, "asched");
+
+    row++;
+
+    label = std::make_unique<Label>();
+    label->setText("Process parallel chain branches concurrently:", NotificationType::dontSendNotification);
+    label->setBounds(getLabelBounds(row));
+    addChildAndSetID(label.get(), "lbl");
+    m_components.push_back(std::move(label));
+
+    m_chainBranches.setBounds(getCheckBoxBounds(row));
+    m_chainBranches.setToggleState(m_app->getServer()->getChainBranches(), NotificationType::dontSendNotification);
+    addChildAndSetID(&m_chainBranches, "branches");
+
+    row++;
+
+    label = std::make_unique<Label>();
+    label->setText("Pipeline long chains across cores (adds latency):", NotificationType::dontSendNotification);
+    label->setBounds(getLabelBounds(row));
+    addChildAndSetID(label.get(), "lbl");
+    m_components.push_back(std::move(label));
+
+    m_chainPipelining.setBounds(getCheckBoxBounds(row));
+    m_chainPipelining.setToggleState(m_app->getServer()->getChainPipelining(), NotificationType::dontSendNotification);
+    addChildAndSetID(&m_chainPipelining, "pipeline");
+
+    row++;
+
     label = std::make_unique<Label>();
     label->setText("Diagnostics", NotificationType::dontSendNotification);
     label->setJustificationType(Justification::centredTop);
@@ -497,6 +545,10 @@ ServerSettingsWindow::ServerSettingsWindow(App* app)
         appCpy->getServer()->setEnableVST2(m_vst2Support.getToggleState());
         appCpy->getServer()->setScanForPlugins(m_scanForPlugins.getToggleState());
         appCpy->getServer()->setParallelPluginLoad(m_parallelPluginLoad.getToggleState());
+        appCpy->getServer()->setPluginPool(m_pluginPool.getToggleState());
+        appCpy->getServer()->setAudioScheduler(m_audioScheduler.getToggleState());
+        appCpy->getServer()->setChainBranches(m_chainBranches.getToggleState());
+        appCpy->getServer()->setChainPipelining(m_chainPipelining.getToggleState());
         appCpy->getServer()->setSandboxing(m_sandbox.getToggleState());
         appCpy->getServer()->setCrashReporting(m_crashReporting.getToggleState());
         switch (m_screenCapturingMode.getSelectedId()) {
@@ -28,7 +28,8 @@ class ServerSettingsWindow : public DocumentWindow, public LogTag {
     std::vector<std::unique_ptr<Component>> m_components;
     TextEditor m_idText, m_nameText, m_screenJpgQuality, m_vst2Folders, m_vst3Folders;
     ToggleButton m_auSupport, m_vst3Support, m_vst2Support, m_screenDiffDetection, m_scanForPlugins, m_tracer, m_logger,
-        m_vstNoStandardFolders, m_parallelPluginLoad, m_sandbox, m_localMode, m_pluginWindowsOnTop, m_crashReporting;
+        m_vstNoStandardFolders, m_parallelPluginLoad, m_pluginPool, m_audioScheduler, m_sandbox, m_localMode,
+        m_pluginWindowsOnTop, m_crashReporting, m_chainBranches, m_chainPipelining;
     TextButton m_saveButton;
     Label m_screenJpgQualityLbl, m_screenDiffDetectionLbl, m_screenCapturingQualityLbl, m_localModeLbl,
         m_pluginWindowsOnTopLbl;
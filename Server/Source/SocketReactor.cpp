@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#include "SocketReactor.hpp"
+
+#if defined(JUCE_LINUX)
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif defined(JUCE_MAC)
+#include <sys/event.h>
+#include <unistd.h>
+#endif
+
+namespace e47 {
+
+SocketReactor::SocketReactor() : Thread("SocketReactor"), LogTag("reactor") {
+    traceScope();
+#if defined(JUCE_LINUX)
+    m_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_fd < 0) {
+        logln("epoll_create1 failed: " << strerror(errno));
+    }
+#elif defined(JUCE_MAC)
+    m_fd = kqueue();
+    if (m_fd < 0) {
+        logln("kqueue failed: " << strerror(errno));
+    }
+#endif
+    if (m_fd > -1) {
+        startThread(Thread::realtimeAudioPriority);
+    } else {
+        logln("no socket reactor available, workers will poll their sockets");
+    }
+}
+
+SocketReactor::~SocketReactor() {
+    traceScope();
+    stopThread(-1);
+#if defined(JUCE_LINUX) || defined(JUCE_MAC)
+    if (m_fd > -1) {
+        ::close(m_fd);
+    }
+#endif
+}
+
+void SocketReactor::run() {
+    traceScope();
+    logln("socket reactor started");
+#if defined(JUCE_LINUX)
+    epoll_event events[MAX_EVENTS];
+#elif defined(JUCE_MAC)
+    struct kevent events[MAX_EVENTS];
+    struct timespec timeout = {0, 100000000};
+#endif
+    while (!currentThreadShouldExit()) {
+#if defined(JUCE_LINUX)
+        int num = epoll_wait(m_fd, events, MAX_EVENTS, 100);
+#elif defined(JUCE_MAC)
+        int num = kevent(m_fd, nullptr, 0, events, MAX_EVENTS, &timeout);
+#else
+        int num = 0;
+        sleep(100);
+#endif
+        if (num < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logln("waiting for events failed: " << strerror(errno));
+            break;
+        }
+        std::lock_guard<std::mutex> lock(m_mtx);
+        for (int i = 0; i < num; i++) {
+#if defined(JUCE_LINUX)
+            auto* reg = static_cast<Registration*>(events[i].data.ptr);
+#elif defined(JUCE_MAC)
+            auto* reg = static_cast<Registration*>(events[i].udata);
+#else
+            Registration* reg = nullptr;
+#endif
+            // the registration might have been removed after the events have been collected
+            if (m_registrations.find(reg) != m_registrations.end()) {
+                reg->m_event.signal();
+            }
+        }
+    }
+    logln("socket reactor terminated");
+}
+
+std::unique_ptr<SocketReactor::Registration> SocketReactor::add(StreamingSocket* socket) {
+    auto reactor = getInstance();
+    if (nullptr == reactor || reactor->m_fd < 0 || nullptr == socket || !socket->isConnected()) {
+        return nullptr;
+    }
+    auto reg = std::make_unique<Registration>(reactor, socket);
+    if (!reactor->addReal(reg.get())) {
+        reg->m_reactor.reset();
+        return nullptr;
+    }
+    return reg;
+}
+
+bool SocketReactor::addReal(Registration* reg) {
+    traceScope();
+    std::lock_guard<std::mutex> lock(m_mtx);
+    int handle = reg->m_socket->getRawSocketHandle();
+    // Edge triggered, every new chunk of data signals the registration. Registration::waitUntilReady checks the
+    // socket before waiting, so data that arrived before the registration is not missed.
+#if defined(JUCE_LINUX)
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = reg;
+    if (epoll_ctl(m_fd, EPOLL_CTL_ADD, handle, &ev) != 0) {
+        logln("epoll_ctl failed: " << strerror(errno));
+        return false;
+    }
+#elif defined(JUCE_MAC)
+    struct kevent ev;
+    EV_SET(&ev, handle, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, reg);
+    if (kevent(m_fd, &ev, 1, nullptr, 0, nullptr) != 0) {
+        logln("kevent failed: " << strerror(errno));
+        return false;
+    }
+#else
+    ignoreUnused(handle);
+    return false;
+#endif
+    m_registrations.insert(reg);
+    return true;
+}
+
+void SocketReactor::remove(Registration* reg) {
+    traceScope();
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_registrations.erase(reg) == 0) {
+        return;
+    }
+    int handle = reg->m_socket->getRawSocketHandle();
+    if (handle < 0) {
+        // closed sockets are removed automatically
+        return;
+    }
+#if defined(JUCE_LINUX)
+    epoll_event ev;
+    epoll_ctl(m_fd, EPOLL_CTL_DEL, handle, &ev);
+#elif defined(JUCE_MAC)
+    struct kevent ev;
+    EV_SET(&ev, handle, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    kevent(m_fd, &ev, 1, nullptr, 0, nullptr);
+#endif
+}
+
+SocketReactor::Registration::~Registration() {
+    if (nullptr != m_reactor) {
+        m_reactor->remove(this);
+    }
+}
+
+int SocketReactor::Registration::waitUntilReady(int timeoutMilliseconds) {
+    int ret = m_socket->waitUntilReady(true, 0);
+    if (ret != 0) {
+        return ret;
+    }
+    if (!m_event.wait(timeoutMilliseconds)) {
+        return 0;
+    }
+    return m_socket->isConnected() ? m_socket->waitUntilReady(true, 0) : -1;
+}
+
+}  // namespace e47
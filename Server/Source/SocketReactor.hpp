@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021 Andreas Pohl
+ * Licensed under MIT (https://github.com/apohl79/audiogridder/blob/master/COPYING)
+ *
+ * Author: Andreas Pohl
+ */
+
+#ifndef SocketReactor_hpp
+#define SocketReactor_hpp
+
+#include <JuceHeader.h>
+#include <unordered_set>
+
+#include "SharedInstance.hpp"
+#include "Utils.hpp"
+
+namespace e47 {
+
+/*
+ * Delivers socket readiness as events. A single thread waits on epoll (Linux) or kqueue (macOS) for all registered
+ * sockets and wakes up the thread waiting for a socket, so workers do not have to poll their sockets. On other
+ * platforms no registration is possible and callers fall back to polling.
+ */
+class SocketReactor : public Thread, public LogTag, public SharedInstance<SocketReactor> {
+  public:
+    SocketReactor();
+    ~SocketReactor() override;
+
+    void run() override;
+
+    class Registration {
+      public:
+        Registration(std::shared_ptr<SocketReactor> reactor, StreamingSocket* socket)
+            : m_reactor(reactor), m_socket(socket) {}
+        ~Registration();
+
+        // Same return values as StreamingSocket::waitUntilReady
+        int waitUntilReady(int timeoutMilliseconds);
+
+        // Unblock a waiting thread, e.g. for shutting down
+        void wakeUp() { m_event.signal(); }
+
+      private:
+        friend SocketReactor;
+        std::shared_ptr<SocketReactor> m_reactor;
+        StreamingSocket* m_socket;
+        WaitableEvent m_event;
+    };
+
+    // Returns nullptr, if the socket can't be registered. The caller has to poll the socket in this case.
+    static std::unique_ptr<Registration> add(StreamingSocket* socket);
+
+  private:
+    static constexpr int MAX_EVENTS = 64;
+
+    int m_fd = -1;
+    std::mutex m_mtx;
+    std::unordered_set<Registration*> m_registrations;
+
+    bool addReal(Registration* reg);
+    void remove(Registration* reg);
+};
+
+}  // namespace e47
+
+#endif /* SocketReactor_hpp */
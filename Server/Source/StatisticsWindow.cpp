@@ -9,6 +9,7 @@
 #include "App.hpp"
 #include "CPUInfo.hpp"
 #include "Metrics.hpp"
+#include "ProcessorChain.hpp"
 #include "WindowPositions.hpp"
 
 namespace e47 {
@@ -149,6 +150,21 @@ StatisticsWindow::StatisticsWindow(App* app)
 
     row++;
 
+    line = std::make_unique<HirozontalLine>(getLineBounds(row++));
+    addChildAndSetID(line.get(), "line");
+    m_components.push_back(std::move(line));
+
+    addLabel(m_sandboxing ? "CPU usage per sandbox" : "Plugin DSP load (average/peak)", getLabelBounds(row++));
+    int tableRows = 6;
+    m_pluginLoad.setBounds(borderLR, borderTB + row * rowHeight, totalWidth - borderLR * 2, tableRows * rowHeight - 5);
+    m_pluginLoad.setMultiLine(true);
+    m_pluginLoad.setReadOnly(true);
+    m_pluginLoad.setCaretVisible(false);
+    m_pluginLoad.setFont(Font(Font::getDefaultMonospacedFontName(), 12.0f, Font::plain));
+    addChildAndSetID(&m_pluginLoad, "pluginload");
+
+    row += tableRows;
+
     totalHeight += row * rowHeight;
 
     auto audioTime = Metrics::getStatistic<TimeStatistic>("audio");
@@ -200,6 +216,36 @@ StatisticsWindow::StatisticsWindow(App* app)
         }
         m_audioBytesOut.setText(String(netOut, 2) + dataUnitOut, NotificationType::dontSendNotification);
         m_audioBytesIn.setText(String(netIn, 2) + dataUnitIn, NotificationType::dontSendNotification);
+
+        if (m_sandboxing) {
+            auto srv = m_app->getServer();
+            if (nullptr != srv) {
+                String table;
+                for (auto& t : srv->getThreadUsageBySandboxes()) {
+                    table << t.first.paddedRight(' ', 34) << String(t.second, 1).paddedLeft(' ', 6) << "%\n";
+                }
+                m_pluginLoad.setText(table, false);
+            }
+        } else {
+            String table;
+            for (auto& chain : ProcessorChain::getLoadOfAllChains()) {
+                table << chain["client"].get<std::string>() << "\n";
+                int slot = 0;
+                for (auto& plug : chain["plugins"]) {
+                    table << "  " << slot++ << ": " << String(plug["name"].get<std::string>()).paddedRight(' ', 30)
+                          << String(plug["load"].get<double>(), 1).paddedLeft(' ', 6) << "%"
+                          << String(plug["peak"].get<double>(), 1).paddedLeft(' ', 6) << "%\n";
+                }
+            }
+            auto threadUsage = CPUInfo::getThreadUsage();
+            if (!threadUsage.empty()) {
+                table << "\nCPU usage per thread\n";
+                for (auto& t : threadUsage) {
+                    table << "  " << t.first.paddedRight(' ', 33) << String(t.second, 1).paddedLeft(' ', 6) << "%\n";
+                }
+            }
+            m_pluginLoad.setText(table, false);
+        }
     });
     m_updater.startThread();
 
@@ -11,6 +11,7 @@
 #include "App.hpp"
 #include "CPUInfo.hpp"
 #include "ChannelSet.hpp"
+#include "PluginPool.hpp"
 
 #ifdef JUCE_MAC
 #include <sys/socket.h>
@@ -38,6 +39,20 @@ Worker::Worker(std::shared_ptr<StreamingSocket> masterSocket, const HandshakeReq
     count++;
 }
 
+Worker::Worker(std::unique_ptr<StreamingSocket> cmdIn, const HandshakeRequest& cfg)
+    : Thread("Worker"),
+      LogTag("worker"),
+      m_cfg(cfg),
+      m_audio(std::make_shared<AudioWorker>(this)),
+      m_screen(std::make_shared<ScreenWorker>(this)),
+      m_msgFactory(this),
+      m_keyWatcher(std::make_unique<KeyWatcher>(this)) {
+    traceScope();
+    m_attached[HandshakeRequest::STREAM_COMMANDS] = std::move(cmdIn);
+    initAsyncFunctors();
+    count++;
+}
+
 Worker::~Worker() {
     traceScope();
     stopAsyncFunctors();
@@ -52,15 +67,16 @@ void Worker::run() {
     traceScope();
     runCount++;
     setLogTagExtra("client:" + String::toHexString(m_cfg.clientId));
+    m_audio->setLogTagSource(this);
 
     m_noPluginListFilter = m_cfg.isFlag(HandshakeRequest::NO_PLUGINLIST_FILTER);
 
     // set master socket non-blocking
-    if (!setNonBlocking(m_masterSocket->getRawSocketHandle())) {
+    if (nullptr != m_masterSocket && !setNonBlocking(m_masterSocket->getRawSocketHandle())) {
         logln("failed to set master socket non-blocking");
     }
 
-    m_cmdIn.reset(accept(m_masterSocket.get(), 2000));
+    m_cmdIn.reset(acceptStream(HandshakeRequest::STREAM_COMMANDS, 2000));
     if (nullptr != m_cmdIn && m_cmdIn->isConnected()) {
         logln("client connected " << m_cmdIn->getHostName());
     } else {
@@ -69,7 +85,7 @@ void Worker::run() {
     }
 
     // command sending socket
-    m_cmdOut.reset(accept(m_masterSocket.get(), 2000));
+    m_cmdOut.reset(acceptStream(HandshakeRequest::STREAM_CALLBACKS, 2000));
     if (nullptr == m_cmdIn || !m_cmdIn->isConnected()) {
         logln("failed to establish command connection");
         return;
@@ -78,17 +94,59 @@ void Worker::run() {
     std::unique_ptr<StreamingSocket> sock;
 
     // start audio processing
-    sock.reset(accept(m_masterSocket.get(), 2000));
+    sock.reset(acceptStream(HandshakeRequest::STREAM_AUDIO, 2000));
+    std::unique_ptr<SharedMemoryStream> shm;
+    if (nullptr != sock && sock->isConnected() && m_cfg.isFlag(HandshakeRequest::SHARED_MEMORY_AUDIO)) {
+        shm = std::make_unique<SharedMemoryStream>(this, m_cfg.clientId, SharedMemoryStream::getRingSize(m_cfg), false,
+                                                   sock.get());
+        bool ok = shm->open();
+        if (!ok) {
+            logln("failed to open shared memory audio stream, falling back to TCP");
+            shm.reset();
+        }
+        // the client waits for the result, so that it can fall back to TCP as well
+        char result = ok ? 1 : 0;
+        if (!send(sock.get(), &result, 1)) {
+            logln("failed to send shared memory negotiation result");
+            shm.reset();
+            sock.reset();
+        }
+    }
+    std::unique_ptr<DatagramStream> udp;
+    if (nullptr != sock && sock->isConnected() && nullptr == shm && m_cfg.isFlag(HandshakeRequest::UDP_AUDIO)) {
+        // the UDP port matches the TCP port the client connected to, in session mode any free port is used
+        udp = std::make_unique<DatagramStream>(this, m_cfg.clientId, sock.get());
+        if (!udp->waitForClient(nullptr != m_masterSocket ? m_masterSocket->getBoundPort() : 0, 2000)) {
+            logln("UDP audio negotiation failed, falling back to TCP");
+            udp.reset();
+        }
+    }
     if (nullptr != sock && sock->isConnected()) {
-        m_audio->init(std::move(sock), m_cfg.channelsIn, m_cfg.channelsOut, m_cfg.channelsSC, m_cfg.activeChannels,
-                      m_cfg.rate, m_cfg.samplesPerBlock, m_cfg.doublePrecission);
-        m_audio->startThread(Thread::realtimeAudioPriority);
+        if (nullptr != m_resumedChain) {
+            m_audio->setChain(m_resumedChain);
+        }
+        m_audio->init(std::move(sock), std::move(shm), std::move(udp), m_cfg.channelsIn, m_cfg.channelsOut,
+                      m_cfg.channelsSC, m_cfg.activeChannels, m_cfg.rate, m_cfg.samplesPerBlock, m_cfg.doublePrecission,
+                      m_cfg.isFlag(HandshakeRequest::COMPRESSED_AUDIO), m_cfg.wireFormat);
+        // with the audio scheduler, the audio worker thread only does the I/O
+        m_audio->startThread(getApp()->getServer()->isAudioSchedulerEnabled() ? AudioScheduler::IO_THREAD_PRIORITY
+                                                                               : Thread::realtimeAudioPriority);
+        if (auto pool = PluginPool::getInstance()) {
+            pool->setConfig(m_cmdIn->getHostName(), m_cfg.rate, m_cfg.samplesPerBlock);
+        }
+        if (nullptr != m_resumedChain) {
+            logln("resumed session with " << m_audio->getSize() << " plugin(s)");
+            for (int i = 0; i < m_audio->getSize(); i++) {
+                watchParameters(m_audio->getProcessor(i));
+            }
+        }
     } else {
         logln("failed to establish audio connection");
     }
+    m_resumedChain.reset();
 
     // start screen capturing
-    sock.reset(accept(m_masterSocket.get(), 2000));
+    sock.reset(acceptStream(HandshakeRequest::STREAM_SCREEN, 2000));
     if (nullptr != sock && sock->isConnected()) {
         m_screen->init(std::move(sock));
         m_screen->startThread();
@@ -96,8 +154,13 @@ void Worker::run() {
         logln("failed to establish screen connection");
     }
 
-    m_masterSocket->close();
-    m_masterSocket.reset();
+    if (nullptr != m_masterSocket) {
+        m_masterSocket->close();
+        m_masterSocket.reset();
+    } else {
+        std::lock_guard<std::mutex> lock(m_attachMtx);
+        m_attachClosed = true;
+    }
 
     // send list of plugins
     auto msgPL = std::make_shared<Message<PluginList>>(this);
@@ -118,6 +181,9 @@ void Worker::run() {
                 case AddPlugin::Type:
                     handleMessage(Message<Any>::convert<AddPlugin>(msg));
                     break;
+                case LoadChain::Type:
+                    handleMessage(Message<Any>::convert<LoadChain>(msg));
+                    break;
                 case DelPlugin::Type:
                     handleMessage(Message<Any>::convert<DelPlugin>(msg));
                     break;
@@ -175,6 +241,15 @@ void Worker::run() {
                 case CPULoad::Type:
                     handleMessage(Message<Any>::convert<CPULoad>(msg));
                     break;
+                case SetPluginBranch::Type:
+                    handleMessage(Message<Any>::convert<SetPluginBranch>(msg));
+                    break;
+                case PluginDSPLoad::Type:
+                    handleMessage(Message<Any>::convert<PluginDSPLoad>(msg));
+                    break;
+                case ChainXruns::Type:
+                    handleMessage(Message<Any>::convert<ChainXruns>(msg));
+                    break;
                 case PluginList::Type:
                     handleMessage(Message<Any>::convert<PluginList>(msg));
                     break;
@@ -187,8 +262,22 @@ void Worker::run() {
         }
     }
 
+    // the client did not quit, the connection has been lost or the client resumes the session already
+    bool lost = !m_shutdown || m_parkSession;
+
     shutdown();
     m_audio->waitForThreadToExit(-1);
+    auto chain = m_audio->getChain();
+    if (lost && m_sessionToken != 0 && nullptr != chain && chain->getSize() > 0) {
+        for (size_t i = 0; i < chain->getSize(); i++) {
+            auto proc = chain->getProcessor((int)i);
+            proc->onParamValueChange = nullptr;
+            proc->onParamGestureChange = nullptr;
+        }
+        getApp()->getServer()->parkSession(m_sessionToken, m_sessionHost, m_cfg, chain);
+    } else {
+        m_audio->clear();
+    }
     m_audio.reset();
     m_screen->waitForThreadToExit(-1);
     m_screen.reset();
@@ -214,6 +303,46 @@ void Worker::shutdown() {
     signalThreadShouldExit();
 }
 
+void Worker::parkSession() {
+    traceScope();
+    if (!m_shutdown) {
+        m_parkSession = true;
+    }
+    shutdown();
+}
+
+StreamingSocket* Worker::acceptStream(int stream, int timeoutMilliseconds) {
+    traceScope();
+    if (nullptr != m_masterSocket) {
+        // the client connects the streams in order
+        return accept(m_masterSocket.get(), timeoutMilliseconds);
+    }
+    std::unique_lock<std::mutex> lock(m_attachMtx);
+    m_attachCv.wait_for(lock, std::chrono::milliseconds(timeoutMilliseconds),
+                        [this, stream] { return nullptr != m_attached[stream]; });
+    return m_attached[stream].release();
+}
+
+bool Worker::attachStream(int stream, std::unique_ptr<StreamingSocket>& sock) {
+    traceScope();
+    if (stream < 0 || stream >= HandshakeRequest::NUM_STREAMS || sock->getHostName() != m_sessionHost) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_attachMtx);
+    if (m_attachClosed || nullptr != m_attached[stream]) {
+        return false;
+    }
+    m_attached[stream] = std::move(sock);
+    m_attachCv.notify_one();
+    return true;
+}
+
+void Worker::setSession(uint32 token, const String& host, std::shared_ptr<ProcessorChain> chain) {
+    m_sessionToken = token;
+    m_sessionHost = host;
+    m_resumedChain = chain;
+}
+
 void Worker::handleMessage(std::shared_ptr<Message<Quit>> /* msg */) {
     traceScope();
     shutdown();
@@ -237,12 +366,7 @@ void Worker::handleMessage(std::shared_ptr<Message<AddPlugin>> msg) {
         jresult["latency"] = m_audio->getLatencySamples();
         jresult["disabledSideChain"] = !wasSidechainDisabled && m_audio->isSidechainDisabled();
         runOnMsgThreadSync([&] { jresult["hasEditor"] = plugin->hasEditor(); });
-        proc->onParamValueChange = [this](int idx, int paramIdx, float val) {
-            sendParamValueChange(idx, paramIdx, val);
-        };
-        proc->onParamGestureChange = [this](int idx, int paramIdx, bool gestureIsStarting) {
-            sendParamGestureChange(idx, paramIdx, gestureIsStarting);
-        };
+        watchParameters(proc);
     }
     Message<AddPluginResult> msgResult(this);
     PLD(msgResult).setJson(jresult);
@@ -257,18 +381,8 @@ void Worker::handleMessage(std::shared_ptr<Message<AddPlugin>> msg) {
         return;
     }
     logln("sending presets...");
-    String presets;
-    bool first = true;
-    for (int i = 0; i < plugin->getNumPrograms(); i++) {
-        if (first) {
-            first = false;
-        } else {
-            presets << "|";
-        }
-        presets << plugin->getProgramName(i);
-    }
     Message<Presets> msgPresets(this);
-    msgPresets.payload.setString(presets);
+    msgPresets.payload.setString(getPresets(plugin));
     if (!msgPresets.send(m_cmdIn.get())) {
         logln("failed to send Presets message");
         m_cmdIn->close();
@@ -276,40 +390,7 @@ void Worker::handleMessage(std::shared_ptr<Message<AddPlugin>> msg) {
     }
     logln("...ok");
     logln("sending parameters...");
-    json jparams = json::array();
-    runOnMsgThreadSync([plugin, &jparams] {
-        for (auto& param : plugin->getParameters()) {
-            json jparam = {{"idx", param->getParameterIndex()},
-                           {"name", param->getName(32).toStdString()},
-                           {"defaultValue", param->getDefaultValue()},
-                           {"currentValue", param->getValue()},
-                           {"category", param->getCategory()},
-                           {"label", param->getLabel().toStdString()},
-                           {"numSteps", param->getNumSteps()},
-                           {"isBoolean", param->isBoolean()},
-                           {"isDiscrete", param->isDiscrete()},
-                           {"isMeta", param->isMetaParameter()},
-                           {"isOrientInv", param->isOrientationInverted()},
-                           {"minValue", param->getText(0.0f, 20).toStdString()},
-                           {"maxValue", param->getText(1.0f, 20).toStdString()}};
-            jparam["allValues"] = json::array();
-            for (auto& val : param->getAllValueStrings()) {
-                jparam["allValues"].push_back(val.toStdString());
-            }
-            if (jparam["allValues"].size() == 0 && param->isDiscrete() && param->getNumSteps() < 64) {
-                // try filling values manually
-                float step = 1.0f / (param->getNumSteps() - 1);
-                for (int i = 0; i < param->getNumSteps(); i++) {
-                    auto val = param->getText(step * i, 32);
-                    if (val.isEmpty()) {
-                        break;
-                    }
-                    jparam["allValues"].push_back(val.toStdString());
-                }
-            }
-            jparams.push_back(jparam);
-        }
-    });
+    auto jparams = getParameters(plugin);
     Message<Parameters> msgParams(this);
     PLD(msgParams).setJson(jparams);
     if (!msgParams.send(m_cmdIn.get())) {
@@ -329,15 +410,59 @@ void Worker::handleMessage(std::shared_ptr<Message<AddPlugin>> msg) {
     if (*msgSettings.payload.size > 0) {
         MemoryBlock block;
         block.append(msgSettings.payload.data, (size_t)*msgSettings.payload.size);
-        // restore the plugin state on the message thread, so we can hopefully avoid instabilities with parameter
-        // changes a plugin might make from this method.
-        runOnMsgThreadSync(
-            [&block, plugin] { plugin->setStateInformation(block.getData(), static_cast<int>(block.getSize())); });
+        setState(plugin, block);
     }
     logln("...ok");
     m_audio->addToRecentsList(id, m_cmdIn->getHostName());
 }
 
+void Worker::handleMessage(std::shared_ptr<Message<LoadChain>> msg) {
+    traceScope();
+    StringArray ids;
+    std::vector<MemoryBlock> states;
+    for (auto& jplug : pPLD(msg).getJson()) {
+        ids.add(jsonGetValue(jplug, "id", String()));
+        MemoryBlock block;
+        block.fromBase64Encoding(jsonGetValue(jplug, "settings", String()));
+        states.push_back(std::move(block));
+    }
+    logln("loading chain with " << ids.size() << " plugin(s)...");
+    bool wasSidechainDisabled = m_audio->isSidechainDisabled();
+    StringArray errors;
+    auto procs = m_audio->addPlugins(ids, errors);
+    json jplugins = json::array();
+    for (size_t i = 0; i < procs.size(); i++) {
+        json jplug;
+        jplug["success"] = nullptr != procs[i];
+        jplug["err"] = errors[(int)i].toStdString();
+        if (nullptr != procs[i]) {
+            auto plugin = procs[i]->getPlugin();
+            runOnMsgThreadSync([&] { jplug["hasEditor"] = plugin->hasEditor(); });
+            jplug["presets"] = getPresets(plugin).toStdString();
+            jplug["params"] = getParameters(plugin);
+            if (states[i].getSize() > 0) {
+                setState(plugin, states[i]);
+            }
+            watchParameters(procs[i]);
+            m_audio->addToRecentsList(ids[(int)i], m_cmdIn->getHostName());
+            logln("..." << ids[(int)i] << " ok");
+        } else {
+            logln("..." << ids[(int)i] << " failed: " << errors[(int)i]);
+        }
+        jplugins.push_back(jplug);
+    }
+    json jresult;
+    jresult["latency"] = m_audio->getLatencySamples();
+    jresult["disabledSideChain"] = !wasSidechainDisabled && m_audio->isSidechainDisabled();
+    jresult["plugins"] = jplugins;
+    Message<LoadChainResult> msgResult(this);
+    PLD(msgResult).setJson(jresult);
+    if (!msgResult.send(m_cmdIn.get())) {
+        logln("failed to send result");
+        m_cmdIn->close();
+    }
+}
+
 void Worker::handleMessage(std::shared_ptr<Message<DelPlugin>> msg) {
     traceScope();
     int idx = pPLD(msg).getNumber();
@@ -478,6 +603,11 @@ void Worker::handleMessage(std::shared_ptr<Message<ExchangePlugins>> msg) {
     m_audio->exchangePlugins(pDATA(msg)->idxA, pDATA(msg)->idxB);
 }
 
+void Worker::handleMessage(std::shared_ptr<Message<SetPluginBranch>> msg) {
+    traceScope();
+    m_audio->setPluginBranch(pDATA(msg)->idx, pDATA(msg)->branch);
+}
+
 void Worker::handleMessage(std::shared_ptr<Message<RecentsList>> msg) {
     traceScope();
     auto list = m_audio->getRecentsList(m_cmdIn->getHostName());
@@ -560,6 +690,20 @@ void Worker::handleMessage(std::shared_ptr<Message<CPULoad>> msg) {
     msg->send(m_cmdIn.get());
 }
 
+void Worker::handleMessage(std::shared_ptr<Message<PluginDSPLoad>> msg) {
+    traceScope();
+    auto j = m_audio->getPluginDSPLoad();
+    pPLD(msg).setJson(j);
+    msg->send(m_cmdIn.get());
+}
+
+void Worker::handleMessage(std::shared_ptr<Message<ChainXruns>> msg) {
+    traceScope();
+    auto j = m_audio->getXruns();
+    pPLD(msg).setJson(j);
+    msg->send(m_cmdIn.get());
+}
+
 void Worker::handleMessage(std::shared_ptr<Message<PluginList>> msg) {
     traceScope();
     String filterStr = pPLD(msg).getString();
@@ -682,6 +826,72 @@ bool Worker::KeyWatcher::keyPressed(const KeyPress& kp, Component*) {
     return true;
 }
 
+void Worker::watchParameters(std::shared_ptr<AGProcessor> proc) {
+    proc->onParamValueChange = [this](int idx, int paramIdx, float val) { sendParamValueChange(idx, paramIdx, val); };
+    proc->onParamGestureChange = [this](int idx, int paramIdx, bool gestureIsStarting) {
+        sendParamGestureChange(idx, paramIdx, gestureIsStarting);
+    };
+}
+
+String Worker::getPresets(std::shared_ptr<AudioPluginInstance> plugin) {
+    String presets;
+    bool first = true;
+    for (int i = 0; i < plugin->getNumPrograms(); i++) {
+        if (first) {
+            first = false;
+        } else {
+            presets << "|";
+        }
+        presets << plugin->getProgramName(i);
+    }
+    return presets;
+}
+
+json Worker::getParameters(std::shared_ptr<AudioPluginInstance> plugin) {
+    json jparams = json::array();
+    runOnMsgThreadSync([plugin, &jparams] {
+        for (auto& param : plugin->getParameters()) {
+            json jparam = {{"idx", param->getParameterIndex()},
+                           {"name", param->getName(32).toStdString()},
+                           {"defaultValue", param->getDefaultValue()},
+                           {"currentValue", param->getValue()},
+                           {"category", param->getCategory()},
+                           {"label", param->getLabel().toStdString()},
+                           {"numSteps", param->getNumSteps()},
+                           {"isBoolean", param->isBoolean()},
+                           {"isDiscrete", param->isDiscrete()},
+                           {"isMeta", param->isMetaParameter()},
+                           {"isOrientInv", param->isOrientationInverted()},
+                           {"minValue", param->getText(0.0f, 20).toStdString()},
+                           {"maxValue", param->getText(1.0f, 20).toStdString()}};
+            jparam["allValues"] = json::array();
+            for (auto& val : param->getAllValueStrings()) {
+                jparam["allValues"].push_back(val.toStdString());
+            }
+            if (jparam["allValues"].size() == 0 && param->isDiscrete() && param->getNumSteps() < 64) {
+                // try filling values manually
+                float step = 1.0f / (param->getNumSteps() - 1);
+                for (int i = 0; i < param->getNumSteps(); i++) {
+                    auto val = param->getText(step * i, 32);
+                    if (val.isEmpty()) {
+                        break;
+                    }
+                    jparam["allValues"].push_back(val.toStdString());
+                }
+            }
+            jparams.push_back(jparam);
+        }
+    });
+    return jparams;
+}
+
+void Worker::setState(std::shared_ptr<AudioPluginInstance> plugin, const MemoryBlock& block) {
+    // restore the plugin state on the message thread, so we can hopefully avoid instabilities with parameter
+    // changes a plugin might make from this method.
+    runOnMsgThreadSync(
+        [&block, plugin] { plugin->setStateInformation(block.getData(), static_cast<int>(block.getSize())); });
+}
+
 void Worker::sendParamValueChange(int idx, int paramIdx, float val) {
     logln("sending parameter update (index=" << idx << ", parame index=" << paramIdx << ") new value is " << val);
     Message<ParameterValue> msg(this);
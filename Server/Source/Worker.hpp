@@ -10,6 +10,7 @@
 
 #include <JuceHeader.h>
 #include <thread>
+#include <condition_variable>
 
 #include "AudioWorker.hpp"
 #include "Message.hpp"
@@ -27,13 +28,32 @@ class Worker : public Thread, public LogTag {
 
     Worker(std::shared_ptr<StreamingSocket> masterSocket, const HandshakeRequest& cfg);
 
+    // Session mode: the handshake connection is the command connection, the other connections are attached by the
+    // server, when they arrive at the server port
+    Worker(std::unique_ptr<StreamingSocket> cmdIn, const HandshakeRequest& cfg);
+
     ~Worker() override;
     void run() override;
 
     void shutdown();
 
+    uint64 getClientId() const { return m_cfg.clientId; }
+
+    // Takes over the connection, if the worker waits for the given stream. Returns false otherwise.
+    bool attachStream(int stream, std::unique_ptr<StreamingSocket>& sock);
+
+    // A worker with a session token parks its chain at the server, when the client disconnects without quitting. A
+    // chain, that has been resumed, replaces the empty chain of the worker. Has to be called before the worker starts.
+    void setSession(uint32 token, const String& host, std::shared_ptr<ProcessorChain> chain = nullptr);
+    uint32 getSessionToken() const { return m_sessionToken; }
+    const String& getSessionHost() const { return m_sessionHost; }
+
+    // Shuts the worker down and parks the session, as if the connection had been lost
+    void parkSession();
+
     void handleMessage(std::shared_ptr<Message<Quit>> msg);
     void handleMessage(std::shared_ptr<Message<AddPlugin>> msg);
+    void handleMessage(std::shared_ptr<Message<LoadChain>> msg);
     void handleMessage(std::shared_ptr<Message<DelPlugin>> msg);
     void handleMessage(std::shared_ptr<Message<EditPlugin>> msg);
     void handleMessage(std::shared_ptr<Message<HidePlugin>> msg, bool fromMaster = false);
@@ -44,6 +64,7 @@ class Worker : public Thread, public LogTag {
     void handleMessage(std::shared_ptr<Message<BypassPlugin>> msg);
     void handleMessage(std::shared_ptr<Message<UnbypassPlugin>> msg);
     void handleMessage(std::shared_ptr<Message<ExchangePlugins>> msg);
+    void handleMessage(std::shared_ptr<Message<SetPluginBranch>> msg);
     void handleMessage(std::shared_ptr<Message<RecentsList>> msg);
     void handleMessage(std::shared_ptr<Message<Preset>> msg);
     void handleMessage(std::shared_ptr<Message<ParameterValue>> msg);
@@ -53,6 +74,8 @@ class Worker : public Thread, public LogTag {
     void handleMessage(std::shared_ptr<Message<Rescan>> msg);
     void handleMessage(std::shared_ptr<Message<Restart>> msg);
     void handleMessage(std::shared_ptr<Message<CPULoad>> msg);
+    void handleMessage(std::shared_ptr<Message<PluginDSPLoad>> msg);
+    void handleMessage(std::shared_ptr<Message<ChainXruns>> msg);
     void handleMessage(std::shared_ptr<Message<PluginList>> msg);
 
   private:
@@ -60,10 +83,23 @@ class Worker : public Thread, public LogTag {
     std::unique_ptr<StreamingSocket> m_cmdIn;
     std::unique_ptr<StreamingSocket> m_cmdOut;
     HandshakeRequest m_cfg;
+
+    std::unique_ptr<StreamingSocket> m_attached[HandshakeRequest::NUM_STREAMS];
+    bool m_attachClosed = false;
+    std::mutex m_attachMtx;
+    std::condition_variable m_attachCv;
+
+    uint32 m_sessionToken = 0;
+    // only streams from the host of the client can be attached
+    String m_sessionHost;
+    std::shared_ptr<ProcessorChain> m_resumedChain;
+
+    StreamingSocket* acceptStream(int stream, int timeoutMilliseconds);
     std::shared_ptr<AudioWorker> m_audio;
     std::shared_ptr<ScreenWorker> m_screen;
     std::atomic_int m_activeEditorIdx{-1};
     std::atomic_bool m_shutdown{false};
+    std::atomic_bool m_parkSession{false};
     MessageFactory m_msgFactory;
 
     bool m_noPluginListFilter = false;
@@ -77,6 +113,10 @@ class Worker : public Thread, public LogTag {
     std::unique_ptr<KeyWatcher> m_keyWatcher;
 
     void sendKeys(const std::vector<uint16_t>& keysToPress);
+    static String getPresets(std::shared_ptr<AudioPluginInstance> plugin);
+    static json getParameters(std::shared_ptr<AudioPluginInstance> plugin);
+    static void setState(std::shared_ptr<AudioPluginInstance> plugin, const MemoryBlock& block);
+    void watchParameters(std::shared_ptr<AGProcessor> proc);
     void sendParamValueChange(int idx, int paramIdx, float val);
     void sendParamGestureChange(int idx, int paramIdx, bool guestureIsStarting);
 